@@ -0,0 +1,12 @@
+// Dispatch-bound arithmetic loop. Each iteration runs ~45 tiny instructions,
+// most of them constant pushes and arithmetic, so the run time is dominated
+// by getting from one instruction handler to the next.
+var i = 0;
+var sum = 0;
+while (i < 2000000)
+{
+    sum = sum + (1 + 2 * 3 - 4 / 2 + 5 * 6 - 7 + 8 * 9 - 10 / 5 + 11 * 12 - 13) -
+          (14 * 15 - 16 + 17 / 17 - 18 * 19 + 20 - 21 * 22 + 23);
+    i = i + 1;
+}
+print sum;
@@ -0,0 +1,15 @@
+// callback heavy: a local helper captures the loop's accumulator and is called a million
+// times. It never escapes, so no closure or upvalue is ever allocated for it
+fun run(n) {
+    var total = 0;
+    fun step(x) { total = total + x; }
+    var i = 0;
+    while (i < n) {
+        step(i);
+        i = i + 1;
+    }
+    return total;
+}
+var start = clock();
+print run(1000000);
+print clock() - start;
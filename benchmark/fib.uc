@@ -0,0 +1,8 @@
+// call heavy: every fib(n) makes two calls, fib(30) is about 2.7 million of them
+fun fib(n) {
+    if (n < 2) return n;
+    return fib(n - 2) + fib(n - 1);
+}
+var start = clock();
+print fib(30);
+print clock() - start; // seconds spent in the calls alone, no startup or compile time
@@ -0,0 +1,11 @@
+// Global variable traffic. Almost every instruction in the loop body reads or
+// writes a top-level variable.
+var i = 0;
+var sum = 0;
+var step = 3;
+while (i < 2000000)
+{
+    sum = sum + step;
+    i = i + 1;
+}
+print sum;
@@ -0,0 +1,12 @@
+// tiny helpers called in a hot loop, what inlining is for. Compare with --no-inline
+fun square(x) { return x * x; }
+fun add(a, b) { return a + b; }
+var start = clock();
+var total = 0;
+var i = 0;
+while (i < 1000000) {
+    total = add(total, square(i));
+    i = i + 1;
+}
+print total;
+print clock() - start;
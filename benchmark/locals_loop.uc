@@ -0,0 +1,14 @@
+// Local-variable loop. On the stack backend every read of i or sum is an
+// OP_GET_LOCAL copy onto the stack; the register backend reads them in place,
+// so this is where the two instruction sets differ the most.
+{
+    var i = 0;
+    var sum = 0;
+    var step = 3;
+    while (i < 5000000)
+    {
+        sum = sum + i * step - i;
+        i = i + 1;
+    }
+    print sum;
+}
@@ -0,0 +1,25 @@
+// property heavy: every iteration reads and writes fields through a handful of access
+// sites. The instances all share one shape, so each site hits its inline cache
+class Vec {
+    init(x, y) {
+        this.x = x;
+        this.y = y;
+    }
+    add(other) {
+        this.x = this.x + other.x;
+        this.y = this.y + other.y;
+    }
+}
+fun run(n) {
+    var total = Vec(0, 0);
+    var step = Vec(1, 2);
+    var i = 0;
+    while (i < n) {
+        total.add(step);
+        i = i + 1;
+    }
+    return total.x + total.y;
+}
+var start = clock();
+print run(1000000);
+print clock() - start;
@@ -0,0 +1,8 @@
+// a loop written as tail recursion, a million calls in one frame
+fun loop(i, acc) {
+    if (i == 0) return acc;
+    return loop(i - 1, acc + i);
+}
+var start = clock();
+print loop(1000000, 0);
+print clock() - start;
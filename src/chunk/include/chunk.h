@@ -7,36 +7,143 @@
 
 /**
  *  Each instruction has a one-byte opcode which determines what kind of instruction
- *  we are dealing with. They are defined here
+ *  we are dealing with. They are listed ONCE here as an X-macro so the enum, the VM's
+ *  dispatch table and anything else that needs "one entry per opcode" are generated
+ *  from the same list and can never drift apart. The second column is the number of
+ *  operand bytes that follow the opcode in the bytecode, the third is how many values
+ *  the instruction leaves on the stack minus how many it takes off.
+ *
+ *  The _NUM and _STR variants at the end are never emitted by the compiler. The VM patches
+ *  a generic instruction into one of them in place once it has seen its operand types.
  */
+#define OPCODE_LIST(X)                                                                    \
+    X(OP_CONSTANT, 1, +1)                                                                 \
+    X(OP_NIL, 0, +1)                                                                      \
+    X(OP_TRUE, 0, +1)                                                                     \
+    X(OP_FALSE, 0, +1)                                                                    \
+    X(OP_POP, 0, -1)                                                                      \
+    X(OP_GET_LOCAL, 1, +1)                                                                \
+    X(OP_SET_LOCAL, 1, 0)                                                                 \
+    X(OP_GET_GLOBAL, 1, +1)                                                               \
+    X(OP_DEFINE_GLOBAL, 1, -1)                                                            \
+    X(OP_SET_GLOBAL, 1, 0)                                                                \
+    X(OP_GET_UPVALUE, 1, +1)                                                              \
+    X(OP_SET_UPVALUE, 1, 0)                                                               \
+    X(OP_EQUAL, 0, -1)                                                                    \
+    X(OP_GREATER, 0, -1)                                                                  \
+    X(OP_LESS, 0, -1)                                                                     \
+    X(OP_ADD, 0, -1)                                                                      \
+    X(OP_SUBTRACT, 0, -1)                                                                 \
+    X(OP_MULTIPLY, 0, -1)                                                                 \
+    X(OP_DIVIDE, 0, -1)                                                                   \
+    X(OP_NOT, 0, 0)                                                                       \
+    X(OP_NEGATE, 0, 0)                                                                    \
+    X(OP_PRINT, 0, -1)                                                                    \
+    X(OP_JUMP, 2, 0)                                                                      \
+    X(OP_JUMP_IF_FALSE, 2, 0)                                                             \
+    X(OP_LOOP, 2, 0)                                                                      \
+    X(OP_CALL, 1, 0)                    /* really -argCount, the compiler adjusts */      \
+    X(OP_TAIL_CALL, 1, 0)               /* OP_CALL reusing the caller's frame */          \
+    X(OP_INLINE_CALL, 3, 0)             /* argCount, function, bytes of inlined body */   \
+    X(OP_DROP_UNDER, 1, 0)              /* really -count, drops count values below top */ \
+    X(OP_CLOSURE, 1, +1)                                                                  \
+    X(OP_CLOSE_UPVALUE, 0, -1)                                                            \
+    X(OP_RETURN, 0, -1)                 /* pops the return value */                       \
+    X(OP_CLASS, 1, +1)                                                                    \
+    X(OP_INHERIT, 0, -1)                /* copies the superclass' methods, pops subclass */ \
+    X(OP_METHOD, 1, -1)                                                                   \
+    X(OP_GET_PROPERTY, 1, 0)            /* operand is a property cache, not a constant */ \
+    X(OP_SET_PROPERTY, 1, -1)           /* same */                                        \
+    X(OP_GET_SUPER, 1, -1)                                                                \
+    X(OP_INVOKE, 2, 0)                  /* cache, argCount; really -argCount */           \
+    X(OP_SUPER_INVOKE, 2, -1)           /* same, really -argCount - 1 */                  \
+    X(OP_THROW, 0, -1)                  /* see ExceptionHandler, nothing marks a try */   \
+    X(OP_BUILD_LIST, 1, +1)             /* count; really 1 - count, pops the items */     \
+    X(OP_GET_INDEX, 0, -1)              /* [list, index] -> item */                       \
+    X(OP_SET_INDEX, 0, -2)              /* [list, index, item] -> item */                 \
+    /* superinstructions, each one replaces a common sequence of the ops above */         \
+    X(OP_NOT_EQUAL, 0, -1)              /* OP_EQUAL; OP_NOT */                            \
+    X(OP_GREATER_EQUAL, 0, -1)          /* OP_LESS; OP_NOT */                             \
+    X(OP_LESS_EQUAL, 0, -1)             /* OP_GREATER; OP_NOT */                          \
+    X(OP_ADD_LOCAL_CONST, 2, +1)        /* OP_GET_LOCAL slot; OP_CONSTANT idx; OP_ADD */  \
+    X(OP_JUMP_IF_FALSE_POP, 2, -1)      /* OP_JUMP_IF_FALSE; OP_POP on both paths */      \
+    /* wide forms, 24 bit operand, only used when the short one does not fit */           \
+    X(OP_CONSTANT_LONG, 3, +1)                                                            \
+    X(OP_GET_GLOBAL_LONG, 3, +1)                                                          \
+    X(OP_DEFINE_GLOBAL_LONG, 3, -1)                                                       \
+    X(OP_SET_GLOBAL_LONG, 3, 0)                                                           \
+    X(OP_JUMP_LONG, 3, 0)                                                                 \
+    X(OP_JUMP_IF_FALSE_LONG, 3, 0)                                                        \
+    X(OP_JUMP_IF_FALSE_POP_LONG, 3, -1)                                                   \
+    X(OP_LOOP_LONG, 3, 0)                                                                 \
+    X(OP_CLOSURE_LONG, 3, +1)                                                             \
+    X(OP_CLASS_LONG, 3, +1)                                                               \
+    X(OP_METHOD_LONG, 3, -1)                                                              \
+    X(OP_GET_PROPERTY_LONG, 3, 0)                                                         \
+    X(OP_SET_PROPERTY_LONG, 3, -1)                                                        \
+    X(OP_GET_SUPER_LONG, 3, -1)                                                           \
+    X(OP_INVOKE_LONG, 4, 0)                                                               \
+    X(OP_SUPER_INVOKE_LONG, 4, -1)                                                        \
+    /* quickened forms, only ever written by the VM (see QUICKEN in vm.c) */              \
+    X(OP_ADD_NUM, 0, -1)                                                                  \
+    X(OP_ADD_STR, 0, -1)                                                                  \
+    X(OP_SUBTRACT_NUM, 0, -1)                                                             \
+    X(OP_MULTIPLY_NUM, 0, -1)                                                             \
+    X(OP_DIVIDE_NUM, 0, -1)                                                               \
+    X(OP_GREATER_NUM, 0, -1)                                                              \
+    X(OP_LESS_NUM, 0, -1)
+
 typedef enum
 {
-    OP_CONSTANT,
-    OP_NIL,
-    OP_TRUE,
-    OP_FALSE,
-    OP_POP,
-    OP_GET_LOCAL,
-    OP_SET_LOCAL,
-    OP_GET_GLOBAL,
-    OP_DEFINE_GLOBAL,
-    OP_SET_GLOBAL,
-    OP_EQUAL,
-    OP_GREATER,
-    OP_LESS,
-    OP_ADD,
-    OP_SUBTRACT,
-    OP_MULTIPLY,
-    OP_DIVIDE,
-    OP_NOT,
-    OP_NEGATE,
-    OP_PRINT,
-    OP_JUMP,
-    OP_JUMP_IF_FALSE,
-    OP_LOOP,
-    OP_RETURN,
+#define OPCODE_ENUM(name, operandBytes, stackEffect) name,
+    OPCODE_LIST(OPCODE_ENUM)
+#undef OPCODE_ENUM
+    OP_COUNT // number of opcodes, NOT an instruction
 } OpCode;
 
+// most shapes one property access site remembers, a site seeing more is megamorphic and
+// keeps evicting the oldest
+#define PROPERTY_CACHE_WAYS 4
+
+/*
+ * Instances with shape have the property at fields[index]. An invoke site caches methods
+ * instead: instances of klass with shape, which has no field of that name, call method.
+ * OP_SUPER_INVOKE knows it has no field to look at and leaves shape NULL.
+ */
+typedef struct
+{
+    struct ObjShape *shape;
+    struct ObjShape *newShape; // shape after a set, only differs from shape when it adds the field
+    uint32_t index;
+    struct ObjClass *klass; // invoke sites only
+    Value method;           // same
+} PropertyCacheEntry;
+
+/*
+ * Inline cache of one property access or invoke site, every site gets its own.
+ * Entries with a NULL shape and klass are unused.
+ */
+typedef struct
+{
+    uint32_t name; // constant index of the property's name
+    uint8_t next;  // entry the next miss overwrites
+    PropertyCacheEntry entries[PROPERTY_CACHE_WAYS];
+} PropertyCache;
+
+/*
+ * One try block. Entering it costs nothing at runtime, no instruction marks it: only
+ * when something is thrown does the VM look up the instruction that threw in its
+ * chunk's handlers. A covering entry sends it to the catch block with the stack cut back
+ * to stackDepth and the thrown value pushed as the catch variable.
+ */
+typedef struct
+{
+    uint32_t start;   // offset of the try block's first instruction
+    uint32_t end;     // offset just past its last one
+    uint32_t handler; // offset of the catch block
+    int stackDepth;   // locals of the frame in scope at the try, the catch variable goes above
+} ExceptionHandler;
+
 /**
  * Bytecode is a series of instructions. Hence the need for this to be dynamically
  * sized
@@ -46,8 +153,15 @@ typedef struct
     uint32_t count;       // num of elements we currently have allocated
     uint32_t capacity;    // num of elements we are able to accomodate
     ValueArray constants; // store chunk's constants, every chunk will have constant pool
+    PropertyCache *caches; // inline caches of the property instructions
+    int cacheCount;
+    int cacheCapacity;
+    ExceptionHandler *handlers; // inner try blocks come before the ones around them
+    int handlerCount;
+    int handlerCapacity;
     uint8_t *code;
     int *lines; // each entry in this array is the line number of the corresponding instruction
+    int maxStackDepth; // most values this chunk's code ever has on the stack at once, set by the compiler
 } Chunk;
 
 /**
@@ -89,4 +203,39 @@ void Chunk_WriteChunk(Chunk *chunk, uint8_t byte, int line);
  * @param value The value to add as a constant.
  * @return The index where the last constant was appended.
  */
-int Chunk_AddConstant(Chunk *chunk, Value value);
\ No newline at end of file
+int Chunk_AddConstant(Chunk *chunk, Value value);
+
+/**
+ * @brief Add an empty inline cache for a property instruction.
+ *
+ * @param chunk The chunk the instruction is in.
+ * @param name Constant index of the property name.
+ * @return The index of the new cache, the instruction's operand.
+ */
+int Chunk_AddPropertyCache(Chunk *chunk, int name);
+
+/**
+ * @brief Record a try block in the chunk's exception table. Blocks nested in it must be
+ * added first, the VM takes the first entry that covers the throwing instruction.
+ *
+ * @param chunk The chunk the try block is in.
+ * @param handler Offsets and stack depth, see ExceptionHandler.
+ */
+void Chunk_AddHandler(Chunk *chunk, ExceptionHandler handler);
+
+/**
+ * @brief Size in bytes (opcode plus operands) of the instruction starting at offset.
+ *
+ * @param chunk The chunk holding the instruction.
+ * @param offset Offset of the instruction's opcode.
+ * @return Number of bytes until the next instruction.
+ */
+int Chunk_InstructionLength(Chunk *chunk, int offset);
+
+/**
+ * @brief Net number of values an instruction pushes (negative if it pops more than it pushes).
+ *
+ * @param opcode
+ * @return int
+ */
+int Chunk_StackEffect(uint8_t opcode);
\ No newline at end of file
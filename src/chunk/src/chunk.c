@@ -3,6 +3,7 @@
 #include "value.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 void Chunk_InitChunk(Chunk *chunk)
 {
@@ -11,6 +12,13 @@ void Chunk_InitChunk(Chunk *chunk)
     chunk->capacity = 0;
     chunk->code = NULL;
     chunk->lines = NULL;
+    chunk->maxStackDepth = 0;
+    chunk->caches = NULL;
+    chunk->cacheCount = 0;
+    chunk->cacheCapacity = 0;
+    chunk->handlers = NULL;
+    chunk->handlerCount = 0;
+    chunk->handlerCapacity = 0;
     // init ValueArray as well for constants in chunk
     Value_initValueArray(&chunk->constants);
 }
@@ -36,6 +44,8 @@ void Chunk_FreeChunk(Chunk *chunk)
 {
     FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
     FREE_ARRAY(int, chunk->lines, chunk->capacity);
+    FREE_ARRAY(PropertyCache, chunk->caches, chunk->cacheCapacity);
+    FREE_ARRAY(ExceptionHandler, chunk->handlers, chunk->handlerCapacity);
     freeValueArray(&chunk->constants);
     Chunk_InitChunk(chunk);
 }
@@ -46,4 +56,46 @@ int Chunk_AddConstant(Chunk *chunk, Value value)
     writeValueArray(&chunk->constants, value);
     // return index where constant was appended so we can locate it later
     return chunk->constants.count - 1;
+}
+
+int Chunk_AddPropertyCache(Chunk *chunk, int name)
+{
+    if (chunk->cacheCapacity < chunk->cacheCount + 1)
+    {
+        int oldCapacity = chunk->cacheCapacity;
+        chunk->cacheCapacity = GROW_CAPACITY(oldCapacity);
+        chunk->caches = GROW_ARRAY(PropertyCache, chunk->caches, oldCapacity, chunk->cacheCapacity);
+    }
+    PropertyCache *cache = &chunk->caches[chunk->cacheCount];
+    memset(cache, 0, sizeof(PropertyCache));
+    cache->name = (uint32_t)name;
+    return chunk->cacheCount++;
+}
+
+void Chunk_AddHandler(Chunk *chunk, ExceptionHandler handler)
+{
+    if (chunk->handlerCapacity < chunk->handlerCount + 1)
+    {
+        int oldCapacity = chunk->handlerCapacity;
+        chunk->handlerCapacity = GROW_CAPACITY(oldCapacity);
+        chunk->handlers = GROW_ARRAY(ExceptionHandler, chunk->handlers, oldCapacity,
+                                     chunk->handlerCapacity);
+    }
+    chunk->handlers[chunk->handlerCount++] = handler;
+}
+
+int Chunk_InstructionLength(Chunk *chunk, int offset)
+{
+#define OPCODE_OPERAND_BYTES(name, operandBytes, stackEffect) operandBytes,
+    static const uint8_t operandBytes[] = {OPCODE_LIST(OPCODE_OPERAND_BYTES)};
+#undef OPCODE_OPERAND_BYTES
+    return 1 + operandBytes[chunk->code[offset]];
+}
+
+int Chunk_StackEffect(uint8_t opcode)
+{
+#define OPCODE_STACK_EFFECT(name, operandBytes, stackEffect) stackEffect,
+    static const int8_t stackEffects[] = {OPCODE_LIST(OPCODE_STACK_EFFECT)};
+#undef OPCODE_STACK_EFFECT
+    return stackEffects[opcode];
 }
\ No newline at end of file
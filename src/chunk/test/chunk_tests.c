@@ -32,7 +32,7 @@ void Test_Chunk_InitChunk(void)
 void Test_Chunk_AddConstant(void)
 {
     Chunk testChunk = {0};
-    Value testVal = {.type = VAL_NUMBER, .as = {.number = 0xF0F0}};
+    Value testVal = NUMBER_VAL(0xF0F0);
 
     int constantIdx = Chunk_AddConstant(&testChunk, testVal);
     TEST_ASSERT_EQUAL(testChunk.constants.count , 1);
@@ -40,6 +40,22 @@ void Test_Chunk_AddConstant(void)
     TEST_ASSERT_EQUAL(AS_NUMBER(testChunk.constants.values[constantIdx]), AS_NUMBER(testVal));
     TEST_ASSERT_EQUAL(constantIdx, 0);
 }
+
+void Test_Chunk_InstructionLengthAndStackEffect(void)
+{
+    Chunk testChunk = {0};
+    Chunk_WriteChunk(&testChunk, OP_CONSTANT_LONG, 1);
+    Chunk_WriteChunk(&testChunk, 0, 1);
+    Chunk_WriteChunk(&testChunk, 1, 1);
+    Chunk_WriteChunk(&testChunk, 0, 1);
+    Chunk_WriteChunk(&testChunk, OP_ADD, 1);
+
+    TEST_ASSERT_EQUAL(4, Chunk_InstructionLength(&testChunk, 0));
+    TEST_ASSERT_EQUAL(1, Chunk_InstructionLength(&testChunk, 4));
+    TEST_ASSERT_EQUAL(1, Chunk_StackEffect(OP_CONSTANT_LONG));
+    TEST_ASSERT_EQUAL(-1, Chunk_StackEffect(OP_ADD));
+    TEST_ASSERT_EQUAL(-1, Chunk_StackEffect(OP_JUMP_IF_FALSE_POP));
+}
  
 int main(void)
 {
@@ -47,6 +63,7 @@ int main(void)
 
     RUN_TEST(Test_Chunk_InitChunk);
     RUN_TEST(Test_Chunk_AddConstant);
+    RUN_TEST(Test_Chunk_InstructionLengthAndStackEffect);
  
   return UNITY_END();
 }
\ No newline at end of file
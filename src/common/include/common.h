@@ -5,7 +5,37 @@
 #include <stdio.h>
 #include <stddef.h>
 
-#define DEBUG_PRINT_CODE
-#define DEBUG_TRACE_EXECUTION
+// Define DEBUG_PRINT_CODE (or configure with -DURBANC_PRINT_CODE=ON) to disassemble every
+// chunk once it is compiled. Execution tracing is a runtime switch instead, see Vm_SetTracing.
+
+// Define PROFILE_OPCODE_PAIRS (or configure with -DURBANC_PROFILE_OPCODE_PAIRS=ON) to count
+// every pair of consecutively executed opcodes and print the most frequent ones when the
+// VM shuts down. Used to decide which superinstructions are worth adding.
+
+// Define DEBUG_STRESS_GC (or configure with -DURBANC_STRESS_GC=ON) to collect garbage on
+// every allocation instead of when the heap has grown enough, mostly young collections
+// with a full one now and then. Slow, but an object some C code forgot to keep reachable,
+// or to pass through writeBarrier, is freed right away instead of once in a blue moon.
+// DEBUG_LOG_GC (-DURBANC_LOG_GC=ON) prints how much each collection freed.
+
+// Pack every Value into one 64 bit word (see value.h). Define URBANC_NO_NAN_BOXING
+// (or configure with -DURBANC_NAN_BOXING=OFF) to get the 16 byte tagged union back.
+#ifndef URBANC_NO_NAN_BOXING
+#define NAN_BOXING
+#endif
+
+// Threaded dispatch: GCC and Clang support "labels as values" which lets Vm_Run jump
+// straight from one instruction handler to the next. Define URBANC_NO_COMPUTED_GOTO
+// (or configure with -DURBANC_COMPUTED_GOTO=OFF) to force the portable switch loop.
+#if defined(__GNUC__) && !defined(URBANC_NO_COMPUTED_GOTO)
+#define USE_COMPUTED_GOTO
+#endif
+
+// Small blocks come from size-class pools instead of malloc (see Memory_Reallocate). Define
+// URBANC_NO_POOL_ALLOCATOR (or configure with -DURBANC_POOL_ALLOCATOR=OFF) to send every
+// block to malloc, so tools like AddressSanitizer see each one on its own.
+#ifndef URBANC_NO_POOL_ALLOCATOR
+#define POOL_ALLOCATOR
+#endif
 
 #define UINT8_COUNT (UINT8_MAX + 1) // limit on number of locals in scope at once
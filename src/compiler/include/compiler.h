@@ -5,4 +5,24 @@
 
 #include <stdbool.h>
 
-bool Compiler_Compile(const char *source, Chunk *chunk);
+/**
+ * @brief Compile a whole script into the implicit top level function the VM runs.
+ *
+ * @param source - user code
+ * @return ObjFunction* - the script's function, NULL if there was a compile error
+ */
+ObjFunction *Compiler_Compile(const char *source);
+
+/**
+ * @brief Mark the functions being compiled, their constants aren't reachable from
+ * anywhere else yet. Called by the garbage collector.
+ */
+void Compiler_MarkRoots();
+
+/**
+ * @brief Turn inlining of small global functions at their call sites on or off, it is on
+ * by default. Applies to code compiled afterwards.
+ *
+ * @param enabled
+ */
+void Compiler_SetInlining(bool enabled);
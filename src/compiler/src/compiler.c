@@ -2,6 +2,7 @@
 
 #include "chunk.h"
 #include "common.h"
+#include "memory.h"
 #include "scanner.h"
 #include "value.h"
 
@@ -15,6 +16,8 @@
 #endif // DEBUG_PRINT_CODE
 
 #define MAX_STACK_FRAMES 64
+// largest operand a wide (*_LONG) instruction can carry
+#define UINT24_MAX 0xffffff
 
 typedef struct
 {
@@ -54,20 +57,82 @@ typedef struct
 
 typedef struct
 {
-    Token name; // name of the variable
-    int depth;  // scope depth of the block where the local was declared
+    Token name;      // name of the variable
+    int depth;       // scope depth of the block where the local was declared
+    bool isCaptured; // a closure holds on to it, it has to be moved off the stack when it goes away
 } Local;
 
-typedef struct
+// the top level code is compiled into an implicit function too, the VM calls it to run the script
+typedef enum
 {
+    TYPE_FUNCTION,
+    TYPE_INITIALIZER, // a class' init() method, always returns 'this'
+    TYPE_METHOD,
+    TYPE_SCRIPT
+} FunctionType;
+
+/**
+ * One of these per function being compiled. They form a stack through enclosing, the
+ * innermost one (current) is the function whose chunk code is emitted into.
+ */
+typedef struct Compiler
+{
+    struct Compiler *enclosing; // compiler of the surrounding function, NULL for the script
+    ObjFunction *function;      // function whose chunk is being filled
+    FunctionType type;
     Local locals[UINT8_COUNT]; // flat array of all locals in scope during each point in compilation
     int localCount;            // counts number of locals are in scope
+    UpvalueInfo upvalues[UINT8_COUNT]; // variables captured so far, function->upvalueCount of them
+    bool escapes;              // the function may be called after its declaring frame is gone
+    bool nestedCapture;        // a function nested in this one captures through our upvalues
+    int inlineFloor;           // while inlining a call, locals below this belong to the caller
     int scopeDepth;            // number of blocks surrounding current bit of code we're compiling
+    // peephole state used to fuse instruction sequences into superinstructions
+    int lastInstruction;     // code offset of the most recently emitted opcode
+    int previousInstruction; // code offset of the opcode emitted before that one
+    int lastJumpTarget;      // highest code offset some jump or loop lands on
+    int stackDepth;          // values on the VM stack after the last emitted instruction
+    int tryDepth;            // try blocks around the code being compiled
+    // a global function just loaded that a call right after may inline, see call()
+    struct InlineCandidate *calleeCandidate;
+    int calleeLoadedAt; // code offset of the instruction that loaded it
 } Compiler;
 
+/*
+ * Inlining. A global function whose whole body is 'return <expression>;', with an
+ * expression that is small, calls nothing and has no jumps, is recorded as a candidate
+ * when its declaration is compiled. A call to it compiled later in the same source then
+ * gets a copy of the expression, compiled again from the function's own tokens with the
+ * parameters bound to the arguments on the stack. Those tokens carry the function's
+ * line numbers, so the inlined code maps back to the function's source.
+ *
+ * The global can still be reassigned at runtime, so OP_INLINE_CALL checks the callee is
+ * the function that was inlined and makes a real call if it isn't.
+ */
+#define INLINE_BUDGET 32 // most bytes a candidate's expression may compile to
+#define INLINE_CANDIDATES_MAX 64
+
+typedef struct InlineCandidate
+{
+    int global;            // slot of the global it is declared as
+    ObjFunction *function; // the compiled function, what OP_INLINE_CALL expects to find
+    Scanner params;        // scanner position right after the '(' of its parameters
+} InlineCandidate;
+
+static InlineCandidate inlineCandidates[INLINE_CANDIDATES_MAX];
+static int inlineCandidateCount = 0;
+static bool inliningEnabled = true;
+
+// one per class declaration being compiled, innermost first
+typedef struct ClassCompiler
+{
+    struct ClassCompiler *enclosing;
+    bool hasSuperclass; // 'super' is a local of the class body's scope
+} ClassCompiler;
+
 Parser parser;
 Compiler *current = NULL;
-Chunk *compilingChunk;
+ClassCompiler *currentClass = NULL;
 
 static void Compiler_PrintStackTrace()
 {
@@ -85,7 +150,7 @@ static void Compiler_PrintStackTrace()
 
 static Chunk *currentChunk()
 {
-    return compilingChunk;
+    return &current->function->chunk;
 }
 
 static void errorAt(Token *token, const char *message)
@@ -203,77 +268,198 @@ static bool match(TokenType type)
     return true;
 }
 
+/**
+ * @brief Track values being added to (or taken off) the current function's stack frame
+ * without an instruction doing it, and remember the deepest the frame gets.
+ *
+ * @param delta - net number of values pushed
+ */
+static void adjustStackDepth(int delta)
+{
+    current->stackDepth += delta;
+    if (current->stackDepth > currentChunk()->maxStackDepth)
+        currentChunk()->maxStackDepth = current->stackDepth;
+}
+
 static void emitByte(uint8_t byte)
 {
     // write opcode or operand to prev line so runtime errors are associated w it
     Chunk_WriteChunk(currentChunk(), byte, parser.previous.line);
 }
 
+/**
+ * @brief Emit an opcode (as opposed to an operand byte). Remembers where the last two
+ * instructions started so the superinstruction peephole can look back at them.
+ *
+ * Also tracks how deep the stack gets. The code we emit is structured, every branch
+ * leaves the stack as deep as the other one, so following the instructions in the
+ * order they are emitted gives the exact depth at each point. The deepest one ends up
+ * in the chunk and the VM reserves that much stack up front.
+ *
+ * @param op - opcode to emit
+ */
+static void emitOp(uint8_t op)
+{
+    current->previousInstruction = current->lastInstruction;
+    current->lastInstruction = currentChunk()->count;
+    emitByte(op);
+    adjustStackDepth(Chunk_StackEffect(op));
+}
+
+/**
+ * @brief Implicit return at the end of a function body (or a bare 'return;'), functions
+ * without a return value return nil.
+ */
 static void emitReturn()
 {
-    emitByte(OP_RETURN);
+    // an initializer hands back the new instance, which is in slot 0
+    if (current->type == TYPE_INITIALIZER)
+    {
+        emitOp(OP_GET_LOCAL);
+        emitByte(0);
+    }
+    else
+        emitOp(OP_NIL);
+    emitOp(OP_RETURN);
 }
 
 /**
- * @brief
+ * @brief Add value to the chunk's constant table
  *
  * @param value
- * @return uint8_t
+ * @return int - index of the constant, fits in 24 bits
  */
-static uint8_t makeConstant(Value value)
+static int makeConstant(Value value)
 {
-    // add value to constant array
+    // value may be a new object nothing refers to yet, the constant array may have to grow
+    if (IS_OBJ(value))
+        Memory_PushRoot(AS_OBJ(value));
     int constant = Chunk_AddConstant(currentChunk(), value);
-    if (constant > UINT8_MAX)
+    // the function may have grown old in an earlier collection
+    writeBarrier((Obj *)current->function, value);
+    if (IS_OBJ(value))
+        Memory_PopRoot();
+    if (constant > UINT24_MAX)
     {
         error("Too many constants in one chunk.");
         return 0;
     }
 
-    return (uint8_t)constant;
+    return constant;
+}
+
+/**
+ * @brief Emit a 24 bit operand, most significant byte first like the 16 bit jump offsets
+ *
+ * @param operand
+ */
+static void emitUint24(int operand)
+{
+    emitByte((operand >> 16) & 0xff);
+    emitByte((operand >> 8) & 0xff);
+    emitByte(operand & 0xff);
+}
+
+/**
+ * @brief Emit an instruction taking an index operand (constant or global slot). Uses
+ * the compact one byte form when the index fits and the 24 bit *_LONG form otherwise,
+ * so small scripts never pay for the big ones.
+ *
+ * @param op - short form of the instruction
+ * @param longOp - wide form of the same instruction
+ * @param operand - index
+ */
+static void emitIndexed(uint8_t op, uint8_t longOp, int operand)
+{
+    if (operand <= UINT8_MAX)
+    {
+        emitOp(op);
+        emitByte((uint8_t)operand);
+        return;
+    }
+    emitOp(longOp);
+    emitUint24(operand);
+}
+
+/**
+ * @brief Map a short jump opcode to its 24 bit *_LONG form
+ */
+static uint8_t longJumpOp(uint8_t op)
+{
+    switch (op)
+    {
+    case OP_JUMP:
+        return OP_JUMP_LONG;
+    case OP_JUMP_IF_FALSE:
+        return OP_JUMP_IF_FALSE_LONG;
+    case OP_JUMP_IF_FALSE_POP:
+        return OP_JUMP_IF_FALSE_POP_LONG;
+    case OP_LOOP:
+        return OP_LOOP_LONG;
+    default:
+        return op;
+    }
 }
 
 /**
  * @brief This function is used to patch the offset of a jump instruction. Called by
  * emitJump and before patchJump.
  *
+ * Every jump is emitted in its wide form with a 24 bit placeholder since we don't know
+ * yet how far it goes. relaxJumps() shrinks the ones that fit back into 16 bits once
+ * the whole chunk is compiled.
+ *
  * @param instruction - placeholder instruction to be patched
  * @return int - offset of the jump instruction
  */
 static int emitJump(uint8_t instruction)
 {
     // emit opcode byte bc multiple instructions use this function 'if' and
-    emitByte(instruction);
-    // 16 bit offset lets us jump up to 65,535 bytes forward or backward
-    // SHOULD be plents
-    emitByte(0xff);
-    emitByte(0xff);
+    emitOp(longJumpOp(instruction));
+    emitUint24(UINT24_MAX);
 
-    return currentChunk()->count - 2;
+    return currentChunk()->count - 3;
+}
+
+/**
+ * @brief Emit an opcode followed by its one byte operand
+ *
+ * @param op - opcode
+ * @param operand - operand byte
+ */
+static void emitBytes(uint8_t op, uint8_t operand)
+{
+    emitOp(op);
+    emitByte(operand);
 }
 
-static void emitBytes(uint8_t byte1, uint8_t byte2)
+/**
+ * @brief Record that a jump or loop will land on the NEXT instruction emitted. Code
+ * before and after a jump target can not be fused into one superinstruction.
+ *
+ * @return int - code offset of the target
+ */
+static int markJumpTarget()
 {
-    emitByte(byte1);
-    emitByte(byte2);
+    current->lastJumpTarget = currentChunk()->count;
+    return currentChunk()->count;
 }
 
 static void emitLoop(int loopStart)
 {
-    // emit new loop instruction.
-    emitByte(OP_LOOP);
+    // emit new loop instruction, wide for now, see relaxJumps()
+    emitOp(OP_LOOP_LONG);
 
-    int offset = currentChunk()->count - loopStart + 2;
-    if (offset > UINT16_MAX)
+    int offset = currentChunk()->count - loopStart + 3;
+    if (offset > UINT24_MAX)
         error("Loop body too large.");
 
-    emitByte((offset >> 8) & 0xff);
-    emitByte(offset & 0xff);
+    emitUint24(offset);
 }
 
 static void emitConstant(Value value)
 {
-    emitBytes(OP_CONSTANT, makeConstant(value));
+    emitIndexed(OP_CONSTANT, OP_CONSTANT_LONG, makeConstant(value));
 }
 
 /**
@@ -284,38 +470,249 @@ static void emitConstant(Value value)
  */
 static void patchJump(int offset)
 {
-    // -2 to adjust for the bytecode for the jump offset itself.
-    int jump = currentChunk()->count - offset - 2;
+    // -3 to adjust for the bytecode for the jump offset itself.
+    int jump = markJumpTarget() - offset - 3;
 
-    if (jump > UINT16_MAX)
+    if (jump > UINT24_MAX)
     {
         error("ASKING TOO MUCH OF BRANCH. Too much code to jump over.");
     }
 
-    currentChunk()->code[offset] = (jump >> 8) & 0xff;
-    currentChunk()->code[offset + 1] = jump & 0xff;
+    currentChunk()->code[offset] = (jump >> 16) & 0xff;
+    currentChunk()->code[offset + 1] = (jump >> 8) & 0xff;
+    currentChunk()->code[offset + 2] = jump & 0xff;
+}
+
+/**
+ * @brief Map a wide jump opcode back to its 16 bit form, or -1 if op isn't a jump
+ */
+static int shortJumpOp(uint8_t op)
+{
+    switch (op)
+    {
+    case OP_JUMP_LONG:
+        return OP_JUMP;
+    case OP_JUMP_IF_FALSE_LONG:
+        return OP_JUMP_IF_FALSE;
+    case OP_JUMP_IF_FALSE_POP_LONG:
+        return OP_JUMP_IF_FALSE_POP;
+    case OP_LOOP_LONG:
+        return OP_LOOP;
+    default:
+        return -1;
+    }
+}
+
+typedef struct
+{
+    int at;      // offset of the jump's opcode in the wide layout
+    int target;  // offset the jump lands on in the wide layout
+    bool narrow; // true once we know the 16 bit form reaches the target
+} JumpSite;
+
+/**
+ * @brief Jump relaxation. Every jump was emitted wide, now shrink the ones whose
+ * distance fits in 16 bits. Shrinking a jump only ever brings other jumps' targets
+ * closer, so we keep narrowing until nothing changes and then rewrite the code (and
+ * line info) in one pass. Runs once per chunk at the end of compilation.
+ */
+static void relaxJumps()
+{
+    Chunk *chunk = currentChunk();
+    int jumpCount = 0;
+    for (int offset = 0; offset < chunk->count; offset += Chunk_InstructionLength(chunk, offset))
+    {
+        if (shortJumpOp(chunk->code[offset]) != -1)
+            jumpCount++;
+    }
+    if (jumpCount == 0)
+        return;
+
+    JumpSite *jumps = ALLOCATE(JumpSite, jumpCount);
+    int j = 0;
+    for (int offset = 0; offset < chunk->count; offset += Chunk_InstructionLength(chunk, offset))
+    {
+        uint8_t op = chunk->code[offset];
+        if (shortJumpOp(op) == -1)
+            continue;
+        int distance = (chunk->code[offset + 1] << 16) | (chunk->code[offset + 2] << 8) |
+                       chunk->code[offset + 3];
+        jumps[j].at = offset;
+        jumps[j].target = offset + 4 + (op == OP_LOOP_LONG ? -distance : distance);
+        jumps[j].narrow = false;
+        j++;
+    }
+
+    // removed[i] = bytes saved before old offset i by the jumps narrowed so far
+    int *removed = ALLOCATE(int, chunk->count + 1);
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        int saved = 0;
+        j = 0;
+        for (int offset = 0; offset <= chunk->count; offset++)
+        {
+            removed[offset] = saved;
+            if (j < jumpCount && jumps[j].at == offset)
+            {
+                saved += jumps[j].narrow;
+                j++;
+            }
+        }
+        for (j = 0; j < jumpCount; j++)
+        {
+            if (jumps[j].narrow)
+                continue;
+            // where the jump and its target would be with the current layout
+            int next = jumps[j].at - removed[jumps[j].at] + 3;
+            int target = jumps[j].target - removed[jumps[j].target];
+            int distance = target >= next ? target - next : next - target;
+            if (distance <= UINT16_MAX)
+            {
+                jumps[j].narrow = true;
+                changed = true;
+            }
+        }
+    }
+
+    // final layout, then rewrite in place. We only ever drop bytes so the write
+    // position never overtakes the read position
+    int saved = 0;
+    j = 0;
+    for (int offset = 0; offset <= chunk->count; offset++)
+    {
+        removed[offset] = saved;
+        if (j < jumpCount && jumps[j].at == offset)
+        {
+            saved += jumps[j].narrow;
+            j++;
+        }
+    }
+
+    // the exception table points into the code too
+    for (int i = 0; i < chunk->handlerCount; i++)
+    {
+        ExceptionHandler *handler = &chunk->handlers[i];
+        handler->start -= removed[handler->start];
+        handler->end -= removed[handler->end];
+        handler->handler -= removed[handler->handler];
+    }
+
+    int write = 0;
+    j = 0;
+    for (int offset = 0; offset < chunk->count;)
+    {
+        int length = Chunk_InstructionLength(chunk, offset);
+        if (j < jumpCount && jumps[j].at == offset)
+        {
+            uint8_t op = chunk->code[offset];
+            int line = chunk->lines[offset];
+            int next = write + (jumps[j].narrow ? 3 : 4);
+            int target = jumps[j].target - removed[jumps[j].target];
+            int distance = target >= next ? target - next : next - target;
+            if (jumps[j].narrow)
+            {
+                chunk->code[write] = (uint8_t)shortJumpOp(op);
+                chunk->code[write + 1] = (distance >> 8) & 0xff;
+                chunk->code[write + 2] = distance & 0xff;
+            }
+            else
+            {
+                chunk->code[write] = op;
+                chunk->code[write + 1] = (distance >> 16) & 0xff;
+                chunk->code[write + 2] = (distance >> 8) & 0xff;
+                chunk->code[write + 3] = distance & 0xff;
+            }
+            for (int i = write; i < next; i++)
+                chunk->lines[i] = line;
+            write = next;
+            j++;
+        }
+        else
+        {
+            memmove(&chunk->code[write], &chunk->code[offset], length);
+            memmove(&chunk->lines[write], &chunk->lines[offset], length * sizeof(int));
+            write += length;
+        }
+        offset += length;
+    }
+    chunk->count = write;
+
+    FREE_ARRAY(int, removed, chunk->count + saved + 1);
+    FREE_ARRAY(JumpSite, jumps, jumpCount);
 }
 
-static void initCompiler(Compiler *compiler)
+static void initCompiler(Compiler *compiler, FunctionType type)
 {
+    compiler->enclosing = current;
+    compiler->type = type;
+    compiler->escapes = true;
+    compiler->nestedCapture = false;
+    compiler->inlineFloor = 0;
+    compiler->calleeCandidate = NULL;
+    compiler->calleeLoadedAt = -1;
     compiler->localCount = 0;
     compiler->scopeDepth = 0;
+    compiler->lastInstruction = -1;
+    compiler->previousInstruction = -1;
+    compiler->lastJumpTarget = 0;
+    compiler->stackDepth = 0;
+    compiler->tryDepth = 0;
     for (int i = 0; i < UINT8_COUNT; i++)
     {
-        memset(&compiler->locals[i], 0, sizeof(Token) + sizeof(int));
+        memset(&compiler->locals[i], 0, sizeof(Local));
     }
+    compiler->function = newFunction();
     current = compiler;
+    // we were called right after the function's name was consumed
+    if (type != TYPE_SCRIPT)
+    {
+        current->function->name = copyString(parser.previous.start, parser.previous.length);
+        // the function may have grown old while the name was allocated
+        writeBarrier((Obj *)current->function, OBJ_VAL(current->function->name));
+    }
+
+    /*
+        Slot 0 of every frame holds the function being called, the caller put it there
+        before the arguments. It gets an empty name so user code can never refer to it.
+        A method is called with the receiver there instead, that's 'this'.
+    */
+    Local *local = &current->locals[current->localCount++];
+    local->depth = 0;
+    local->isCaptured = false;
+    if (type == TYPE_METHOD || type == TYPE_INITIALIZER)
+    {
+        local->name.start = "this";
+        local->name.length = 4;
+    }
+    else
+    {
+        local->name.start = "";
+        local->name.length = 0;
+    }
+    adjustStackDepth(1);
 }
 
-static void endCompiler()
+/**
+ * @brief Finish the function being compiled and make the enclosing one current again.
+ *
+ * @return ObjFunction* - the finished function
+ */
+static ObjFunction *endCompiler()
 {
     emitReturn();
+    if (!parser.hadError)
+        relaxJumps();
+    ObjFunction *function = current->function;
 #ifdef DEBUG_PRINT_CODE
     if (!parser.hadError)
     {
-        disassembleChunk(currentChunk(), "code");
+        disassembleChunk(currentChunk(), function->name != NULL ? function->name->chars : "<script>");
     }
 #endif // DEBUG_PRINT_CODE
+    current = current->enclosing;
+    return function;
 }
 
 /**
@@ -342,7 +739,11 @@ static void endScope()
            current->locals[current->localCount - 1].depth >
                current->scopeDepth)
     {
-        emitByte(OP_POP);
+        // a captured local outlives the block, OP_CLOSE_UPVALUE moves it to the heap first
+        if (current->locals[current->localCount - 1].isCaptured)
+            emitOp(OP_CLOSE_UPVALUE);
+        else
+            emitOp(OP_POP);
         current->localCount--;
     }
 }
@@ -350,14 +751,28 @@ static void endScope()
 static void expression();
 static void statement();
 static void declaration();
+static void classDeclaration();
 static ParseRule *getRule(TokenType type);
 static void parsePrecedence(Precedence precedence);
 
-static uint8_t identifierConstant(Token *name)
+/**
+ * @brief Resolve a global variable name to its slot in the VM's global array. The lookup
+ * happens once, here, so no name string ends up in the constant table and the VM never
+ * hashes it at runtime.
+ *
+ * @param name - identifier token of the global
+ * @return int - slot index to use as the instruction operand, fits in 24 bits
+ */
+static int globalSlot(Token *name)
 {
-    char *newString = copyString(name->start, name->length);
-    uint8_t stringIdxConstTable = makeConstant(OBJ_VAL(newString));
-    return stringIdxConstTable;
+    ObjString *string = copyString(name->start, name->length);
+    int slot = Vm_GlobalSlot(string);
+    if (slot > UINT24_MAX)
+    {
+        error("Too many global variables.");
+        return 0;
+    }
+    return slot;
 }
 
 /**
@@ -380,7 +795,7 @@ static bool identifiersEqual(Token *a, Token *b)
 static int resolveLocal(Compiler *compiler, Token *name)
 {
     // walk the list of locals in current scope
-    for (int i = compiler->localCount - 1; i >= 0; i--)
+    for (int i = compiler->localCount - 1; i >= compiler->inlineFloor; i--)
     {
         Local *local = &compiler->locals[i];
         // if we find same name as identifier token, they must be the same
@@ -390,12 +805,70 @@ static int resolveLocal(Compiler *compiler, Token *name)
             {
                 error("Can't read local variable in its own initializer.");
             }
+            return i;
         }
     }
 
     return -1;
 }
 
+/**
+ * @brief Add a variable to the function's list of captured variables, once
+ *
+ * @param compiler - function capturing it
+ * @param index - local slot or upvalue index in the enclosing function
+ * @param isLocal - index is a local slot of the enclosing function
+ * @return int - upvalue index
+ */
+static int addUpvalue(Compiler *compiler, uint8_t index, bool isLocal)
+{
+    int upvalueCount = compiler->function->upvalueCount;
+    for (int i = 0; i < upvalueCount; i++)
+    {
+        UpvalueInfo *upvalue = &compiler->upvalues[i];
+        if (upvalue->index == index && upvalue->isLocal == isLocal)
+            return i;
+    }
+
+    if (upvalueCount == UINT8_COUNT)
+    {
+        error("Too many closure variables in function.");
+        return 0;
+    }
+    compiler->upvalues[upvalueCount].isLocal = isLocal;
+    compiler->upvalues[upvalueCount].index = index;
+    return compiler->function->upvalueCount++;
+}
+
+/**
+ * @brief Look for name in the enclosing functions, innermost first. Each function between
+ * the one that declares the variable and this one captures it in turn.
+ *
+ * Whether the declaring local has to be moved to the heap is not known yet, it depends
+ * on how the capturing function turns out to be used, see function().
+ *
+ * @return int - upvalue index, -1 if name is not a local of any enclosing function
+ */
+static int resolveUpvalue(Compiler *compiler, Token *name)
+{
+    // an inlined body only sees its parameters and globals, like the function itself
+    if (compiler->enclosing == NULL || compiler->inlineFloor > 0)
+        return -1;
+
+    int local = resolveLocal(compiler->enclosing, name);
+    if (local != -1)
+        return addUpvalue(compiler, (uint8_t)local, true);
+
+    int upvalue = resolveUpvalue(compiler->enclosing, name);
+    if (upvalue != -1)
+    {
+        compiler->enclosing->nestedCapture = true;
+        return addUpvalue(compiler, (uint8_t)upvalue, false);
+    }
+
+    return -1;
+}
+
 static void addLocal(Token name)
 {
 
@@ -409,6 +882,7 @@ static void addLocal(Token name)
     Local *local = &current->locals[current->localCount++];
     local->name = name;
     local->depth = -1; // locals put in uninitialized state at first
+    local->isCaptured = false;
 }
 
 static void declareVariable()
@@ -442,14 +916,13 @@ static void declareVariable()
 }
 
 /**
- * @brief Consume identifier token for variable name, add its lexeme to the
- * chunk's constant table as a string, return the constant table index where
- * it was added
+ * @brief Consume identifier token for variable name. For a global, resolve
+ * it to its slot in the VM's global array and return that slot
  *
  * @param errorMessage
- * @return uint8_t
+ * @return int
  */
-static uint8_t parseVariable(const char *errorMessage)
+static int parseVariable(const char *errorMessage)
 {
     consume(TOKEN_IDENTIFIER, errorMessage);
     declareVariable();
@@ -457,16 +930,19 @@ static uint8_t parseVariable(const char *errorMessage)
     // in constant table
     if (current->scopeDepth > 0)
         return 0;
-    return identifierConstant(&parser.previous);
+    return globalSlot(&parser.previous);
 }
 
 static void markInitialized()
 {
+    // a global function is defined by OP_DEFINE_GLOBAL, nothing to mark
+    if (current->scopeDepth == 0)
+        return;
     current->locals[current->localCount - 1].depth =
         current->scopeDepth;
 }
 
-static void defineVariable(uint8_t global)
+static void defineVariable(int global)
 {
     if (current->scopeDepth > 0)
     {
@@ -474,7 +950,233 @@ static void defineVariable(uint8_t global)
         markInitialized();
         return;
     }
-    emitBytes(OP_DEFINE_GLOBAL, global);
+    emitIndexed(OP_DEFINE_GLOBAL, OP_DEFINE_GLOBAL_LONG, global);
+}
+
+/**
+ * @brief Compile the arguments of a call, each one ends up in the callee's frame as is.
+ *
+ * @return uint8_t - number of arguments
+ */
+static uint8_t argumentList()
+{
+    uint8_t argCount = 0;
+    if (!check(TOKEN_RIGHT_PAREN))
+    {
+        do
+        {
+            expression();
+            if (argCount == 255)
+                error("Can't have more than 255 arguments.");
+            argCount++;
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+    return argCount;
+}
+
+static InlineCandidate *findInlineCandidate(int global)
+{
+    for (int i = 0; i < inlineCandidateCount; i++)
+    {
+        if (inlineCandidates[i].global == global)
+            return &inlineCandidates[i];
+    }
+    return NULL;
+}
+
+// what an inlined expression may compile to: no calls, no jumps, nothing that needs a frame
+static bool inlinableOp(uint8_t op)
+{
+    switch (op)
+    {
+    case OP_CONSTANT:
+    case OP_CONSTANT_LONG:
+    case OP_NIL:
+    case OP_TRUE:
+    case OP_FALSE:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_GET_GLOBAL:
+    case OP_GET_GLOBAL_LONG:
+    case OP_SET_GLOBAL:
+    case OP_SET_GLOBAL_LONG:
+    case OP_EQUAL:
+    case OP_NOT_EQUAL:
+    case OP_GREATER:
+    case OP_GREATER_EQUAL:
+    case OP_LESS:
+    case OP_LESS_EQUAL:
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_NOT:
+    case OP_NEGATE:
+    case OP_ADD_LOCAL_CONST:
+    case OP_GET_PROPERTY: // getters, the inlined copy gets a cache of its own
+    case OP_GET_PROPERTY_LONG:
+    case OP_GET_INDEX:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Called once a global function's declaration is compiled: remember it for
+ * inlining if it qualifies, forget an earlier function of the same name otherwise.
+ *
+ * @param global - slot of the global it is declared as
+ * @param function - the compiled function
+ * @param params - scanner right after the '(' of its parameter list
+ */
+static void recordInlineCandidate(int global, ObjFunction *function, Scanner params)
+{
+    InlineCandidate *candidate = findInlineCandidate(global);
+    if (candidate != NULL)
+        *candidate = inlineCandidates[--inlineCandidateCount];
+    if (!inliningEnabled || parser.hadError || inlineCandidateCount == INLINE_CANDIDATES_MAX)
+        return;
+
+    // the body must start with 'return'...
+    Scanner saved = Scanner_SaveState();
+    Scanner_RestoreState(params);
+    Token token;
+    do
+        token = Scanner_ScanToken();
+    while (token.type != TOKEN_LEFT_BRACE && token.type != TOKEN_EOF);
+    token = Scanner_ScanToken();
+    Scanner_RestoreState(saved);
+    if (token.type != TOKEN_RETURN)
+        return;
+
+    // ...and be nothing else: the expression, its OP_RETURN, then the implicit return
+    Chunk *chunk = &function->chunk;
+    int end = chunk->count - 3;
+    if (end > INLINE_BUDGET)
+        return;
+    int offset = 0;
+    while (offset < end && inlinableOp(chunk->code[offset]))
+        offset += Chunk_InstructionLength(chunk, offset);
+    if (offset != end || chunk->code[end] != OP_RETURN)
+        return;
+
+    candidate = &inlineCandidates[inlineCandidateCount++];
+    candidate->global = global;
+    candidate->function = function;
+    candidate->params = params;
+}
+
+/**
+ * @brief Emit the body of a candidate in place of a call to it, the callee and the
+ * arguments have already been compiled. Emits:
+ *
+ *      OP_INLINE_CALL argCount, function, n
+ *      <n bytes: the expression with the arguments as its parameters, OP_DROP_UNDER>
+ *
+ * n fits in a byte and nothing in between jumps, so OP_INLINE_CALL can skip straight
+ * over it when the callee turns out to be some other function at runtime.
+ *
+ * @param candidate - the function being called
+ * @param argCount - arguments on the stack above the callee
+ * @return false if this call can't be inlined, nothing was emitted
+ */
+static bool inlineCall(InlineCandidate *candidate, uint8_t argCount)
+{
+    // the parameters become locals named after the slots the arguments are in. Below
+    // them there can only be the caller's locals and temporaries, no local may sit above
+    int calleeSlot = current->stackDepth - argCount - 1;
+    if (argCount != candidate->function->arity || current->localCount > calleeSlot + 1 ||
+        current->stackDepth > UINT8_COUNT)
+        return false;
+    int expected = makeConstant(OBJ_VAL(candidate->function));
+    if (expected > UINT8_MAX)
+        return false;
+
+    int guard = currentChunk()->count;
+    int depth = current->stackDepth;
+    emitOp(OP_INLINE_CALL);
+    emitByte(argCount);
+    emitByte((uint8_t)expected);
+    emitByte(0); // patched below, once we know how long the body is
+
+    int localCount = current->localCount;
+    Token previous = parser.previous;
+    Token next = parser.current;
+    Scanner saved = Scanner_SaveState();
+
+    // temporaries get locals no identifier can match, only the parameters are visible
+    while (current->localCount <= calleeSlot)
+    {
+        Local *local = &current->locals[current->localCount++];
+        local->name.start = "";
+        local->name.length = 0;
+        local->depth = current->scopeDepth;
+        local->isCaptured = false;
+    }
+    current->inlineFloor = current->localCount;
+    Scanner_RestoreState(candidate->params);
+    advance();
+    if (!check(TOKEN_RIGHT_PAREN))
+    {
+        do
+        {
+            consume(TOKEN_IDENTIFIER, "Expect parameter name.");
+            Local *local = &current->locals[current->localCount++];
+            local->name = parser.previous;
+            local->depth = current->scopeDepth;
+            local->isCaptured = false;
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+    consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+    consume(TOKEN_RETURN, "Expect 'return'.");
+    expression();
+
+    current->inlineFloor = 0;
+    current->localCount = localCount;
+    Scanner_RestoreState(saved);
+    parser.previous = previous;
+    parser.current = next;
+
+    // the result takes the callee's slot, same as after a real call
+    emitBytes(OP_DROP_UNDER, argCount + 1);
+    current->stackDepth -= argCount + 1;
+    int skip = currentChunk()->count - guard - 4;
+    if (skip > UINT8_MAX)
+    {
+        // the caller needed long forms and it got too big after all, call it instead
+        currentChunk()->count = guard;
+        current->stackDepth = depth;
+        current->lastInstruction = current->previousInstruction = -1;
+        return false;
+    }
+    currentChunk()->code[guard + 3] = (uint8_t)skip;
+    // OP_INLINE_CALL can land here, keep superinstructions from spanning it
+    markJumpTarget();
+    return true;
+}
+
+/**
+ * @brief '(' in infix position, the callee has already been compiled.
+ *
+ * @param canAssign
+ */
+static void call(bool canAssign)
+{
+    // only a call straight on the loaded global may be inlined, not one on its result
+    InlineCandidate *candidate = current->calleeCandidate;
+    if (current->calleeLoadedAt != current->lastInstruction)
+        candidate = NULL;
+    current->calleeCandidate = NULL;
+
+    uint8_t argCount = argumentList();
+    if (candidate != NULL && inlineCall(candidate, argCount))
+        return;
+    emitBytes(OP_CALL, argCount);
+    // the callee and its arguments are replaced by the return value
+    current->stackDepth -= argCount;
 }
 
 /**
@@ -487,12 +1189,41 @@ static void and_(bool canAssign)
     // if left operand is false, jump to the end of the AND expression
     int endJump = emitJump(OP_JUMP_IF_FALSE);
 
-    emitByte(OP_POP);
+    emitOp(OP_POP);
     parsePrecedence(PREC_AND);
 
     patchJump(endJump);
 }
 
+/**
+ * @brief Superinstruction peephole for 'local + constant'. If the two instructions
+ * just emitted are OP_GET_LOCAL and OP_CONSTANT, and no jump lands between them, they
+ * are rewritten in place into a single OP_ADD_LOCAL_CONST which also does the add.
+ *
+ * @return true if the add was fused and nothing else needs to be emitted
+ */
+static bool fuseAddLocalConstant()
+{
+    int getLocal = current->previousInstruction;
+    int constant = current->lastInstruction;
+    Chunk *chunk = currentChunk();
+    if (getLocal < 0 || current->lastJumpTarget > getLocal)
+        return false;
+    if (chunk->code[getLocal] != OP_GET_LOCAL || constant != getLocal + 2 ||
+        chunk->code[constant] != OP_CONSTANT || chunk->count != constant + 2)
+        return false;
+
+    // GET_LOCAL slot CONSTANT idx  ->  ADD_LOCAL_CONST slot idx
+    uint8_t slot = chunk->code[getLocal + 1];
+    uint8_t constantIdx = chunk->code[constant + 1];
+    chunk->count = getLocal;
+    current->lastInstruction = current->previousInstruction = -1;
+    current->stackDepth -= 2; // the local and the constant are no longer pushed
+    emitBytes(OP_ADD_LOCAL_CONST, slot);
+    emitByte(constantIdx);
+    return true;
+}
+
 static void binary(bool canAssign)
 {
     TokenType operatorType = parser.previous.type;
@@ -502,34 +1233,35 @@ static void binary(bool canAssign)
     switch (operatorType)
     {
     case TOKEN_PLUS:
-        emitByte(OP_ADD);
+        if (!fuseAddLocalConstant())
+            emitOp(OP_ADD);
         break;
     case TOKEN_MINUS:
-        emitByte(OP_SUBTRACT);
+        emitOp(OP_SUBTRACT);
         break;
     case TOKEN_STAR:
-        emitByte(OP_MULTIPLY);
+        emitOp(OP_MULTIPLY);
         break;
     case TOKEN_SLASH:
-        emitByte(OP_DIVIDE);
+        emitOp(OP_DIVIDE);
         break;
-    case TOKEN_BANG_EQUAL:
-        emitBytes(OP_EQUAL, OP_NOT);
+    case TOKEN_BANG_EQUAL: // fused OP_EQUAL + OP_NOT
+        emitOp(OP_NOT_EQUAL);
         break;
     case TOKEN_EQUAL_EQUAL: // single instruction for ==
-        emitByte(OP_EQUAL);
+        emitOp(OP_EQUAL);
         break;
     case TOKEN_GREATER: // single instr for >
-        emitByte(OP_GREATER);
+        emitOp(OP_GREATER);
         break;
-    case TOKEN_GREATER_EQUAL:
-        emitBytes(OP_LESS, OP_NOT);
+    case TOKEN_GREATER_EQUAL: // fused OP_LESS + OP_NOT
+        emitOp(OP_GREATER_EQUAL);
         break;
     case TOKEN_LESS: // single instr for <
-        emitByte(OP_LESS);
+        emitOp(OP_LESS);
         break;
-    case TOKEN_LESS_EQUAL:
-        emitBytes(OP_GREATER, OP_NOT);
+    case TOKEN_LESS_EQUAL: // fused OP_GREATER + OP_NOT
+        emitOp(OP_LESS_EQUAL);
         break;
     default:
         return; // Unreachable.
@@ -546,13 +1278,13 @@ static void literal(bool canAssign)
     switch (parser.previous.type)
     {
     case TOKEN_FALSE:
-        emitByte(OP_FALSE);
+        emitOp(OP_FALSE);
         break;
     case TOKEN_NIL:
-        emitByte(OP_NIL);
+        emitOp(OP_NIL);
         break;
     case TOKEN_TRUE:
-        emitByte(OP_TRUE);
+        emitOp(OP_TRUE);
         break;
     default:
         return; // Unreachable.
@@ -581,7 +1313,7 @@ static void block()
 static void varDeclaration()
 {
     // keyword followed by var name is compiled by parseVariable
-    uint8_t global = parseVariable("Expect variable name.");
+    int global = parseVariable("Expect variable name.");
 
     // look for '=' followed by initializer expression
     if (match(TOKEN_EQUAL)) // will advance to next token if true
@@ -591,18 +1323,174 @@ static void varDeclaration()
     else
     {
         // if no '=' then initialize the var to nil
-        emitByte(OP_NIL);
+        emitOp(OP_NIL);
     }
     consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
 
     defineVariable(global);
 }
 
+/**
+ * @brief Escape analysis for a local function, done before its body is compiled by looking
+ * ahead at the tokens up to the end of the block declaring it. The function can't outlive
+ * its declaring frame if every mention of its name in there is a direct call 'name(' made
+ * by the declaring function itself. A mention inside any function body (its own included),
+ * assigning it, passing it on or returning it all count as escaping. A shadowing variable
+ * with the same name only makes the answer more conservative.
+ *
+ * @param name - name of the function, the parser is at the '(' of its parameters
+ * @return true if the function may be called once the declaring frame is gone
+ */
+static bool functionEscapes(Token *name)
+{
+    Scanner saved = Scanner_SaveState();
+    int depth = 0;               // braces opened since the declaration
+    int bodyDepths[UINT8_COUNT]; // depth each function body we are inside of started at
+    int bodyCount = 0;
+    bool bodyPending = true;     // the next '{' opens a function body, ours first
+    bool afterName = false;      // the previous token mentioned the name
+    bool escapes = false;
+
+    for (Token token = parser.current; token.type != TOKEN_EOF && depth >= 0 && !escapes;
+         token = Scanner_ScanToken())
+    {
+        if (afterName && token.type != TOKEN_LEFT_PAREN)
+            escapes = true;
+        afterName = false;
+
+        switch (token.type)
+        {
+        case TOKEN_FUN:
+        case TOKEN_CLASS: // methods may run from anywhere, the class body counts as one
+            bodyPending = true;
+            break;
+        case TOKEN_LEFT_BRACE:
+            depth++;
+            if (bodyPending)
+            {
+                if (bodyCount == UINT8_COUNT)
+                    escapes = true; // too deep to keep track, assume the worst
+                else
+                    bodyDepths[bodyCount++] = depth;
+                bodyPending = false;
+            }
+            break;
+        case TOKEN_RIGHT_BRACE:
+            if (bodyCount > 0 && bodyDepths[bodyCount - 1] == depth)
+                bodyCount--;
+            depth--; // below 0 is the end of the declaring block, we're done
+            break;
+        case TOKEN_IDENTIFIER:
+            if (identifiersEqual(&token, name))
+            {
+                if (bodyCount > 0)
+                    escapes = true;
+                else
+                    afterName = true;
+            }
+            break;
+        default:; // Do nothing.
+        }
+    }
+
+    Scanner_RestoreState(saved);
+    return escapes;
+}
+
+/**
+ * @brief Compile a function's parameter list and body into a new ObjFunction and emit
+ * the code that produces the function value in the enclosing function. That is the
+ * cheapest of:
+ *
+ *  - the ObjFunction itself as a constant, when it captures nothing
+ *  - the same, flagged capturesCallerFrame, when it captures only locals of the enclosing
+ *    function and can't escape the frame declaring it. Every call comes from that frame,
+ *    so the VM reads the captured variables straight out of the caller's slots
+ *  - an OP_CLOSURE, which allocates a closure and its upvalues, for everything else
+ *
+ * @param type
+ * @param escapes - false if functionEscapes() proved the function stays in its frame
+ * @return ObjFunction* - the compiled function
+ */
+static ObjFunction *function(FunctionType type, bool escapes)
+{
+    Compiler compiler;
+    initCompiler(&compiler, type);
+    compiler.escapes = escapes;
+    // no matching endScope(), the whole frame goes away when the function returns
+    beginScope();
+
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+    if (!check(TOKEN_RIGHT_PAREN))
+    {
+        do
+        {
+            current->function->arity++;
+            if (current->function->arity > 255)
+                errorAtCurrent("Can't have more than 255 parameters.");
+            int constant = parseVariable("Expect parameter name.");
+            defineVariable(constant);
+            adjustStackDepth(1); // the caller pushed it
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+    consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+    block();
+
+    // while the function is still current, a collection can find it
+    if (current->function->upvalueCount > 0)
+    {
+        int count = current->function->upvalueCount;
+        current->function->upvalues = ALLOCATE(UpvalueInfo, count);
+        memcpy(current->function->upvalues, compiler.upvalues, sizeof(UpvalueInfo) * count);
+    }
+    ObjFunction *function = endCompiler();
+
+    bool onlyLocals = true;
+    for (int i = 0; i < function->upvalueCount; i++)
+        onlyLocals = onlyLocals && compiler.upvalues[i].isLocal;
+
+    if (function->upvalueCount == 0)
+    {
+        emitConstant(OBJ_VAL(function));
+    }
+    else if (!compiler.escapes && !compiler.nestedCapture && onlyLocals)
+    {
+        function->capturesCallerFrame = true;
+        emitConstant(OBJ_VAL(function));
+    }
+    else
+    {
+        // the captured locals will be referenced from the heap, they must be closed over
+        for (int i = 0; i < function->upvalueCount; i++)
+        {
+            if (compiler.upvalues[i].isLocal)
+                current->locals[compiler.upvalues[i].index].isCaptured = true;
+        }
+        emitIndexed(OP_CLOSURE, OP_CLOSURE_LONG, makeConstant(OBJ_VAL(function)));
+    }
+    return function;
+}
+
+static void funDeclaration()
+{
+    int global = parseVariable("Expect function name.");
+    // initialized right away so the body can call itself recursively
+    markInitialized();
+    // a global function can be called from anywhere, only a local one may stay in its frame
+    bool escapes = current->scopeDepth == 0 || functionEscapes(&parser.previous);
+    Scanner params = Scanner_SaveState();
+    ObjFunction *compiled = function(TYPE_FUNCTION, escapes);
+    if (current->scopeDepth == 0)
+        recordInlineCandidate(global, compiled, params);
+    defineVariable(global);
+}
+
 static void expressionStatement()
 {
     expression();
     consume(TOKEN_SEMICOLON, "Expect ';' after expression. ");
-    emitByte(OP_POP);
+    emitOp(OP_POP);
 }
 
 static void forStatement()
@@ -628,7 +1516,7 @@ static void forStatement()
     }
     /**** END INITIALIZAER CLAUSE****/
 
-    int loopStart = currentChunk()->count;
+    int loopStart = markJumpTarget();
 
     /****START CONDITION CLAUSE****/
     int exitJump = -1;
@@ -639,9 +1527,8 @@ static void forStatement()
         expression();
         consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
 
-        // Jump out of the loop if the condition is false.
-        exitJump = emitJump(OP_JUMP_IF_FALSE);
-        emitByte(OP_POP); // Condition.
+        // Jump out of the loop if the condition is false. Condition is popped either way
+        exitJump = emitJump(OP_JUMP_IF_FALSE_POP);
     }
     /**** END CONDITION CLAUSE*****/
 
@@ -652,9 +1539,9 @@ static void forStatement()
         // emit an unconditional jump to the start of the loop so we don't execute the increment yet
         // will hop over the increment clause to the body of the loop
         int bodyJump = emitJump(OP_JUMP);
-        int incrementStart = currentChunk()->count;
+        int incrementStart = markJumpTarget();
         expression();
-        emitByte(OP_POP);
+        emitOp(OP_POP);
         consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
 
         emitLoop(loopStart);
@@ -669,7 +1556,6 @@ static void forStatement()
     if (exitJump != -1)
     {
         patchJump(exitJump);
-        emitByte(OP_POP); // Condition.
     }
 
     // end scope for variables declared in for loop
@@ -695,50 +1581,119 @@ static void ifStatement()
     expression();
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
 
-    // placeholde offset for jump instruction. thenJump is the location
-    // of the JUMP instruction
-    int thenJump = emitJump(OP_JUMP_IF_FALSE);
-    emitByte(OP_POP);
+    // placeholder offset for jump instruction. thenJump is the location
+    // of the JUMP instruction. The condition is popped whichever way we go
+    int thenJump = emitJump(OP_JUMP_IF_FALSE_POP);
     // compile the body of the if statement
     statement();
 
+    // when the condition was true, jump over the else body once the then body is done
+    // so we don't fall thru and execute it as well
+    int elseJump = emitJump(OP_JUMP);
+
     // backpatch the jump instruction with correct offset
     patchJump(thenJump);
 
-    emitByte(OP_POP);
-
-    // support for else. Need to account for case where if is TRUE and its body is executed and be
-    // careful not to fall thru and execute the body of the else code as well
+    // support for else
     if (match(TOKEN_ELSE))
         statement();
 
-    // same as the thenJump above
-    int elseJump = emitJump(OP_JUMP);
-
     // backpatch for the else as well
     patchJump(elseJump);
 }
 
+/**
+ * @brief 'try' block 'catch' '(' name ')' block. Nothing is emitted on the way in, the
+ * try block's code range goes in the chunk's exception table instead and only a throw
+ * looks at it. The catch block gets the thrown value as a local, the VM pushes it right
+ * above the locals that were in scope at the try.
+ */
+static void tryStatement()
+{
+    // nothing before the try block may be fused with its first instruction
+    int start = markJumpTarget();
+    int stackDepth = current->localCount;
+    consume(TOKEN_LEFT_BRACE, "Expect '{' after 'try'.");
+    current->tryDepth++;
+    beginScope();
+    block();
+    endScope();
+    current->tryDepth--;
+    int end = currentChunk()->count;
+    int skipCatch = emitJump(OP_JUMP);
+
+    int handler = markJumpTarget();
+    beginScope();
+    consume(TOKEN_CATCH, "Expect 'catch' after try block.");
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'catch'.");
+    consume(TOKEN_IDENTIFIER, "Expect exception variable name.");
+    addLocal(parser.previous);
+    markInitialized();
+    adjustStackDepth(1); // pushed by the VM, not by an instruction
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after exception variable name.");
+    consume(TOKEN_LEFT_BRACE, "Expect '{' after catch.");
+    block();
+    endScope();
+    patchJump(skipCatch);
+
+    // added after any try nested in this one, the VM takes the first entry that covers
+    Chunk_AddHandler(currentChunk(), (ExceptionHandler){(uint32_t)start, (uint32_t)end,
+                                                        (uint32_t)handler, stackDepth});
+}
+
+static void throwStatement()
+{
+    expression();
+    consume(TOKEN_SEMICOLON, "Expect ';' after thrown value.");
+    emitOp(OP_THROW);
+}
+
 static void printStatement()
 {
     expression();
     consume(TOKEN_SEMICOLON, "Expect ';' after value.");
-    emitByte(OP_PRINT);
+    emitOp(OP_PRINT);
+}
+
+static void returnStatement()
+{
+    if (current->type == TYPE_SCRIPT)
+        error("Can't return from top-level code.");
+
+    if (match(TOKEN_SEMICOLON))
+    {
+        emitReturn();
+    }
+    else
+    {
+        if (current->type == TYPE_INITIALIZER)
+            error("Can't return a value from an initializer.");
+        expression();
+        consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
+        // 'return f(...)': the call's result is our result, so it can take over this
+        // frame instead of stacking a new one. OP_RETURN stays for when the VM can't do
+        // that, a jump landing past the call also ends up on it. Not in a try block, the
+        // frame whose handler would catch what the callee throws has to stay
+        int call = current->lastInstruction;
+        if (call != -1 && call + 2 == currentChunk()->count && current->tryDepth == 0 &&
+            currentChunk()->code[call] == OP_CALL)
+            currentChunk()->code[call] = OP_TAIL_CALL;
+        emitOp(OP_RETURN);
+    }
 }
 
 static void whileStatement()
 {
     // jump all the way back to reeavluate the condition on each iteration.
     // start of the loop
-    int loopStart = currentChunk()->count;
+    int loopStart = markJumpTarget();
     // compile conditional expression within the parentheses
     consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
     expression();
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
 
-    // placeholder for jump instruction
-    int exitJump = emitJump(OP_JUMP_IF_FALSE);
-    emitByte(OP_POP);
+    // placeholder for jump instruction, condition is popped whichever way we go
+    int exitJump = emitJump(OP_JUMP_IF_FALSE_POP);
     statement();
 
     // Needs to know how far back to jump so we can loop back to the start of the while loop.
@@ -747,7 +1702,6 @@ static void whileStatement()
 
     // patch jump after compiling the body of while loop
     patchJump(exitJump);
-    emitByte(OP_POP);
 }
 
 /**
@@ -777,6 +1731,8 @@ static void synchronize()
         case TOKEN_WHILE:
         case TOKEN_PRINT:
         case TOKEN_RETURN:
+        case TOKEN_THROW:
+        case TOKEN_TRY:
             return;
 
         default:; // Do nothing.
@@ -792,7 +1748,15 @@ static void synchronize()
  */
 static void declaration()
 {
-    if (match(TOKEN_VAR))
+    if (match(TOKEN_CLASS))
+    {
+        classDeclaration();
+    }
+    else if (match(TOKEN_FUN))
+    {
+        funDeclaration();
+    }
+    else if (match(TOKEN_VAR))
     {
         varDeclaration();
     }
@@ -825,10 +1789,22 @@ static void statement()
     {
         forStatement();
     }
+    else if (match(TOKEN_RETURN))
+    {
+        returnStatement();
+    }
     else if (match(TOKEN_WHILE))
     {
         whileStatement();
     }
+    else if (match(TOKEN_TRY))
+    {
+        tryStatement();
+    }
+    else if (match(TOKEN_THROW))
+    {
+        throwStatement();
+    }
     else if (match(TOKEN_LEFT_BRACE))
     {
         // if this executes we have found a block statement
@@ -867,7 +1843,7 @@ static void or_(bool canAssign)
     int endJump = emitJump(OP_JUMP);
 
     patchJump(elseJump);
-    emitByte(OP_POP);
+    emitOp(OP_POP);
 
     parsePrecedence(PREC_OR);
     patchJump(endJump);
@@ -884,15 +1860,16 @@ static void string(bool canAssign)
 }
 
 /**
- * @brief Grabs an identifier tokan and adds its lexeme to a chunks constant
- * table as a string. It then emits an instruction that loads the global var
- * with that name
+ * @brief Grabs an identifier token, resolves it to a local slot or a global
+ * slot and emits the instruction that loads (or stores) that variable
  *
  * @param name
  */
 static void namedVariable(Token name, bool canAssign)
 {
     uint8_t getOp, setOp;
+    // locals never need the wide form, there are at most 256 of them
+    uint8_t getLongOp = OP_GET_LOCAL, setLongOp = OP_SET_LOCAL;
     // see if the local exists
     int arg = resolveLocal(current, &name);
     if (arg != -1)
@@ -900,20 +1877,33 @@ static void namedVariable(Token name, bool canAssign)
         getOp = OP_GET_LOCAL;
         setOp = OP_SET_LOCAL;
     }
+    else if ((arg = resolveUpvalue(current, &name)) != -1)
+    {
+        // at most 256 upvalues too, no wide form
+        getOp = getLongOp = OP_GET_UPVALUE;
+        setOp = setLongOp = OP_SET_UPVALUE;
+    }
     else
     {
-        arg = identifierConstant(&name);
+        arg = globalSlot(&name);
         getOp = OP_GET_GLOBAL;
         setOp = OP_SET_GLOBAL;
+        getLongOp = OP_GET_GLOBAL_LONG;
+        setLongOp = OP_SET_GLOBAL_LONG;
     }
     if (canAssign && match(TOKEN_EQUAL))
     {
         expression();
-        emitBytes(setOp, (uint8_t)arg);
+        emitIndexed(setOp, setLongOp, arg);
     }
     else
     {
-        emitBytes(getOp, (uint8_t)arg);
+        emitIndexed(getOp, getLongOp, arg);
+        if (getOp == OP_GET_GLOBAL && check(TOKEN_LEFT_PAREN))
+        {
+            current->calleeCandidate = findInlineCandidate(arg);
+            current->calleeLoadedAt = current->lastInstruction;
+        }
     }
 }
 
@@ -926,6 +1916,186 @@ static void variable(bool canAssign)
     namedVariable(parser.previous, canAssign);
 }
 
+// a token for a name the compiler refers to itself, not found in the source
+static Token syntheticToken(const char *text)
+{
+    Token token;
+    token.start = text;
+    token.length = (int)strlen(text);
+    return token;
+}
+
+/**
+ * @brief '.' in infix position, the object has already been compiled. Each access gets
+ * its own inline cache in the chunk, the instruction's operand is its index.
+ *
+ * @param canAssign
+ */
+static void dot(bool canAssign)
+{
+    consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
+    int name = makeConstant(OBJ_VAL(copyString(parser.previous.start, parser.previous.length)));
+    int cache = Chunk_AddPropertyCache(currentChunk(), name);
+
+    if (canAssign && match(TOKEN_EQUAL))
+    {
+        expression();
+        emitIndexed(OP_SET_PROPERTY, OP_SET_PROPERTY_LONG, cache);
+    }
+    else if (match(TOKEN_LEFT_PAREN))
+    {
+        // 'obj.name(...)' calls the method without binding it to obj first
+        uint8_t argCount = argumentList();
+        emitIndexed(OP_INVOKE, OP_INVOKE_LONG, cache);
+        emitByte(argCount);
+        current->stackDepth -= argCount;
+    }
+    else
+    {
+        emitIndexed(OP_GET_PROPERTY, OP_GET_PROPERTY_LONG, cache);
+    }
+}
+
+/**
+ * @brief A list literal, '[' in prefix position. The items are left on the stack and
+ * OP_BUILD_LIST replaces them with the list.
+ *
+ * @param canAssign
+ */
+static void list(bool canAssign)
+{
+    int count = 0;
+    if (!check(TOKEN_RIGHT_BRACKET))
+    {
+        do
+        {
+            expression();
+            if (count == 255)
+                error("Can't have more than 255 items in a list literal.");
+            count++;
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_BRACKET, "Expect ']' after list items.");
+    emitBytes(OP_BUILD_LIST, (uint8_t)count);
+    current->stackDepth -= count;
+}
+
+/**
+ * @brief '[' in infix position, the list has already been compiled.
+ *
+ * @param canAssign
+ */
+static void subscript(bool canAssign)
+{
+    expression();
+    consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+    if (canAssign && match(TOKEN_EQUAL))
+    {
+        expression();
+        emitOp(OP_SET_INDEX);
+    }
+    else
+    {
+        emitOp(OP_GET_INDEX);
+    }
+}
+
+static void this_(bool canAssign)
+{
+    if (currentClass == NULL)
+    {
+        error("Can't use 'this' outside of a class.");
+        return;
+    }
+    // just a local, slot 0 of every method
+    variable(false);
+}
+
+static void super_(bool canAssign)
+{
+    if (currentClass == NULL)
+        error("Can't use 'super' outside of a class.");
+    else if (!currentClass->hasSuperclass)
+        error("Can't use 'super' in a class with no superclass.");
+
+    consume(TOKEN_DOT, "Expect '.' after 'super'.");
+    consume(TOKEN_IDENTIFIER, "Expect superclass method name.");
+    int name = makeConstant(OBJ_VAL(copyString(parser.previous.start, parser.previous.length)));
+
+    namedVariable(syntheticToken("this"), false);
+    if (match(TOKEN_LEFT_PAREN))
+    {
+        // the superclass goes on top of the arguments, the receiver stays below them
+        uint8_t argCount = argumentList();
+        namedVariable(syntheticToken("super"), false);
+        emitIndexed(OP_SUPER_INVOKE, OP_SUPER_INVOKE_LONG,
+                    Chunk_AddPropertyCache(currentChunk(), name));
+        emitByte(argCount);
+        current->stackDepth -= argCount;
+        return;
+    }
+    namedVariable(syntheticToken("super"), false);
+    emitIndexed(OP_GET_SUPER, OP_GET_SUPER_LONG, name);
+}
+
+static void method()
+{
+    consume(TOKEN_IDENTIFIER, "Expect method name.");
+    int name = makeConstant(OBJ_VAL(copyString(parser.previous.start, parser.previous.length)));
+    FunctionType type = TYPE_METHOD;
+    if (parser.previous.length == 4 && memcmp(parser.previous.start, "init", 4) == 0)
+        type = TYPE_INITIALIZER;
+    // a method can be called from anywhere, it never stays in a frame
+    function(type, true);
+    emitIndexed(OP_METHOD, OP_METHOD_LONG, name);
+}
+
+static void classDeclaration()
+{
+    consume(TOKEN_IDENTIFIER, "Expect class name.");
+    Token className = parser.previous;
+    int name = makeConstant(OBJ_VAL(copyString(className.start, className.length)));
+    declareVariable();
+    int global = current->scopeDepth > 0 ? 0 : globalSlot(&className);
+
+    emitIndexed(OP_CLASS, OP_CLASS_LONG, name);
+    defineVariable(global);
+
+    ClassCompiler classCompiler;
+    classCompiler.hasSuperclass = false;
+    classCompiler.enclosing = currentClass;
+    currentClass = &classCompiler;
+
+    if (match(TOKEN_LESS))
+    {
+        consume(TOKEN_IDENTIFIER, "Expect superclass name.");
+        variable(false);
+        if (identifiersEqual(&className, &parser.previous))
+            error("A class can't inherit from itself.");
+
+        // the superclass stays on the stack as a local the methods capture as 'super'
+        beginScope();
+        addLocal(syntheticToken("super"));
+        defineVariable(0);
+
+        namedVariable(className, false);
+        emitOp(OP_INHERIT);
+        classCompiler.hasSuperclass = true;
+    }
+
+    // the class stays on the stack while its methods are attached to it
+    namedVariable(className, false);
+    consume(TOKEN_LEFT_BRACE, "Expect '{' before class body.");
+    while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF))
+        method();
+    consume(TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
+    emitOp(OP_POP);
+
+    if (classCompiler.hasSuperclass)
+        endScope();
+    currentClass = currentClass->enclosing;
+}
+
 /**
  * @brief PREFIX EXPRESSION
  *
@@ -943,10 +2113,10 @@ static void unary(bool canAssign)
     switch (operatorType)
     {
     case TOKEN_BANG:
-        emitByte(OP_NOT);
+        emitOp(OP_NOT);
         break;
     case TOKEN_MINUS:
-        emitByte(OP_NEGATE);
+        emitOp(OP_NEGATE);
         break;
     default:
         return; // Unreachable.
@@ -960,12 +2130,14 @@ static void unary(bool canAssign)
  *      The precedence of an INFIX expression that uses that token as an operator
  */
 ParseRule rules[] = {
-    [TOKEN_LEFT_PAREN] = {grouping, NULL, PREC_CALL},
+    [TOKEN_LEFT_PAREN] = {grouping, call, PREC_CALL},
     [TOKEN_RIGHT_PAREN] = {NULL, NULL, PREC_NONE},
     [TOKEN_LEFT_BRACE] = {NULL, NULL, PREC_NONE}, // [big]
     [TOKEN_RIGHT_BRACE] = {NULL, NULL, PREC_NONE},
+    [TOKEN_LEFT_BRACKET] = {list, subscript, PREC_CALL},
+    [TOKEN_RIGHT_BRACKET] = {NULL, NULL, PREC_NONE},
     [TOKEN_COMMA] = {NULL, NULL, PREC_NONE},
-    [TOKEN_DOT] = {NULL, NULL, PREC_CALL},
+    [TOKEN_DOT] = {NULL, dot, PREC_CALL},
     [TOKEN_MINUS] = {unary, binary, PREC_TERM},
     [TOKEN_PLUS] = {NULL, binary, PREC_TERM},
     [TOKEN_SEMICOLON] = {NULL, NULL, PREC_NONE},
@@ -983,6 +2155,7 @@ ParseRule rules[] = {
     [TOKEN_STRING] = {string, NULL, PREC_NONE},
     [TOKEN_NUMBER] = {number, NULL, PREC_NONE},
     [TOKEN_AND] = {NULL, and_, PREC_AND},
+    [TOKEN_CATCH] = {NULL, NULL, PREC_NONE},
     [TOKEN_CLASS] = {NULL, NULL, PREC_NONE},
     [TOKEN_ELSE] = {NULL, NULL, PREC_NONE},
     [TOKEN_FALSE] = {literal, NULL, PREC_NONE},
@@ -993,9 +2166,11 @@ ParseRule rules[] = {
     [TOKEN_OR] = {NULL, or_, PREC_OR},
     [TOKEN_PRINT] = {NULL, NULL, PREC_NONE},
     [TOKEN_RETURN] = {NULL, NULL, PREC_NONE},
-    [TOKEN_SUPER] = {NULL, NULL, PREC_NONE},
-    [TOKEN_THIS] = {NULL, NULL, PREC_NONE},
+    [TOKEN_SUPER] = {super_, NULL, PREC_NONE},
+    [TOKEN_THIS] = {this_, NULL, PREC_NONE},
+    [TOKEN_THROW] = {NULL, NULL, PREC_NONE},
     [TOKEN_TRUE] = {literal, NULL, PREC_NONE},
+    [TOKEN_TRY] = {NULL, NULL, PREC_NONE},
     [TOKEN_VAR] = {NULL, NULL, PREC_NONE},
     [TOKEN_WHILE] = {NULL, NULL, PREC_NONE},
     [TOKEN_ERROR] = {NULL, NULL, PREC_NONE},
@@ -1045,12 +2220,14 @@ static ParseRule *getRule(TokenType type)
     return &rules[type];
 }
 
-bool Compiler_Compile(const char *source, Chunk *chunk)
+ObjFunction *Compiler_Compile(const char *source)
 {
     Scanner_InitScanner(source); // initialize the state of scanner
+    // candidates point into the source they were declared in, they don't outlive it
+    inlineCandidateCount = 0;
+    currentClass = NULL;
     Compiler compiler;
-    initCompiler(&compiler);
-    compilingChunk = chunk;
+    initCompiler(&compiler, TYPE_SCRIPT);
 
     parser.hadError = false;
     parser.panicMode = false;
@@ -1063,7 +2240,20 @@ bool Compiler_Compile(const char *source, Chunk *chunk)
         declaration();
     }
 
-    endCompiler();
-    // return false if an error occurred
-    return !parser.hadError;
-}
\ No newline at end of file
+    ObjFunction *function = endCompiler();
+    // NULL if an error occurred
+    return parser.hadError ? NULL : function;
+}
+
+void Compiler_MarkRoots()
+{
+    for (Compiler *compiler = current; compiler != NULL; compiler = compiler->enclosing)
+        Memory_MarkObject((Obj *)compiler->function);
+    for (int i = 0; i < inlineCandidateCount; i++)
+        Memory_MarkObject((Obj *)inlineCandidates[i].function);
+}
+
+void Compiler_SetInlining(bool enabled)
+{
+    inliningEnabled = enabled;
+}
@@ -17,4 +17,12 @@
  */
 void Print_Color(const char *text, int color_code);
 void disassembleChunk(Chunk *chunk, const char *name);
-int Debug_disassembleInstruction(Chunk *chunk, int offset);
\ No newline at end of file
+int Debug_disassembleInstruction(Chunk *chunk, int offset);
+
+/**
+ * @brief Name of an opcode as written in the OpCode enum, e.g. "OP_ADD".
+ *
+ * @param opcode - opcode to name
+ * @return const char* - static string, "OP_UNKNOWN" for bytes that are not opcodes
+ */
+const char *Debug_OpcodeName(uint8_t opcode);
\ No newline at end of file
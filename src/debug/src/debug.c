@@ -1,6 +1,7 @@
 #include "chunk.h"
 #include "common.h"
 #include "debug.h"
+#include "object.h"
 #include "value.h"
 
 #include <stdio.h>
@@ -29,6 +30,26 @@ static int jumpInstruction(const char *name, int sign, Chunk *chunk, int offset)
     return offset + 3;
 }
 
+static uint32_t readUint24(Chunk *chunk, int offset)
+{
+    return (uint32_t)((chunk->code[offset] << 16) | (chunk->code[offset + 1] << 8) |
+                      chunk->code[offset + 2]);
+}
+
+static int longByteInstruction(const char *name, Chunk *chunk, int offset)
+{
+    printf("%-16s %4u\n", name, readUint24(chunk, offset + 1));
+    return offset + 4;
+}
+
+static int longJumpInstruction(const char *name, int sign, Chunk *chunk, int offset)
+{
+    uint32_t jump = readUint24(chunk, offset + 1);
+    printf("%-16s %4d -> %ld\n", name, offset,
+           offset + 4 + sign * (long)jump);
+    return offset + 4;
+}
+
 /**
  * @brief Disassembles a constant instruction.
  *
@@ -50,6 +71,140 @@ static int Debug_constantInstruction(const char *name, Chunk *chunk, int offset)
     return offset + 2;
 }
 
+/**
+ * @brief Disassembles OP_CONSTANT_LONG, whose constant index is 24 bits wide
+ *
+ * @param name - name of the instruction
+ * @param chunk - chunk containing the instruction
+ * @param offset - offset of the instruction in the chunk
+ * @return int - offset of the next instruction
+ */
+static int constantLongInstruction(const char *name, Chunk *chunk, int offset)
+{
+    uint32_t constant = readUint24(chunk, offset + 1);
+    printf("Instruction name: %-16s Constant Idx: %4u ", name, constant);
+    printf("Constant Idx Val: '");
+    Value_printValue(chunk->constants.values[constant], 32);
+    printf("'\n");
+    return offset + 4;
+}
+
+/**
+ * @brief Disassembles OP_ADD_LOCAL_CONST, which carries a local slot AND a constant index
+ *
+ * @param name - name of the instruction
+ * @param chunk - chunk containing the instruction
+ * @param offset - offset of the instruction in the chunk
+ * @return int - offset of the next instruction
+ */
+static int localConstantInstruction(const char *name, Chunk *chunk, int offset)
+{
+    uint8_t slot = chunk->code[offset + 1];
+    uint8_t constant = chunk->code[offset + 2];
+    printf("%-16s %4d + '", name, slot);
+    Value_printValue(chunk->constants.values[constant], 32);
+    printf("'\n");
+    return offset + 3;
+}
+
+/**
+ * @brief Disassembles OP_CLOSURE/OP_CLOSURE_LONG, followed by what the function captures
+ *
+ * @param name - name of the instruction
+ * @param chunk - chunk containing the instruction
+ * @param offset - offset of the instruction in the chunk
+ * @param constant - constant index of the function
+ * @param length - length of the instruction
+ * @return int - offset of the next instruction
+ */
+static int closureInstruction(const char *name, Chunk *chunk, int offset, uint32_t constant,
+                              int length)
+{
+    printf("Instruction name: %-16s Constant Idx: %4u ", name, constant);
+    Value_printValue(chunk->constants.values[constant], 32);
+    printf("\n");
+
+    // the captures aren't operands, they are listed in the function itself
+    ObjFunction *function = AS_FUNCTION(chunk->constants.values[constant]);
+    for (int i = 0; i < function->upvalueCount; i++)
+    {
+        printf("|                     %s %d\n", function->upvalues[i].isLocal ? "local" : "upvalue",
+               function->upvalues[i].index);
+    }
+    return offset + length;
+}
+
+/**
+ * @brief Disassembles OP_INLINE_CALL. The inlined body follows it, its lines are the ones
+ * of the inlined function's source
+ *
+ * @param name - name of the instruction
+ * @param chunk - chunk containing the instruction
+ * @param offset - offset of the instruction in the chunk
+ * @return int - offset of the next instruction
+ */
+static int inlineCallInstruction(const char *name, Chunk *chunk, int offset)
+{
+    uint8_t argCount = chunk->code[offset + 1];
+    uint8_t constant = chunk->code[offset + 2];
+    uint8_t skip = chunk->code[offset + 3];
+    printf("%-16s %4d args ", name, argCount);
+    Value_printValue(chunk->constants.values[constant], 32);
+    printf(" else call -> %d\n", offset + 4 + skip);
+    return offset + 4;
+}
+
+// how many entries of a property or invoke cache are in use
+static int cachedEntries(PropertyCache *cache)
+{
+    int cached = 0;
+    for (int i = 0; i < PROPERTY_CACHE_WAYS; i++)
+        cached += cache->entries[i].shape != NULL || cache->entries[i].klass != NULL;
+    return cached;
+}
+
+/**
+ * @brief Disassembles the property instructions, whose operand is an inline cache index.
+ * Shows the property's name, and the shapes the cache has seen so far
+ *
+ * @param name - name of the instruction
+ * @param chunk - chunk containing the instruction
+ * @param offset - offset of the instruction in the chunk
+ * @param cacheIndex - the operand
+ * @param length - length of the instruction
+ * @return int - offset of the next instruction
+ */
+static int propertyInstruction(const char *name, Chunk *chunk, int offset, uint32_t cacheIndex,
+                               int length)
+{
+    PropertyCache *cache = &chunk->caches[cacheIndex];
+    printf("%-16s %4u '", name, cacheIndex);
+    Value_printValue(chunk->constants.values[cache->name], 32);
+    printf("' %d cached\n", cachedEntries(cache));
+    return offset + length;
+}
+
+// an invoke is a property instruction with the argument count after the cache index
+static int invokeInstruction(const char *name, Chunk *chunk, int offset, uint32_t cacheIndex,
+                             int length)
+{
+    PropertyCache *cache = &chunk->caches[cacheIndex];
+    printf("%-16s (%d args) %4u '", name, chunk->code[offset + length - 1], cacheIndex);
+    Value_printValue(chunk->constants.values[cache->name], 32);
+    printf("' %d cached\n", cachedEntries(cache));
+    return offset + length;
+}
+
+const char *Debug_OpcodeName(uint8_t opcode)
+{
+#define OPCODE_NAME(name, operandBytes, stackEffect) #name,
+    static const char *names[] = {OPCODE_LIST(OPCODE_NAME)};
+#undef OPCODE_NAME
+    if (opcode >= OP_COUNT)
+        return "OP_UNKNOWN";
+    return names[opcode];
+}
+
 void Print_Color(const char *text, int color_code)
 {
     printf("\033[%dm%s\033[0m", color_code, text);
@@ -75,6 +230,12 @@ void disassembleChunk(Chunk *chunk, const char *name)
         // based on the size of instruction is has just disassembled
         offset = Debug_disassembleInstruction(chunk, offset);
     }
+    for (int i = 0; i < chunk->handlerCount; i++)
+    {
+        ExceptionHandler *handler = &chunk->handlers[i];
+        printf("try %04u-%04u catch -> %04u, stack depth %d\n", handler->start, handler->end,
+               handler->handler, handler->stackDepth);
+    }
 }
 
 /**
@@ -115,7 +276,7 @@ int Debug_disassembleInstruction(Chunk *chunk, int offset)
     case OP_EQUAL:
         return simpleInstruction("OP_EQUAL", offset);
     case OP_SET_GLOBAL:
-        return Debug_constantInstruction("OP_SET_GLOBAL", chunk, offset);
+        return byteInstruction("OP_SET_GLOBAL", chunk, offset);
     case OP_POP:
         return simpleInstruction("OP_POP", offset);
     case OP_GREATER:
@@ -137,21 +298,121 @@ int Debug_disassembleInstruction(Chunk *chunk, int offset)
     case OP_PRINT:
         return simpleInstruction("OP_PRINT", offset);
     case OP_DEFINE_GLOBAL:
-        return Debug_constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+        return byteInstruction("OP_DEFINE_GLOBAL", chunk, offset);
     case OP_GET_LOCAL:
         return byteInstruction("OP_GET_LOCAL", chunk, offset);
     case OP_SET_LOCAL:
         return byteInstruction("OP_SET_LOCAL", chunk, offset);
     case OP_GET_GLOBAL:
-        return Debug_constantInstruction("OP_GET_GLOBAL", chunk, offset);
+        return byteInstruction("OP_GET_GLOBAL", chunk, offset);
     case OP_JUMP:
         return jumpInstruction("OP_JUMP", 1, chunk, offset);
     case OP_JUMP_IF_FALSE:
         return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
     case OP_LOOP:
         return jumpInstruction("OP_LOOP", -1, chunk, offset);
+    case OP_GET_UPVALUE:
+        return byteInstruction("OP_GET_UPVALUE", chunk, offset);
+    case OP_SET_UPVALUE:
+        return byteInstruction("OP_SET_UPVALUE", chunk, offset);
+    case OP_CALL:
+        return byteInstruction("OP_CALL", chunk, offset);
+    case OP_TAIL_CALL:
+        return byteInstruction("OP_TAIL_CALL", chunk, offset);
+    case OP_INLINE_CALL:
+        return inlineCallInstruction("OP_INLINE_CALL", chunk, offset);
+    case OP_DROP_UNDER:
+        return byteInstruction("OP_DROP_UNDER", chunk, offset);
+    case OP_CLOSURE:
+        return closureInstruction("OP_CLOSURE", chunk, offset, chunk->code[offset + 1], 2);
+    case OP_CLOSE_UPVALUE:
+        return simpleInstruction("OP_CLOSE_UPVALUE", offset);
+    case OP_CLASS:
+        return Debug_constantInstruction("OP_CLASS", chunk, offset);
+    case OP_INHERIT:
+        return simpleInstruction("OP_INHERIT", offset);
+    case OP_METHOD:
+        return Debug_constantInstruction("OP_METHOD", chunk, offset);
+    case OP_GET_PROPERTY:
+        return propertyInstruction("OP_GET_PROPERTY", chunk, offset, chunk->code[offset + 1], 2);
+    case OP_SET_PROPERTY:
+        return propertyInstruction("OP_SET_PROPERTY", chunk, offset, chunk->code[offset + 1], 2);
+    case OP_GET_SUPER:
+        return Debug_constantInstruction("OP_GET_SUPER", chunk, offset);
+    case OP_INVOKE:
+        return invokeInstruction("OP_INVOKE", chunk, offset, chunk->code[offset + 1], 3);
+    case OP_SUPER_INVOKE:
+        return invokeInstruction("OP_SUPER_INVOKE", chunk, offset, chunk->code[offset + 1], 3);
+    case OP_THROW:
+        return simpleInstruction("OP_THROW", offset);
+    case OP_BUILD_LIST:
+        return byteInstruction("OP_BUILD_LIST", chunk, offset);
+    case OP_GET_INDEX:
+        return simpleInstruction("OP_GET_INDEX", offset);
+    case OP_SET_INDEX:
+        return simpleInstruction("OP_SET_INDEX", offset);
     case OP_RETURN:
         return simpleInstruction("OP_RETURN", offset);
+    case OP_NOT_EQUAL:
+        return simpleInstruction("OP_NOT_EQUAL", offset);
+    case OP_GREATER_EQUAL:
+        return simpleInstruction("OP_GREATER_EQUAL", offset);
+    case OP_LESS_EQUAL:
+        return simpleInstruction("OP_LESS_EQUAL", offset);
+    case OP_ADD_LOCAL_CONST:
+        return localConstantInstruction("OP_ADD_LOCAL_CONST", chunk, offset);
+    case OP_JUMP_IF_FALSE_POP:
+        return jumpInstruction("OP_JUMP_IF_FALSE_POP", 1, chunk, offset);
+    case OP_CONSTANT_LONG:
+        return constantLongInstruction("OP_CONSTANT_LONG", chunk, offset);
+    case OP_CLOSURE_LONG:
+        return closureInstruction("OP_CLOSURE_LONG", chunk, offset,
+                                  readUint24(chunk, offset + 1), 4);
+    case OP_CLASS_LONG:
+        return constantLongInstruction("OP_CLASS_LONG", chunk, offset);
+    case OP_METHOD_LONG:
+        return constantLongInstruction("OP_METHOD_LONG", chunk, offset);
+    case OP_GET_PROPERTY_LONG:
+        return propertyInstruction("OP_GET_PROPERTY_LONG", chunk, offset,
+                                   readUint24(chunk, offset + 1), 4);
+    case OP_SET_PROPERTY_LONG:
+        return propertyInstruction("OP_SET_PROPERTY_LONG", chunk, offset,
+                                   readUint24(chunk, offset + 1), 4);
+    case OP_GET_SUPER_LONG:
+        return constantLongInstruction("OP_GET_SUPER_LONG", chunk, offset);
+    case OP_INVOKE_LONG:
+        return invokeInstruction("OP_INVOKE_LONG", chunk, offset, readUint24(chunk, offset + 1), 5);
+    case OP_SUPER_INVOKE_LONG:
+        return invokeInstruction("OP_SUPER_INVOKE_LONG", chunk, offset,
+                                 readUint24(chunk, offset + 1), 5);
+    case OP_GET_GLOBAL_LONG:
+        return longByteInstruction("OP_GET_GLOBAL_LONG", chunk, offset);
+    case OP_DEFINE_GLOBAL_LONG:
+        return longByteInstruction("OP_DEFINE_GLOBAL_LONG", chunk, offset);
+    case OP_SET_GLOBAL_LONG:
+        return longByteInstruction("OP_SET_GLOBAL_LONG", chunk, offset);
+    case OP_JUMP_LONG:
+        return longJumpInstruction("OP_JUMP_LONG", 1, chunk, offset);
+    case OP_JUMP_IF_FALSE_LONG:
+        return longJumpInstruction("OP_JUMP_IF_FALSE_LONG", 1, chunk, offset);
+    case OP_JUMP_IF_FALSE_POP_LONG:
+        return longJumpInstruction("OP_JUMP_IF_FALSE_POP_LONG", 1, chunk, offset);
+    case OP_LOOP_LONG:
+        return longJumpInstruction("OP_LOOP_LONG", -1, chunk, offset);
+    case OP_ADD_NUM:
+        return simpleInstruction("OP_ADD_NUM", offset);
+    case OP_ADD_STR:
+        return simpleInstruction("OP_ADD_STR", offset);
+    case OP_SUBTRACT_NUM:
+        return simpleInstruction("OP_SUBTRACT_NUM", offset);
+    case OP_MULTIPLY_NUM:
+        return simpleInstruction("OP_MULTIPLY_NUM", offset);
+    case OP_DIVIDE_NUM:
+        return simpleInstruction("OP_DIVIDE_NUM", offset);
+    case OP_GREATER_NUM:
+        return simpleInstruction("OP_GREATER_NUM", offset);
+    case OP_LESS_NUM:
+        return simpleInstruction("OP_LESS_NUM", offset);
     default:
         // print if bug exists in compiler
         printf("Unknown opcode: %d\n", instruction);
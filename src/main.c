@@ -1,6 +1,9 @@
 #include "chunk.h"
 #include "common.h"
+#include "compiler.h"
 #include "debug.h"
+#include "memory.h"
+#include "regvm.h"
 #include "vm.h"
 
 #include <stdio.h>
@@ -54,11 +57,18 @@ static char *readFile(const char *path)
     return buffer;
 }
 
+// which VM runs the code, picked once at startup with --backend
+static InterpretResult (*interpret)(const char *source) = Vm_Interpret;
+// --gc-stats: say what the collector did once the code is done
+static bool printGcStats = false;
+
 static void runFile(const char *path)
 {
-    char *source = readFile(path);                 // read file of code
-    InterpretResult result = Vm_Interpret(source); // EXECUTE (interpret) the code
+    char *source = readFile(path);              // read file of code
+    InterpretResult result = interpret(source); // EXECUTE (interpret) the code
     free(source);                                  // free result I guess its on Heap ??
+    if (printGcStats)
+        Memory_PrintStats(stderr);
 
     if (result == INTERPRET_COMPILE_ERROR)
         exit(65);
@@ -70,19 +80,62 @@ int main(int argc, const char *argv[])
 {
     Vm_InitVm();
 
+    // leading --flags, then at most one script path
+    int arg = 1;
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++)
+    {
+        if (strcmp(argv[arg], "--trace") == 0)
+        {
+            // record executed instructions, dumped if the script hits a runtime error
+            Vm_SetTracing(true);
+        }
+        else if (strcmp(argv[arg], "--no-inline") == 0)
+        {
+            // every call really calls, handy when reading disassembly or profiles
+            Compiler_SetInlining(false);
+        }
+        else if (strcmp(argv[arg], "--backend=stack") == 0)
+        {
+            interpret = Vm_Interpret;
+        }
+        else if (strcmp(argv[arg], "--backend=register") == 0)
+        {
+            interpret = RegVm_Interpret;
+        }
+        else if (strncmp(argv[arg], "--gc-slice=", 11) == 0 && atoi(argv[arg] + 11) > 0)
+        {
+            // full collections in slices of this much work, for shorter pauses
+            Memory_SetIncremental(atoi(argv[arg] + 11));
+        }
+        else if (strcmp(argv[arg], "--gc-stats") == 0)
+        {
+            printGcStats = true;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option '%s'.\n", argv[arg]);
+            fprintf(stderr, "Usage: urbanC [--trace] [--no-inline] [--backend=stack|register] "
+                            "[--gc-slice=<work>] [--gc-stats] [path]\n");
+            exit(64);
+        }
+    }
+
     // no args then drop into REPL
-    if (argc == 1)
+    if (arg == argc)
     {
         repl();
+        if (printGcStats)
+            Memory_PrintStats(stderr);
     }
     // Should be path to a script to run
-    else if (argc == 2)
+    else if (arg == argc - 1)
     {
-        runFile(argv[1]);
+        runFile(argv[arg]);
     }
     else
     {
-        fprintf(stderr, "Usage: urbanC [path]\n");
+        fprintf(stderr, "Usage: urbanC [--trace] [--no-inline] [--backend=stack|register] "
+                        "[--gc-slice=<work>] [--gc-stats] [path]\n");
         exit(64);
     }
 
@@ -1,7 +1,7 @@
 #pragma once
 
 #include "common.h"
-#include "memory.h"
+#include "value.h"
 
 #define MIN_ARR_THRESHOLD 8
 #define ARR_GROWTH_FACTOR 2
@@ -55,13 +55,116 @@
     (type *)Memory_Reallocate(pointer, sizeof(type) * (oldCount), \
                               sizeof(type) * (newCount))
 
+// blocks up to POOL_MAX_SIZE bytes come from pools, in size classes POOL_GRANULE bytes apart
+#define POOL_GRANULE 16
+#define POOL_MAX_SIZE 256
+#define POOL_CLASSES (POOL_MAX_SIZE / POOL_GRANULE)
+// the pools get memory from malloc this many bytes at a time
+#define POOL_PAGE_SIZE (64 * 1024)
+
+// first full collection happens once this many bytes are allocated
+#define GC_INITIAL_THRESHOLD (1024 * 1024)
+// a young collection happens once this many bytes were allocated since the last collection
+#define GC_NURSERY_SIZE (256 * 1024)
+// under DEBUG_STRESS_GC every allocation collects, every this many times a full collection
+#define GC_STRESS_FULL_INTERVAL 8
+// while an incremental collection runs, one slice of it is done every this many bytes allocated
+#define GC_SLICE_BYTES (32 * 1024)
+
+/*
+ * Where an incremental full collection is, see Memory_SetIncremental. Marking is
+ * tri-color: unmarked objects are white, marked ones on the gray stack or in the
+ * remembered set are gray, and the other marked ones are black.
+ */
+typedef enum
+{
+    GC_IDLE,     // only young collections happen
+    GC_CLEARING, // unmarking the old objects, their marks mean nothing until marking starts
+    GC_MARKING,  // a slice blackens gray objects, a store into a black one makes it gray again
+    GC_SWEEPING, // a slice frees unmarked objects, new objects are young and left alone
+} GcPhase;
+
+// what the collector did so far, see Memory_PrintStats
+typedef struct
+{
+    int youngCollections;
+    int fullCollections;        // stop the world ones
+    int incrementalCollections; // finished ones
+    int slices;                 // of the incremental ones
+    uint64_t totalPauseNs;      // the mutator waited this long for all of the above
+    uint64_t maxPauseNs;        // longest single wait: a collection or a slice
+} GcStats;
+// after a collection the next one waits until the heap is this many times the live size
+#define GC_HEAP_GROW_FACTOR 2
+// most objects Memory_PushRoot can protect at once
+#define GC_TEMP_ROOTS_MAX 8
+
 /**
  * @brief Function used for all dynamic memory allocation. This include allocating,
- * reallocating, and freeing memory.
+ * reallocating, and freeing memory. Blocks of at most POOL_MAX_SIZE bytes come from
+ * size-class pools and larger ones from malloc; which one a block came from is worked out
+ * from its size, so oldSize must be exactly what the block was last given. Growing a
+ * block counts towards vm.nextGC and the nursery and may collect garbage first, so every
+ * object still needed must be reachable from a root before calling it (see
+ * Memory_CollectGarbage).
  *
  * @param pointer - The pointer to the memory to be Memory_Reallocated.
  * @param oldSize - The size of the memory block pointed to by pointer.
  * @param newSize - The new size of the memory block.
  */
 void *Memory_Reallocate(void *pointer, size_t oldSize, size_t newSize);
+
+/**
+ * @brief Free every object that can't be reached any more. Precise mark-sweep: marking
+ * starts from the roots (the running fiber's stack, frames and open upvalues, every
+ * fiber, the globals, the functions the compilers are filling and the temporary roots)
+ * and follows every reference an object holds. vm.strings is weak, an interned string
+ * nothing else refers to is dropped from it and freed. Every survivor is old afterwards.
+ * Called by Memory_Reallocate once the whole heap has grown past vm.nextGC.
+ */
+void Memory_CollectGarbage();
+
+/**
+ * @brief Free the young objects, those allocated since the last collection, that can't
+ * be reached any more and make the others old. Marking starts from the same roots plus
+ * the remembered old objects, and stops at every old object: its mark stays set while it
+ * is old. The cost follows what survives and what is remembered, not the size of the old
+ * heap. Called by Memory_Reallocate once GC_NURSERY_SIZE bytes were allocated.
+ */
+void Memory_CollectYoung();
+
+/**
+ * @brief Make full collections incremental: once the heap has grown past vm.nextGC the
+ * collector clears, marks and sweeps in slices of at most workPerSlice units (an object
+ * visited, or a reference followed), interleaved with the program's allocations. Only
+ * the end of marking is done in one go: it looks at the roots again and drops dead
+ * strings from vm.strings. 0 turns it off, full collections stop the world again; one
+ * already running is finished first.
+ */
+void Memory_SetIncremental(int workPerSlice);
+
+// print the collection counts and the total and longest pause
+void Memory_PrintStats(FILE *out);
+
+/**
+ * @brief object is old and may now refer to young objects, the next young collection
+ * follows its references. While an incremental collection marks, a marked object is made
+ * gray again instead, so the references stored into it since are followed too. Does
+ * nothing for an unmarked object. See writeBarrier.
+ */
+void Memory_Remember(Obj *object);
+
+// mark object as reachable, NULL is fine
+void Memory_MarkObject(Obj *object);
+
+// mark value's object, if it is one
+void Memory_MarkValue(Value value);
+
+/**
+ * @brief Keep object alive while nothing else refers to it yet, for C code that has to
+ * allocate again before it can store it anywhere. Pairs with Memory_PopRoot.
+ */
+void Memory_PushRoot(Obj *object);
+void Memory_PopRoot();
+
 void freeObjects();
\ No newline at end of file
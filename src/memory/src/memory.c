@@ -1,8 +1,118 @@
 #include "memory.h"
+#include "compiler.h"
 #include "object.h"
+#include "regvm.h"
 #include "vm.h"
 
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void collectIfDue(size_t grownBy);
+
+#ifdef POOL_ALLOCATOR
+/*
+ * Small blocks come from pages of POOL_PAGE_SIZE bytes instead of malloc. Each size class
+ * (a multiple of POOL_GRANULE up to POOL_MAX_SIZE) has a free list of the blocks given
+ * back; when it is empty the next block is cut from the current page. A block carries no
+ * header, the caller's oldSize says which class it came from.
+ */
+typedef struct PoolBlock
+{
+    struct PoolBlock *next;
+} PoolBlock;
+
+static struct
+{
+    PoolBlock *freeLists[POOL_CLASSES];
+    char *cursor;   // where the next new block in the current page starts
+    char *limit;    // end of the current page
+    void *pages;    // every page, linked through their first word
+    int pageCount;
+} pool;
+
+static int poolClass(size_t size)
+{
+    return (int)((size - 1) / POOL_GRANULE);
+}
+
+static void *poolAllocate(int sizeClass)
+{
+    PoolBlock *block = pool.freeLists[sizeClass];
+    if (block != NULL)
+    {
+        pool.freeLists[sizeClass] = block->next;
+        return block;
+    }
+
+    size_t size = (size_t)(sizeClass + 1) * POOL_GRANULE;
+    if (pool.cursor == NULL || (size_t)(pool.limit - pool.cursor) < size)
+    {
+        // the rest of the old page is too small for this class and is left unused
+        char *page = (char *)malloc(POOL_PAGE_SIZE);
+        if (page == NULL)
+            exit(1);
+        *(void **)page = pool.pages;
+        pool.pages = page;
+        pool.pageCount++;
+        pool.cursor = page + POOL_GRANULE; // the link, blocks stay POOL_GRANULE aligned
+        pool.limit = page + POOL_PAGE_SIZE;
+    }
+    void *result = pool.cursor;
+    pool.cursor += size;
+    return result;
+}
+
+static void poolFree(void *pointer, int sizeClass)
+{
+    PoolBlock *block = (PoolBlock *)pointer;
+    block->next = pool.freeLists[sizeClass];
+    pool.freeLists[sizeClass] = block;
+}
+
+/**
+ * @brief Memory_Reallocate for a block that is small before or after. It moves only when
+ * its size class changes, the bytes both sizes have in common are copied.
+ */
+static void *poolReallocate(void *pointer, size_t oldSize, size_t newSize)
+{
+    bool oldPooled = oldSize != 0 && oldSize <= POOL_MAX_SIZE;
+    bool newPooled = newSize != 0 && newSize <= POOL_MAX_SIZE;
+    if (oldPooled && newPooled && poolClass(oldSize) == poolClass(newSize))
+        return pointer;
+
+    void *result = NULL;
+    if (newPooled)
+        result = poolAllocate(poolClass(newSize));
+    else if (newSize != 0 && (result = malloc(newSize)) == NULL)
+        exit(1);
+
+    if (oldSize != 0)
+    {
+        if (result != NULL)
+            memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+        if (oldPooled)
+            poolFree(pointer, poolClass(oldSize));
+        else
+            free(pointer);
+    }
+    return result;
+}
+
+// hand every page back, only once no block is in use any more
+static void releasePools()
+{
+    void *page = pool.pages;
+    while (page != NULL)
+    {
+        void *next = *(void **)page;
+        free(page);
+        page = next;
+    }
+    memset(&pool, 0, sizeof(pool));
+}
+#endif // POOL_ALLOCATOR
 
 void *Memory_Reallocate(void *pointer, size_t oldSize, size_t newSize)
 {
@@ -14,6 +124,15 @@ void *Memory_Reallocate(void *pointer, size_t oldSize, size_t newSize)
      * let C standard library handle reallocation to new size.
      * if space
      */
+    vm.bytesAllocated += newSize - oldSize;
+    if (newSize > oldSize)
+        collectIfDue(newSize - oldSize);
+
+#ifdef POOL_ALLOCATOR
+    if (oldSize <= POOL_MAX_SIZE || newSize <= POOL_MAX_SIZE)
+        return poolReallocate(pointer, oldSize, newSize);
+#endif // POOL_ALLOCATOR
+
     if (newSize == 0)
     {
         free(pointer);
@@ -40,30 +159,688 @@ static void freeObject(Obj *object)
 {
     switch (object->type)
     {
+    case OBJ_BOUND_METHOD:
+        FREE(ObjBoundMethod, object);
+        break;
+    case OBJ_CLASS:
+    {
+        ObjClass *klass = (ObjClass *)object;
+        freeTable(&klass->methods);
+        FREE(ObjClass, object);
+        break;
+    }
+    case OBJ_INSTANCE:
+    {
+        ObjInstance *instance = (ObjInstance *)object;
+        FREE_ARRAY(Value, instance->fields, instance->fieldCapacity);
+        FREE(ObjInstance, object);
+        break;
+    }
+    case OBJ_LIST:
+    {
+        ObjList *list = (ObjList *)object;
+        if (list->isNumeric)
+            FREE_ARRAY(double, list->as.numbers, list->capacity);
+        else
+            FREE_ARRAY(Value, list->as.values, list->capacity);
+        FREE(ObjList, object);
+        break;
+    }
+    case OBJ_SHAPE:
+        freeTable(&((ObjShape *)object)->transitions);
+        FREE(ObjShape, object);
+        break;
+    case OBJ_CLOSURE:
+    {
+        // the upvalues themselves may be shared with other closures, they are objects of their own
+        ObjClosure *closure = (ObjClosure *)object;
+        FREE_ARRAY(ObjUpvalue *, closure->upvalues, closure->upvalueCount);
+        FREE(ObjClosure, object);
+        break;
+    }
+    case OBJ_FIBER:
+    {
+        ObjFiber *fiber = (ObjFiber *)object;
+        if (fiber->stack != NULL)
+            FREE_ARRAY(Value, fiber->stack - STACK_GUARD, fiber->stackCapacity + STACK_GUARD);
+        FREE_ARRAY(CallFrame, fiber->frames, fiber->frameCapacity);
+        FREE(ObjFiber, object);
+        break;
+    }
     case OBJ_FUNCTION:
     {
         ObjFunction *function = (ObjFunction *)object;
+        FREE_ARRAY(UpvalueInfo, function->upvalues, function->upvalueCount);
         Chunk_FreeChunk(&function->chunk);
         FREE(ObjFunction, object);
         break;
     }
+    case OBJ_NATIVE:
+        FREE(ObjNative, object);
+        break;
+    case OBJ_UPVALUE:
+        FREE(ObjUpvalue, object);
+        break;
     case OBJ_STRING:
+        // the characters are part of the object's block
+        Memory_Reallocate(object, STRING_SIZE(((ObjString *)object)->length), 0);
+        break;
+    }
+}
+
+void Memory_MarkObject(Obj *object)
+{
+    if (object == NULL || object->isMarked)
+        return;
+    object->isMarked = true;
+
+    // the object's references are followed later, from the gray stack, so marking a deep
+    // structure doesn't recurse
+    if (vm.grayCapacity < vm.grayCount + 1)
+    {
+        vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);
+        vm.grayStack = (Obj **)realloc(vm.grayStack, sizeof(Obj *) * vm.grayCapacity);
+        if (vm.grayStack == NULL)
+            exit(1);
+    }
+    vm.grayStack[vm.grayCount++] = object;
+}
+
+void Memory_MarkValue(Value value)
+{
+    if (IS_OBJ(value))
+        Memory_MarkObject(AS_OBJ(value));
+}
+
+static void markArray(ValueArray *array)
+{
+    for (int i = 0; i < array->count; i++)
+        Memory_MarkValue(array->values[i]);
+}
+
+static void markFrames(CallFrame *frames, int frameCount)
+{
+    for (int i = 0; i < frameCount; i++)
+    {
+        Memory_MarkObject((Obj *)frames[i].function);
+        Memory_MarkObject((Obj *)frames[i].closure);
+    }
+}
+
+static void markUpvalues(ObjUpvalue *upvalue)
+{
+    for (; upvalue != NULL; upvalue = upvalue->next)
+        Memory_MarkObject((Obj *)upvalue);
+}
+
+// an inline cache remembers classes and methods, they must not be reused by new objects
+static void markCaches(Chunk *chunk)
+{
+    for (int i = 0; i < chunk->cacheCount; i++)
+    {
+        for (int j = 0; j < PROPERTY_CACHE_WAYS; j++)
+        {
+            PropertyCacheEntry *entry = &chunk->caches[i].entries[j];
+            Memory_MarkObject((Obj *)entry->shape);
+            Memory_MarkObject((Obj *)entry->newShape);
+            Memory_MarkObject((Obj *)entry->klass);
+            Memory_MarkValue(entry->method);
+        }
+    }
+}
+
+/**
+ * @brief Mark everything object refers to, it turns from gray to black.
+ *
+ * @return int - roughly how much work that was, for an incremental collection's budget
+ */
+static int blackenObject(Obj *object)
+{
+    int work = 1;
+    switch (object->type)
+    {
+    case OBJ_BOUND_METHOD:
     {
-        ObjString *string = (ObjString *)object;
-        FREE_ARRAY(char, string->chars, string->length + 1);
-        FREE(ObjString, object);
+        ObjBoundMethod *bound = (ObjBoundMethod *)object;
+        Memory_MarkValue(bound->receiver);
+        Memory_MarkValue(bound->method);
         break;
     }
+    case OBJ_CLASS:
+    {
+        ObjClass *klass = (ObjClass *)object;
+        Memory_MarkObject((Obj *)klass->name);
+        markTable(&klass->methods);
+        work += klass->methods.capacity;
+        break;
+    }
+    case OBJ_CLOSURE:
+    {
+        ObjClosure *closure = (ObjClosure *)object;
+        Memory_MarkObject((Obj *)closure->function);
+        // NULL while OP_CLOSURE is still capturing
+        for (int i = 0; i < closure->upvalueCount; i++)
+            Memory_MarkObject((Obj *)closure->upvalues[i]);
+        work += closure->upvalueCount;
+        break;
+    }
+    case OBJ_FIBER:
+    {
+        ObjFiber *fiber = (ObjFiber *)object;
+        Memory_MarkValue(fiber->function);
+        Memory_MarkObject((Obj *)fiber->resumer);
+        // the running fiber's fields are stale, its stack is marked from vm instead
+        if (fiber != vm.fiber && fiber->stack != NULL)
+        {
+            for (Value *slot = fiber->stack; slot < fiber->stackTop; slot++)
+                Memory_MarkValue(*slot);
+            markFrames(fiber->frames, fiber->frameCount);
+            markUpvalues(fiber->openUpvalues);
+            work += (int)(fiber->stackTop - fiber->stack) + fiber->frameCount;
+        }
+        break;
+    }
+    case OBJ_FUNCTION:
+    {
+        ObjFunction *function = (ObjFunction *)object;
+        Memory_MarkObject((Obj *)function->name);
+        markArray(&function->chunk.constants);
+        markCaches(&function->chunk);
+        work += function->chunk.constants.count + function->chunk.cacheCount;
+        break;
+    }
+    case OBJ_INSTANCE:
+    {
+        ObjInstance *instance = (ObjInstance *)object;
+        Memory_MarkObject((Obj *)instance->klass);
+        Memory_MarkObject((Obj *)instance->shape);
+        for (int i = 0; i < instance->shape->fieldCount; i++)
+            Memory_MarkValue(instance->fields[i]);
+        work += instance->shape->fieldCount;
+        break;
+    }
+    case OBJ_LIST:
+    {
+        ObjList *list = (ObjList *)object;
+        // a numeric list holds no references at all
+        if (!list->isNumeric)
+        {
+            for (int i = 0; i < list->count; i++)
+                Memory_MarkValue(list->as.values[i]);
+            work += list->count;
+        }
+        break;
+    }
+    case OBJ_NATIVE:
+        Memory_MarkObject((Obj *)((ObjNative *)object)->name);
+        break;
+    case OBJ_SHAPE:
+    {
+        ObjShape *shape = (ObjShape *)object;
+        Memory_MarkObject((Obj *)shape->parent);
+        Memory_MarkObject((Obj *)shape->name);
+        markTable(&shape->transitions);
+        work += shape->transitions.capacity;
+        break;
     }
+    case OBJ_UPVALUE:
+    {
+        ObjUpvalue *upvalue = (ObjUpvalue *)object;
+        // closed or not: a store through an open upvalue into an old fiber's stack only
+        // remembers the upvalue, so the value has to be found from here
+        Memory_MarkValue(*upvalue->location);
+        // a closure may outlive every other reference to a suspended fiber it captured from
+        Memory_MarkObject((Obj *)upvalue->fiber);
+        break;
+    }
+    case OBJ_STRING:
+        break;
+    }
+    return work;
 }
 
-void freeObjects()
+static void markRoots()
 {
-    Obj *object = vm.objects;
+    // the running fiber, whose state lives in vm while it runs
+    for (Value *slot = vm.stack; slot < vm.stackTop; slot++)
+        Memory_MarkValue(*slot);
+    markFrames(vm.frames, vm.frameCount);
+    markUpvalues(vm.openUpvalues);
+    // every other fiber still running is a resumer of it, their stacks are marked with them
+    Memory_MarkObject((Obj *)vm.fiber);
+    Memory_MarkObject((Obj *)vm.mainFiber);
+    Memory_MarkValue(vm.exception);
+
+    markArray(&vm.globalValues);
+    markArray(&vm.globalIdentifiers);
+    markTable(&vm.globalSlots);
+    Memory_MarkObject((Obj *)vm.initString);
+    Memory_MarkObject((Obj *)vm.emptyShape);
+    for (int i = 0; i < vm.tempRootCount; i++)
+        Memory_MarkObject(vm.tempRoots[i]);
+    // a trace dump still names the functions it recorded
+    if (vm.trace.enabled)
+    {
+        for (int i = 0; i < TRACE_BUFFER_SIZE; i++)
+            Memory_MarkObject((Obj *)vm.trace.entries[i].function);
+    }
+
+    Compiler_MarkRoots();
+    RegVm_MarkRoots();
+}
+
+static void traceReferences()
+{
+    while (vm.grayCount > 0)
+        blackenObject(vm.grayStack[--vm.grayCount]);
+}
+
+// empty the remembered set
+static void forgetRemembered()
+{
+    for (int i = 0; i < vm.rememberedCount; i++)
+        vm.remembered[i]->isRemembered = false;
+    vm.rememberedCount = 0;
+}
+
+// free every old object that wasn't marked, the others stay old and keep their mark
+static void sweepOld()
+{
+    Obj *previous = NULL;
+    Obj *object = vm.oldObjects;
+    while (object != NULL)
+    {
+        if (object->isMarked)
+        {
+            previous = object;
+            object = object->next;
+            continue;
+        }
+        Obj *unreached = object;
+        object = object->next;
+        if (previous != NULL)
+            previous->next = object;
+        else
+            vm.oldObjects = object;
+        freeObject(unreached);
+    }
+}
+
+// free every young object that wasn't marked, the others become old
+static void sweepYoung()
+{
+    Obj *object = vm.youngObjects;
     while (object != NULL)
     {
         Obj *next = object->next;
-        freeObject(object);
+        if (object->isMarked)
+        {
+            object->next = vm.oldObjects;
+            vm.oldObjects = object;
+        }
+        else
+        {
+            freeObject(object);
+        }
         object = next;
     }
+    vm.youngObjects = NULL;
+    vm.nurseryBytes = 0;
+}
+
+static uint64_t nowNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// the program has been waiting for the collector since start
+static void recordPause(uint64_t start)
+{
+    uint64_t pause = nowNs() - start;
+    vm.gcStats.totalPauseNs += pause;
+    if (pause > vm.gcStats.maxPauseNs)
+        vm.gcStats.maxPauseNs = pause;
+}
+
+// the more that survived, the longer until the next full collection
+static void setNextGC()
+{
+    vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
+    if (vm.nextGC < GC_INITIAL_THRESHOLD)
+        vm.nextGC = GC_INITIAL_THRESHOLD;
+}
+
+void Memory_CollectGarbage()
+{
+    uint64_t start = nowNs();
+#ifdef DEBUG_LOG_GC
+    size_t before = vm.bytesAllocated;
+#endif // DEBUG_LOG_GC
+
+    // old objects keep their mark between collections, this one marks from scratch
+    for (Obj *object = vm.oldObjects; object != NULL; object = object->next)
+        object->isMarked = false;
+    markRoots();
+    traceReferences();
+    tableRemoveWhite(&vm.strings);
+    // afterwards everything is old, nothing refers to a young object any more
+    forgetRemembered();
+    sweepOld();
+    sweepYoung();
+    setNextGC();
+
+    vm.gcStats.fullCollections++;
+    recordPause(start);
+#ifdef DEBUG_LOG_GC
+    fprintf(stderr, "-- gc collected %zu bytes (from %zu to %zu) next at %zu\n",
+            before - vm.bytesAllocated, before, vm.bytesAllocated, vm.nextGC);
+#endif // DEBUG_LOG_GC
+}
+
+void Memory_CollectYoung()
+{
+    uint64_t start = nowNs();
+#ifdef DEBUG_LOG_GC
+    size_t before = vm.bytesAllocated;
+    int remembered = vm.rememberedCount;
+#endif // DEBUG_LOG_GC
+
+    // marking stops at old objects, they are marked already
+    markRoots();
+    for (int i = 0; i < vm.rememberedCount; i++)
+        blackenObject(vm.remembered[i]);
+    forgetRemembered();
+    traceReferences();
+    tableRemoveWhite(&vm.strings);
+    sweepYoung();
+
+    vm.gcStats.youngCollections++;
+    recordPause(start);
+#ifdef DEBUG_LOG_GC
+    fprintf(stderr, "-- gc young collected %zu bytes (from %zu to %zu), %d remembered\n",
+            before - vm.bytesAllocated, before, vm.bytesAllocated, remembered);
+#endif // DEBUG_LOG_GC
+}
+
+/*
+ * An incremental full collection goes through the GcPhases one slice at a time. Each
+ * step below does up to budget units of work and returns how much it did, a step that
+ * runs out of things to do moves on to the next phase instead.
+ */
+
+// the whole heap is collected, which old objects refer to young ones doesn't matter
+static void startCycle()
+{
+    forgetRemembered();
+    vm.clearCursor = vm.oldObjects;
+    vm.sliceBytes = 0;
+    vm.gcPhase = GC_CLEARING;
+}
+
+static int clearStep(int budget)
+{
+    int work = 0;
+    for (; vm.clearCursor != NULL && work < budget; work++)
+    {
+        vm.clearCursor->isMarked = false;
+        vm.clearCursor = vm.clearCursor->next;
+    }
+    if (vm.clearCursor == NULL)
+    {
+        vm.gcPhase = GC_MARKING;
+        markRoots();
+    }
+    return work;
+}
+
+/**
+ * @brief The end of marking, all in one go. The roots aren't behind a write barrier, so
+ * they are marked again and whatever that reaches is traced. Then the objects to sweep
+ * are set aside: everything allocated up to now, what comes after is young and left to
+ * the young collections.
+ */
+static void finishMarking()
+{
+    markRoots();
+    for (int i = 0; i < vm.rememberedCount; i++)
+        blackenObject(vm.remembered[i]);
+    forgetRemembered();
+    traceReferences();
+    tableRemoveWhite(&vm.strings);
+
+    vm.sweepLink = &vm.oldObjects;
+    vm.sweepingYoung = vm.youngObjects;
+    vm.youngObjects = NULL;
+    vm.nurseryBytes = 0;
+    vm.gcPhase = GC_SWEEPING;
+}
+
+static int markStep(int budget)
+{
+    int work = 0;
+    while (work < budget)
+    {
+        // objects stored into since they were blackened go first
+        if (vm.rememberedCount > 0)
+        {
+            Obj *object = vm.remembered[--vm.rememberedCount];
+            object->isRemembered = false;
+            work += blackenObject(object);
+        }
+        else if (vm.grayCount > 0)
+        {
+            work += blackenObject(vm.grayStack[--vm.grayCount]);
+        }
+        else
+        {
+            finishMarking();
+            break;
+        }
+    }
+    return work;
+}
+
+static void finishCycle()
+{
+    vm.gcPhase = GC_IDLE;
+    vm.sweepLink = NULL;
+    setNextGC();
+    vm.gcStats.incrementalCollections++;
+#ifdef DEBUG_LOG_GC
+    fprintf(stderr, "-- gc incremental collection done, %zu bytes live, next at %zu\n",
+            vm.bytesAllocated, vm.nextGC);
+#endif // DEBUG_LOG_GC
+}
+
+static int sweepStep(int budget)
+{
+    int work = 0;
+    for (; *vm.sweepLink != NULL && work < budget; work++)
+    {
+        Obj *object = *vm.sweepLink;
+        if (object->isMarked)
+        {
+            vm.sweepLink = &object->next;
+            continue;
+        }
+        *vm.sweepLink = object->next;
+        freeObject(object);
+    }
+    // past the last old object, young survivors are appended there as old ones
+    for (; *vm.sweepLink == NULL && vm.sweepingYoung != NULL && work < budget; work++)
+    {
+        Obj *object = vm.sweepingYoung;
+        vm.sweepingYoung = object->next;
+        if (object->isMarked)
+        {
+            object->next = NULL;
+            *vm.sweepLink = object;
+            vm.sweepLink = &object->next;
+        }
+        else
+        {
+            freeObject(object);
+        }
+    }
+    if (*vm.sweepLink == NULL && vm.sweepingYoung == NULL)
+        finishCycle();
+    return work;
+}
+
+static int collectStep(int budget)
+{
+    switch (vm.gcPhase)
+    {
+    case GC_CLEARING:
+        return clearStep(budget);
+    case GC_MARKING:
+        return markStep(budget);
+    case GC_SWEEPING:
+        return sweepStep(budget);
+    case GC_IDLE:
+        break;
+    }
+    return 0;
+}
+
+// one slice of the incremental collection, the program waits for it
+static void collectSlice(int budget)
+{
+    uint64_t start = nowNs();
+    for (int work = 0; work < budget && vm.gcPhase != GC_IDLE;)
+        work += collectStep(budget - work);
+    vm.gcStats.slices++;
+    recordPause(start);
+}
+
+// do whatever the incremental collection has left in one go
+static void finishCollection()
+{
+    uint64_t start = nowNs();
+    while (vm.gcPhase != GC_IDLE)
+        collectStep(INT_MAX / 2);
+    recordPause(start);
+}
+
+static void collectIfDue(size_t grownBy)
+{
+    vm.nurseryBytes += grownBy;
+    if (vm.gcPhase != GC_IDLE)
+    {
+        // young collections wait until the full one is done. If the program allocates
+        // faster than the slices keep up with, the rest is done at once
+        vm.sliceBytes += grownBy;
+        if (vm.bytesAllocated > vm.nextGC * GC_HEAP_GROW_FACTOR)
+        {
+            finishCollection();
+            return;
+        }
+#ifndef DEBUG_STRESS_GC
+        if (vm.sliceBytes < GC_SLICE_BYTES)
+            return;
+#endif // DEBUG_STRESS_GC
+        vm.sliceBytes = 0;
+        collectSlice(vm.gcSliceWork);
+        return;
+    }
+
+#ifdef DEBUG_STRESS_GC
+    static int stressCount = 0;
+    bool full = ++stressCount % GC_STRESS_FULL_INTERVAL == 0;
+    bool young = true;
+#else
+    bool full = vm.bytesAllocated > vm.nextGC;
+    bool young = vm.nurseryBytes > GC_NURSERY_SIZE;
+#endif // DEBUG_STRESS_GC
+    if (full && vm.gcSliceWork > 0)
+    {
+        startCycle();
+        collectSlice(vm.gcSliceWork);
+    }
+    else if (full)
+    {
+        Memory_CollectGarbage();
+    }
+    else if (young)
+    {
+        Memory_CollectYoung();
+    }
+}
+
+void Memory_SetIncremental(int workPerSlice)
+{
+    if (workPerSlice <= 0)
+    {
+        finishCollection();
+        workPerSlice = 0;
+    }
+    vm.gcSliceWork = workPerSlice;
+}
+
+void Memory_PrintStats(FILE *out)
+{
+    GcStats *stats = &vm.gcStats;
+    fprintf(out, "== gc: %d young, %d full, %d incremental in %d slices ==\n",
+            stats->youngCollections, stats->fullCollections, stats->incrementalCollections,
+            stats->slices);
+    fprintf(out, "pauses: %.3f ms total, %.3f ms max\n", (double)stats->totalPauseNs / 1e6,
+            (double)stats->maxPauseNs / 1e6);
+#ifdef POOL_ALLOCATOR
+    fprintf(out, "pool: %d pages of %d KB\n", pool.pageCount, POOL_PAGE_SIZE / 1024);
+#endif // POOL_ALLOCATOR
+}
+
+void Memory_Remember(Obj *object)
+{
+    // while the old marks are cleared they mean nothing, marking starts from scratch after
+    if (!object->isMarked || object->isRemembered || vm.gcPhase == GC_CLEARING)
+        return;
+    object->isRemembered = true;
+    if (vm.rememberedCapacity < vm.rememberedCount + 1)
+    {
+        vm.rememberedCapacity = GROW_CAPACITY(vm.rememberedCapacity);
+        vm.remembered = (Obj **)realloc(vm.remembered, sizeof(Obj *) * vm.rememberedCapacity);
+        if (vm.remembered == NULL)
+            exit(1);
+    }
+    vm.remembered[vm.rememberedCount++] = object;
+}
+
+void Memory_PushRoot(Obj *object)
+{
+    vm.tempRoots[vm.tempRootCount++] = object;
+}
+
+void Memory_PopRoot()
+{
+    vm.tempRootCount--;
+}
+
+void freeObjects()
+{
+    free(vm.grayStack);
+    vm.grayStack = NULL;
+    vm.grayCount = vm.grayCapacity = 0;
+    free(vm.remembered);
+    vm.remembered = NULL;
+    vm.rememberedCount = vm.rememberedCapacity = 0;
+
+    vm.gcPhase = GC_IDLE;
+    Obj *lists[] = {vm.youngObjects, vm.oldObjects, vm.sweepingYoung};
+    for (int i = 0; i < 3; i++)
+    {
+        Obj *object = lists[i];
+        while (object != NULL)
+        {
+            Obj *next = object->next;
+            freeObject(object);
+            object = next;
+        }
+    }
+    vm.youngObjects = vm.oldObjects = vm.sweepingYoung = NULL;
+#ifdef POOL_ALLOCATOR
+    releasePools();
+#endif // POOL_ALLOCATOR
 }
\ No newline at end of file
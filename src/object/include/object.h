@@ -2,49 +2,302 @@
 
 #include "chunk.h"
 #include "common.h"
+#include "memory.h"
+#include "table.h"
 #include "value.h"
 
 #include <stdint.h>
 
 #define OBJ_TYPE(value) (AS_OBJ(value)->type)
 
+#define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
+#define IS_CLASS(value) isObjType(value, OBJ_CLASS)
+#define IS_CLOSURE(value) isObjType(value, OBJ_CLOSURE)
+#define IS_FIBER(value) isObjType(value, OBJ_FIBER)
+#define IS_INSTANCE(value) isObjType(value, OBJ_INSTANCE)
+#define IS_LIST(value) isObjType(value, OBJ_LIST)
 #define IS_STRING(value) isObjType(value, OBJ_STRING)
 #define IS_FUNCTION(value) isObjType(value, OBJ_FUNCTION)
+#define IS_NATIVE(value) isObjType(value, OBJ_NATIVE)
 
+#define AS_BOUND_METHOD(value) ((ObjBoundMethod *)AS_OBJ(value))
+#define AS_CLASS(value) ((ObjClass *)AS_OBJ(value))
+#define AS_CLOSURE(value) ((ObjClosure *)AS_OBJ(value))
+#define AS_FIBER(value) ((ObjFiber *)AS_OBJ(value))
+#define AS_INSTANCE(value) ((ObjInstance *)AS_OBJ(value))
+#define AS_LIST(value) ((ObjList *)AS_OBJ(value))
 #define AS_STRING(value) ((ObjString *)AS_OBJ(value))
 #define AS_CSTRING(value) (((ObjString *)AS_OBJ(value))->chars)
 #define AS_FUNCTION(value) ((ObjFunction *)AS_OBJ(value))
+#define AS_NATIVE(value) ((ObjNative *)AS_OBJ(value))
 
 typedef enum
 {
+    OBJ_BOUND_METHOD,
+    OBJ_CLASS,
+    OBJ_CLOSURE,
+    OBJ_FIBER,
     OBJ_FUNCTION,
+    OBJ_INSTANCE,
+    OBJ_LIST,
+    OBJ_NATIVE,
+    OBJ_SHAPE,
     OBJ_STRING,
+    OBJ_UPVALUE,
 } ObjType;
 
 struct Obj
 {
     ObjType type;
-    struct Obj *next; // an INTRUSIVE list, every obj gets a ptr to next
+    bool isMarked;     // reached by the current mark phase, stays set while the object is old
+    bool isRemembered; // old and in vm.remembered, a young collection looks inside it
+    struct Obj *next;  // an INTRUSIVE list, every obj gets a ptr to next
 };
 
-// We'll give each function its own Chunk and some other metadata
+/**
+ * @brief Call after storing value into object, for any object that may already be old.
+ * A young collection doesn't look inside old objects unless they are remembered, so an
+ * old object made to refer to a young one must be. Likewise an incremental collection
+ * doesn't look inside a black object again unless a store makes it gray. Stores into an
+ * object that is still being built, with nothing allocated in between, don't need it.
+ */
+static inline void writeBarrier(Obj *object, Value value)
+{
+    if (object->isMarked && IS_OBJ(value) && !AS_OBJ(value)->isMarked)
+        Memory_Remember(object);
+}
+
+// where a function finds a variable it captured, relative to the function declaring it
+typedef struct
+{
+    uint8_t index; // slot of the declaring function's local, or index of its own upvalue
+    bool isLocal;  // true for a local of the declaring function
+} UpvalueInfo;
+
+/*
+ * We'll give each function its own Chunk and some other metadata.
+ *
+ * A function that captures variables is normally wrapped in an ObjClosure at runtime. The
+ * compiler skips that when it can prove the function never outlives the frame that
+ * declares it and is only ever called from that frame (capturesCallerFrame): then the
+ * captured variables are still on the stack, in the caller's slots, for every call.
+ */
 typedef struct
 {
     Obj obj;
     int arity; // stores num of params the function expects
+    int upvalueCount;      // number of variables captured from enclosing functions
+    UpvalueInfo *upvalues; // upvalueCount entries, what each captured variable is
+    bool capturesCallerFrame; // captured variable i is upvalues[i].index in the caller's slots
     Chunk chunk;
     ObjString *name;
 } ObjFunction;
 
+/*
+ * A function implemented in C. args points straight at the arguments on the VM's value
+ * stack (nothing is copied or boxed), args[-1] is the native itself. Return the result,
+ * or Vm_NativeError(...) to raise a runtime error. A native must not push or pop.
+ */
+typedef Value (*NativeFn)(int argCount, Value *args);
+
+// arity of a native that takes any number of arguments and checks argCount itself
+#define NATIVE_VARIADIC -1
+
+typedef struct
+{
+    Obj obj;
+    NativeFn function;
+    int arity; // the VM checks it before the call, so fixed arity natives never have to
+    ObjString *name;
+} ObjNative;
+
+/*
+ * A captured variable. While the variable's frame is alive it stays where it is and
+ * location points at its stack slot (open). When the variable goes out of scope the
+ * value is moved into closed and location points there instead.
+ */
+typedef struct ObjUpvalue
+{
+    Obj obj;
+    Value *location;
+    Value closed;
+    struct ObjUpvalue *next; // open upvalues form a list sorted by stack slot, top first
+    struct ObjFiber *fiber;  // while open, the fiber whose stack location points into
+} ObjUpvalue;
+
+// a function value together with the variables it captured
+typedef struct
+{
+    Obj obj;
+    ObjFunction *function;
+    ObjUpvalue **upvalues;
+    int upvalueCount;
+} ObjClosure;
+
+typedef struct ObjClass
+{
+    Obj obj;
+    ObjString *name;
+    Table methods; // name -> function or closure, inherited ones copied in
+} ObjClass;
+
+/*
+ * Hidden class. Instances don't carry a table of their fields: an instance's shape says
+ * which field is at which index of its dense fields array. Shapes form a tree rooted at
+ * vm.emptyShape, each one adding a single field to its parent, so instances that got the
+ * same fields in the same order share one shape. Property access sites cache the index
+ * per shape, see PropertyCache.
+ */
+typedef struct ObjShape
+{
+    Obj obj;
+    struct ObjShape *parent; // NULL for the empty shape
+    ObjString *name;         // field this shape adds to its parent
+    int fieldCount;          // fields of an instance with this shape, the new one is the last
+    Table transitions;       // field name -> OBJ_VAL(shape with that field added)
+} ObjShape;
+
+typedef struct
+{
+    Obj obj;
+    ObjClass *klass;
+    ObjShape *shape;
+    Value *fields;     // shape->fieldCount of them in use
+    int fieldCapacity;
+} ObjInstance;
+
+/**
+ * A function call in progress. The callee's locals are not copied anywhere: slots is a
+ * window onto the running fiber's value stack starting at the callee itself, with the
+ * arguments the caller pushed right above it as the first locals.
+ */
+typedef struct
+{
+    ObjFunction *function;
+    ObjClosure *closure; // where function's captured variables are, NULL if it has none on the heap
+    uint8_t *ip;  // next byte to execute in function's chunk, saved here while it calls out
+    Value *slots; // slot 0 of this call's stack window
+} CallFrame;
+
+typedef enum
+{
+    FIBER_NEW,       // never resumed, function hasn't been called yet
+    FIBER_SUSPENDED, // yielded, waiting for the next resume
+    FIBER_ACTIVE,    // running, or waiting for a fiber it resumed
+    FIBER_DONE,      // function returned, its stack is gone
+} FiberState;
+
+/*
+ * A coroutine with a value stack and call frames of its own. Only the running fiber's
+ * stack and frames are in the VM (vm.stack, vm.frames, ...), a fiber that isn't running
+ * keeps them here. Switching fibers stores one set of these pointers and loads another,
+ * no values are copied and no OS thread is involved. The fields below are stale while
+ * the fiber runs.
+ */
+typedef struct ObjFiber
+{
+    Obj obj;
+    Value function; // called with the first resume's value, if it takes an argument
+    FiberState state;
+    struct ObjFiber *resumer; // gets control back when this one yields or returns
+    Value *stack;             // laid out like vm.stack, guard slot included
+    int stackCapacity;
+    Value *stackTop;
+    CallFrame *frames;
+    int frameCount;
+    int frameCapacity;
+    ObjUpvalue *openUpvalues;
+} ObjFiber;
+
+/*
+ * A growable array. As long as every item is a number the items are stored as plain
+ * doubles, packed together with no tags in between, so numeric code walks memory that is
+ * all payload and natives can loop over a double * the C compiler can vectorize. The
+ * first non-number stored converts the whole list to Values, it never goes back.
+ */
+typedef struct
+{
+    Obj obj;
+    bool isNumeric; // items are in as.numbers, otherwise in as.values
+    int count;
+    int capacity;
+    union
+    {
+        double *numbers;
+        Value *values;
+    } as;
+} ObjList;
+
+// a method read off an instance, calling it calls the method with the instance as 'this'
+typedef struct
+{
+    Obj obj;
+    Value receiver;
+    Value method; // function or closure
+} ObjBoundMethod;
+
+/*
+ * The characters are stored right after the header, in the same block, so a string is one
+ * allocation and reading it touches one place in memory.
+ */
 struct ObjString
 {
     Obj obj;       // ObjString is ALSO an Obj, first field will thus be an Obj
     int length;    // Length of string
-    char *chars;   // ptr to heap allocated aray
     uint32_t hash; // store hash code for every string, used to look up a vars value
+    char chars[];  // length characters and a null terminator
 };
 
+// bytes taken by a string of length characters
+#define STRING_SIZE(length) (sizeof(ObjString) + (size_t)(length) + 1)
+
 ObjFunction *newFunction();
+ObjClosure *newClosure(ObjFunction *function);
+ObjFiber *newFiber(Value function);
+ObjUpvalue *newUpvalue(Value *slot);
+ObjNative *newNative(NativeFn function, int arity, ObjString *name);
+ObjClass *newClass(ObjString *name);
+ObjInstance *newInstance(ObjClass *klass);
+ObjBoundMethod *newBoundMethod(Value receiver, Value method);
+
+/**
+ * @brief A list holding the count values at items, numeric if they are all numbers.
+ */
+ObjList *newList(Value *items, int count);
+ObjShape *newShape(ObjShape *parent, ObjString *name);
+
+/**
+ * @brief Shape an instance with shape gets when field is added to it, created the first
+ * time that transition is taken.
+ */
+ObjShape *shapeAddField(ObjShape *shape, ObjString *name);
+
+/**
+ * @brief Index of field in the fields of an instance with shape.
+ *
+ * @return int - -1 if the shape doesn't have the field
+ */
+int shapeFieldIndex(ObjShape *shape, ObjString *name);
+
+/**
+ * @brief Move instance to newShape, a child of its shape, and store the new field's value.
+ */
+void instanceAddField(ObjInstance *instance, ObjShape *newShape, Value value);
+
+// item index of list, which must be in range
+static inline Value listGet(ObjList *list, int index)
+{
+    return list->isNumeric ? NUMBER_VAL(list->as.numbers[index]) : list->as.values[index];
+}
+
+/**
+ * @brief Replace the item at index, which must be in range. A non-number turns a numeric
+ * list into one of Values first.
+ */
+void listSet(ObjList *list, int index, Value value);
+
+// add value after the last item
+void listAppend(ObjList *list, Value value);
 
 /**
  * REEAAAALLLLLYYYYYY DOOOOO NOOOOOOTTTTTT LLLLLLIIIKKKKKKEEEEEE TTTTTTHHHHHHHHIIIIIIIISSSSSS
@@ -54,6 +307,26 @@ static inline bool isObjType(Value value, ObjType type)
     return IS_OBJ(value) && AS_OBJ(value)->type == type;
 }
 
-ObjString *takeString(char *chars, int length);
+/**
+ * @brief A new string with room for length characters, for C code that builds one in
+ * place: fill in chars (the terminator too) and hand it to internString before allocating
+ * anything else, nothing keeps it alive until then.
+ */
+ObjString *allocateString(int length);
+
+/**
+ * @brief Hash a string from allocateString and intern it. If an equal string is interned
+ * already that one is returned instead, the new one is garbage.
+ */
+ObjString *internString(ObjString *string);
+
+// the interned string with these characters, only allocated if there is none yet
 ObjString *copyString(const char *chars, int length);
+
+/**
+ * @brief The interned string with a's characters followed by b's. Both are hashed and
+ * looked up where they are, only a result that is not interned yet is allocated. a and b
+ * must be reachable, the allocation may collect.
+ */
+ObjString *concatenateStrings(ObjString *a, ObjString *b);
 void printObject(Value value);
\ No newline at end of file
@@ -14,8 +14,14 @@ static Obj *allocateObject(size_t size, ObjType type)
 {
     Obj *object = (Obj *)Memory_Reallocate(NULL, 0, size);
     object->type = type;
-    object->next = vm.objects;
-    vm.objects = object;
+    object->isMarked = false;
+    object->isRemembered = false;
+    // every object starts out young, see Memory_CollectYoung
+    object->next = vm.youngObjects;
+    vm.youngObjects = object;
+    // gray while an incremental collection marks, it is blackened once it is filled in
+    if (vm.gcPhase == GC_MARKING)
+        Memory_MarkObject(object);
     return object;
 }
 
@@ -24,25 +30,236 @@ ObjFunction *newFunction()
     // allocate mem and initialize obj header so VM knows what type of obj it is
     ObjFunction *function = ALLOCATE_OBJ(ObjFunction, OBJ_FUNCTION);
     function->arity = 0;
+    function->upvalueCount = 0;
+    function->upvalues = NULL;
+    function->capturesCallerFrame = false;
     function->name = NULL;
     Chunk_InitChunk(&function->chunk);
     return function;
 }
 
-static ObjString *allocateString(char *chars, int length, uint32_t hash)
+ObjClosure *newClosure(ObjFunction *function)
 {
-    ObjString *string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+    // the upvalues are filled in by OP_CLOSURE right after
+    ObjUpvalue **upvalues = ALLOCATE(ObjUpvalue *, function->upvalueCount);
+    for (int i = 0; i < function->upvalueCount; i++)
+        upvalues[i] = NULL;
+
+    ObjClosure *closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
+    closure->function = function;
+    closure->upvalues = upvalues;
+    closure->upvalueCount = function->upvalueCount;
+    return closure;
+}
+
+ObjFiber *newFiber(Value function)
+{
+    // no stack or frames yet, they are allocated when the fiber is first resumed
+    ObjFiber *fiber = ALLOCATE_OBJ(ObjFiber, OBJ_FIBER);
+    fiber->function = function;
+    fiber->state = FIBER_NEW;
+    fiber->resumer = NULL;
+    fiber->stack = NULL;
+    fiber->stackCapacity = 0;
+    fiber->stackTop = NULL;
+    fiber->frames = NULL;
+    fiber->frameCount = 0;
+    fiber->frameCapacity = 0;
+    fiber->openUpvalues = NULL;
+    return fiber;
+}
+
+ObjUpvalue *newUpvalue(Value *slot)
+{
+    ObjUpvalue *upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
+    upvalue->location = slot;
+    upvalue->closed = NIL_VAL;
+    upvalue->next = NULL;
+    upvalue->fiber = NULL;
+    return upvalue;
+}
+
+ObjClass *newClass(ObjString *name)
+{
+    ObjClass *klass = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
+    klass->name = name;
+    initTable(&klass->methods);
+    return klass;
+}
+
+ObjInstance *newInstance(ObjClass *klass)
+{
+    ObjInstance *instance = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
+    instance->klass = klass;
+    instance->shape = vm.emptyShape;
+    instance->fields = NULL;
+    instance->fieldCapacity = 0;
+    return instance;
+}
+
+ObjBoundMethod *newBoundMethod(Value receiver, Value method)
+{
+    ObjBoundMethod *bound = ALLOCATE_OBJ(ObjBoundMethod, OBJ_BOUND_METHOD);
+    bound->receiver = receiver;
+    bound->method = method;
+    return bound;
+}
+
+ObjList *newList(Value *items, int count)
+{
+    bool isNumeric = true;
+    for (int i = 0; i < count && isNumeric; i++)
+        isNumeric = IS_NUMBER(items[i]);
+
+    // storage first: a collection triggered by it couldn't find a list allocated before it
+    double *numbers = NULL;
+    Value *values = NULL;
+    if (isNumeric)
+    {
+        numbers = ALLOCATE(double, count);
+        for (int i = 0; i < count; i++)
+            numbers[i] = AS_NUMBER(items[i]);
+    }
+    else
+    {
+        values = ALLOCATE(Value, count);
+        for (int i = 0; i < count; i++)
+            values[i] = items[i];
+    }
+
+    ObjList *list = ALLOCATE_OBJ(ObjList, OBJ_LIST);
+    list->isNumeric = isNumeric;
+    list->count = count;
+    list->capacity = count;
+    if (isNumeric)
+        list->as.numbers = numbers;
+    else
+        list->as.values = values;
+    return list;
+}
+
+// box the doubles of a numeric list, from now on it holds Values
+static void listMakeGeneric(ObjList *list)
+{
+    Value *values = ALLOCATE(Value, list->capacity);
+    for (int i = 0; i < list->count; i++)
+        values[i] = NUMBER_VAL(list->as.numbers[i]);
+    FREE_ARRAY(double, list->as.numbers, list->capacity);
+    list->as.values = values;
+    list->isNumeric = false;
+}
+
+void listSet(ObjList *list, int index, Value value)
+{
+    if (list->isNumeric)
+    {
+        if (IS_NUMBER(value))
+        {
+            list->as.numbers[index] = AS_NUMBER(value);
+            return;
+        }
+        listMakeGeneric(list);
+    }
+    list->as.values[index] = value;
+    writeBarrier((Obj *)list, value);
+}
+
+void listAppend(ObjList *list, Value value)
+{
+    if (list->count == list->capacity)
+    {
+        int oldCapacity = list->capacity;
+        list->capacity = GROW_CAPACITY(oldCapacity);
+        if (list->isNumeric)
+            list->as.numbers = GROW_ARRAY(double, list->as.numbers, oldCapacity, list->capacity);
+        else
+            list->as.values = GROW_ARRAY(Value, list->as.values, oldCapacity, list->capacity);
+    }
+    list->count++;
+    listSet(list, list->count - 1, value);
+}
+
+ObjShape *newShape(ObjShape *parent, ObjString *name)
+{
+    ObjShape *shape = ALLOCATE_OBJ(ObjShape, OBJ_SHAPE);
+    shape->parent = parent;
+    shape->name = name;
+    shape->fieldCount = parent == NULL ? 0 : parent->fieldCount + 1;
+    initTable(&shape->transitions);
+    return shape;
+}
+
+ObjShape *shapeAddField(ObjShape *shape, ObjString *name)
+{
+    Value next;
+    if (tableGet(&shape->transitions, name, &next))
+        return (ObjShape *)AS_OBJ(next);
+    ObjShape *child = newShape(shape, name);
+    // nothing refers to child until it is in the table, which may have to grow first
+    Memory_PushRoot((Obj *)child);
+    tableSet(&shape->transitions, name, OBJ_VAL(child));
+    writeBarrier((Obj *)shape, OBJ_VAL(child));
+    Memory_PopRoot();
+    return child;
+}
+
+int shapeFieldIndex(ObjShape *shape, ObjString *name)
+{
+    // only taken when an access site's cache misses, so a walk up the tree is fine
+    for (; shape->parent != NULL; shape = shape->parent)
+    {
+        if (shape->name == name)
+            return shape->fieldCount - 1;
+    }
+    return -1;
+}
+
+void instanceAddField(ObjInstance *instance, ObjShape *newShape, Value value)
+{
+    if (newShape->fieldCount > instance->fieldCapacity)
+    {
+        int oldCapacity = instance->fieldCapacity;
+        instance->fieldCapacity = GROW_CAPACITY(oldCapacity);
+        instance->fields = GROW_ARRAY(Value, instance->fields, oldCapacity, instance->fieldCapacity);
+    }
+    instance->shape = newShape;
+    instance->fields[newShape->fieldCount - 1] = value;
+    // the new shape needs none, every shape stays reachable through the tree from vm.emptyShape
+    writeBarrier((Obj *)instance, value);
+}
+
+ObjNative *newNative(NativeFn function, int arity, ObjString *name)
+{
+    ObjNative *native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
+    native->function = function;
+    native->arity = arity;
+    native->name = name;
+    return native;
+}
+
+ObjString *allocateString(int length)
+{
+    ObjString *string = (ObjString *)allocateObject(STRING_SIZE(length), OBJ_STRING);
     string->length = length;
-    string->chars = chars;
+    string->hash = 0;
+    return string;
+}
+
+static ObjString *addString(ObjString *string, uint32_t hash)
+{
     string->hash = hash;
+    // vm.strings doesn't keep its strings alive, see Memory_CollectGarbage
+    Memory_PushRoot((Obj *)string);
     tableSet(&vm.strings, string, NIL_VAL);
+    Memory_PopRoot();
     return string;
 }
 
-// This is FNV-1a
-static uint32_t hashString(const char *key, int length)
+#define FNV_OFFSET_BASIS 2166136261u
+
+// This is FNV-1a, it goes on from hash so a string can be hashed a piece at a time
+static uint32_t hashString(uint32_t hash, const char *key, int length)
 {
-    uint32_t hash = 2166136261u;
     for (int i = 0; i < length; i++)
     {
         hash ^= (uint8_t)key[i];
@@ -51,28 +268,48 @@ static uint32_t hashString(const char *key, int length)
     return hash;
 }
 
-ObjString *takeString(char *chars, int length)
+ObjString *internString(ObjString *string)
 {
-    uint32_t hash = hashString(chars, length);
-    ObjString *interned = tableFindString(&vm.strings, chars, length, hash); // look for string
-    if (interned != NULL)                                                    // if we find it
+    uint32_t hash = hashString(FNV_OFFSET_BASIS, string->chars, string->length);
+    ObjString *interned = tableFindString(&vm.strings, string->chars, string->length, hash); // look for string
+    if (interned == NULL)
+        return addString(string, hash);
+
+    // nothing was allocated since, so the new one is still first in line and can go right
+    // away, unless marking already made it gray
+    if (vm.gcPhase != GC_MARKING && vm.youngObjects == (Obj *)string)
     {
-        FREE_ARRAY(char, chars, length + 1); // free memory for the string that was passed int
-        return interned;                     // and return the FOUND string
+        vm.youngObjects = string->obj.next;
+        Memory_Reallocate(string, STRING_SIZE(string->length), 0);
     }
-    return allocateString(chars, length, hash);
+    return interned; // and return the FOUND string
+}
+
+ObjString *concatenateStrings(ObjString *a, ObjString *b)
+{
+    uint32_t hash = hashString(hashString(FNV_OFFSET_BASIS, a->chars, a->length), b->chars, b->length);
+    ObjString *interned = tableFindJoined(&vm.strings, a->chars, a->length, b->chars, b->length, hash);
+    if (interned != NULL)
+        return interned;
+
+    int length = a->length + b->length;                     // calculate length of the two strings to be concatenated
+    ObjString *result = allocateString(length);             // the new string, built in place
+    memcpy(result->chars, a->chars, a->length);             // copy chars from first string into it
+    memcpy(result->chars + a->length, b->chars, b->length); // same process for second string
+    result->chars[length] = '\0';                           // NULL TERMINATE YOUR STRINGS
+    return addString(result, hash);
 }
 
 ObjString *copyString(const char *chars, int length)
 {
-    uint32_t hash = hashString(chars, length);
+    uint32_t hash = hashString(FNV_OFFSET_BASIS, chars, length);
     ObjString *interned = tableFindString(&vm.strings, chars, length, hash);
     if (interned != NULL)
         return interned;
-    char *heapChars = ALLOCATE(char, length + 1); // allocate new arr on heap big enough for string and null terminator
-    memcpy(heapChars, chars, length);             // copy chars
-    heapChars[length] = '\0';                     // copy chars
-    return allocateString(heapChars, length, hash);
+    ObjString *string = allocateString(length); // header and characters in one block
+    memcpy(string->chars, chars, length);       // copy chars
+    string->chars[length] = '\0';
+    return addString(string, hash);
 }
 
 /**
@@ -82,6 +319,12 @@ ObjString *copyString(const char *chars, int length)
  */
 static void printFunction(ObjFunction *function)
 {
+    // the top level code is a function too, but it has no name
+    if (function->name == NULL)
+    {
+        printf("<script>");
+        return;
+    }
     printf("<function: %s>", function->name->chars);
 }
 
@@ -94,12 +337,52 @@ void printObject(Value value)
 {
     switch (OBJ_TYPE(value))
     {
+    case OBJ_BOUND_METHOD:
+    {
+        Value method = AS_BOUND_METHOD(value)->method;
+        printFunction(IS_CLOSURE(method) ? AS_CLOSURE(method)->function : AS_FUNCTION(method));
+        break;
+    }
+    case OBJ_CLASS:
+        printf("%s", AS_CLASS(value)->name->chars);
+        break;
+    case OBJ_INSTANCE:
+        printf("%s instance", AS_INSTANCE(value)->klass->name->chars);
+        break;
+    case OBJ_LIST:
+    {
+        ObjList *list = AS_LIST(value);
+        printf("[");
+        for (int i = 0; i < list->count; i++)
+        {
+            if (i > 0)
+                printf(", ");
+            Value_printValue(listGet(list, i), 31);
+        }
+        printf("]");
+        break;
+    }
+    case OBJ_SHAPE: // never a value a script can see
+        printf("shape");
+        break;
+    case OBJ_CLOSURE:
+        printFunction(AS_CLOSURE(value)->function);
+        break;
+    case OBJ_FIBER:
+        printf("<fiber>");
+        break;
     // functions are first-class objects
     case OBJ_FUNCTION:
         printFunction(AS_FUNCTION(value));
         break;
+    case OBJ_NATIVE:
+        printf("<native function: %s>", AS_NATIVE(value)->name->chars);
+        break;
     case OBJ_STRING:
         printf("%s", AS_CSTRING(value));
         break;
+    case OBJ_UPVALUE: // never a value a script can see
+        printf("upvalue");
+        break;
     }
 }
\ No newline at end of file
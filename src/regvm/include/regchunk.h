@@ -0,0 +1,109 @@
+#pragma once
+
+#include "common.h"
+#include "value.h"
+
+/**
+ *  Register backend bytecode. Every instruction is one 32 bit word, split the same way
+ *  Lua 5.1 does it:
+ *
+ *      | B (9 bits) | C (9 bits) | A (8 bits) | opcode (6 bits) |
+ *      |        Bx (18 bits)     | A (8 bits) | opcode (6 bits) |
+ *
+ *  A always names a register. B and C are "RK" operands: below REG_CONSTANT_BIT they name
+ *  a register, at or above it they name a constant. That lets an instruction like
+ *  ROP_ADD read a local and a constant in place, nothing gets copied to a stack first.
+ *  Bx is an unsigned index (constant or global slot), sBx the same bits read as a signed
+ *  jump offset relative to the next instruction.
+ *
+ *  Registers are frame slots: locals live in registers 0..n-1 in declaration order and
+ *  temporaries are allocated above them.
+ */
+#define REG_OPCODE_LIST(X)                                                             \
+    X(ROP_MOVE)          /* R[A] = R[B] */                                             \
+    X(ROP_LOADK)         /* R[A] = K[Bx] */                                            \
+    X(ROP_GET_GLOBAL)    /* R[A] = globals[Bx] */                                      \
+    X(ROP_DEFINE_GLOBAL) /* globals[Bx] = R[A] */                                      \
+    X(ROP_SET_GLOBAL)    /* globals[Bx] = R[A], error if not defined yet */            \
+    X(ROP_ADD)           /* R[A] = RK[B] + RK[C] */                                    \
+    X(ROP_SUBTRACT)      /* R[A] = RK[B] - RK[C] */                                    \
+    X(ROP_MULTIPLY)      /* R[A] = RK[B] * RK[C] */                                    \
+    X(ROP_DIVIDE)        /* R[A] = RK[B] / RK[C] */                                    \
+    X(ROP_EQUAL)         /* R[A] = RK[B] == RK[C] */                                   \
+    X(ROP_NOT_EQUAL)     /* R[A] = RK[B] != RK[C] */                                   \
+    X(ROP_GREATER)       /* R[A] = RK[B] > RK[C] */                                    \
+    X(ROP_GREATER_EQUAL) /* R[A] = !(RK[B] < RK[C]) */                                 \
+    X(ROP_LESS)          /* R[A] = RK[B] < RK[C] */                                    \
+    X(ROP_LESS_EQUAL)    /* R[A] = !(RK[B] > RK[C]) */                                 \
+    X(ROP_NOT)           /* R[A] = !RK[B] */                                           \
+    X(ROP_NEGATE)        /* R[A] = -RK[B] */                                           \
+    X(ROP_PRINT)         /* print RK[B] */                                             \
+    X(ROP_JUMP)          /* ip += sBx */                                               \
+    X(ROP_JUMP_IF_FALSE) /* if R[A] is falsey, ip += sBx */                            \
+    X(ROP_JUMP_IF_TRUE)  /* if R[A] is truthy, ip += sBx */                            \
+    X(ROP_RETURN)
+
+typedef enum
+{
+#define REG_OPCODE_ENUM(name) name,
+    REG_OPCODE_LIST(REG_OPCODE_ENUM)
+#undef REG_OPCODE_ENUM
+    ROP_COUNT // number of opcodes, NOT an instruction
+} RegOpCode;
+
+#define REG_MAX_OPCODES 64            // 6 opcode bits
+#define REG_MAX_REGISTERS 256         // A is 8 bits
+#define REG_MAX_BX 0x3ffff            // 18 bits
+#define REG_MAX_SBX (REG_MAX_BX >> 1) // sBx is stored as Bx + REG_MAX_SBX
+#define REG_CONSTANT_BIT 0x100        // RK operand >= this is a constant index
+#define REG_MAX_RK_CONSTANT 0xff      // constants past this need a ROP_LOADK first
+
+#define REG_GET_OP(instruction) ((instruction) & 0x3f)
+#define REG_GET_A(instruction) (((instruction) >> 6) & 0xff)
+#define REG_GET_C(instruction) (((instruction) >> 14) & 0x1ff)
+#define REG_GET_B(instruction) ((instruction) >> 23)
+#define REG_GET_BX(instruction) ((instruction) >> 14)
+#define REG_GET_SBX(instruction) ((int)REG_GET_BX(instruction) - REG_MAX_SBX)
+
+#define REG_ENCODE_ABC(op, a, b, c) \
+    ((uint32_t)(op) | ((uint32_t)(a) << 6) | ((uint32_t)(c) << 14) | ((uint32_t)(b) << 23))
+#define REG_ENCODE_ABX(op, a, bx) \
+    ((uint32_t)(op) | ((uint32_t)(a) << 6) | ((uint32_t)(bx) << 14))
+#define REG_ENCODE_ASBX(op, a, sbx) REG_ENCODE_ABX(op, a, (sbx) + REG_MAX_SBX)
+
+#define REG_IS_CONSTANT(rk) ((rk) & REG_CONSTANT_BIT)
+#define REG_CONSTANT_INDEX(rk) ((rk) & ~REG_CONSTANT_BIT)
+
+typedef struct
+{
+    int count;            // num of instructions in use
+    int capacity;         // num of instructions we are able to accomodate
+    uint32_t *code;       // one word per instruction
+    int *lines;           // line number of each instruction
+    ValueArray constants; // constant pool
+    int maxRegisters;     // registers the code needs, reserved on the VM stack before it runs
+} RegChunk;
+
+void RegChunk_InitChunk(RegChunk *chunk);
+void RegChunk_FreeChunk(RegChunk *chunk);
+
+/**
+ * @brief Append one instruction to the chunk.
+ *
+ * @param chunk - chunk to write to
+ * @param instruction - encoded instruction, see REG_ENCODE_*
+ * @param line - source line it came from
+ */
+void RegChunk_WriteChunk(RegChunk *chunk, uint32_t instruction, int line);
+
+/**
+ * @brief Add value to the chunk's constant pool.
+ *
+ * @return int - index of the new constant
+ */
+int RegChunk_AddConstant(RegChunk *chunk, Value value);
+
+/**
+ * @brief Print every instruction of the chunk, the register backend's disassembleChunk.
+ */
+void RegChunk_Disassemble(RegChunk *chunk, const char *name);
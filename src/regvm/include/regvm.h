@@ -0,0 +1,36 @@
+#pragma once
+
+#include "regchunk.h"
+#include "vm.h"
+
+/*
+ * Register based backend, an alternative to the stack machine in vm.c selected at
+ * startup (urbanC --backend=register). It has its own compiler and run loop but shares
+ * the rest of the VM: globals, interned strings, the object list and the value stack,
+ * which doubles as its register file.
+ *
+ * It covers the statement/expression language the stack backend compiles to a single
+ * chunk; anything beyond that is a compile error here.
+ */
+
+/**
+ * @brief Compile source into register bytecode.
+ *
+ * @param source - user code
+ * @param chunk - chunk to fill, must be initialized
+ * @return false if there was a compile error
+ */
+bool RegCompiler_Compile(const char *source, RegChunk *chunk);
+
+/**
+ * @brief Register backend counterpart of Vm_Interpret: compile source and run it.
+ *
+ * @param source - user code
+ * @return InterpretResult
+ */
+InterpretResult RegVm_Interpret(const char *source);
+
+/**
+ * @brief Mark the constants of the chunk being compiled or run, for the garbage collector.
+ */
+void RegVm_MarkRoots();
@@ -0,0 +1,116 @@
+#include "regchunk.h"
+
+#include "memory.h"
+#include "value.h"
+
+#include <stdio.h>
+
+_Static_assert(ROP_COUNT <= REG_MAX_OPCODES, "register opcodes must fit in 6 bits");
+
+void RegChunk_InitChunk(RegChunk *chunk)
+{
+    chunk->count = 0;
+    chunk->capacity = 0;
+    chunk->code = NULL;
+    chunk->lines = NULL;
+    chunk->maxRegisters = 0;
+    Value_initValueArray(&chunk->constants);
+}
+
+void RegChunk_FreeChunk(RegChunk *chunk)
+{
+    FREE_ARRAY(uint32_t, chunk->code, chunk->capacity);
+    FREE_ARRAY(int, chunk->lines, chunk->capacity);
+    freeValueArray(&chunk->constants);
+    RegChunk_InitChunk(chunk);
+}
+
+void RegChunk_WriteChunk(RegChunk *chunk, uint32_t instruction, int line)
+{
+    if (chunk->capacity < chunk->count + 1)
+    {
+        int oldCapacity = chunk->capacity;
+        chunk->capacity = GROW_CAPACITY(oldCapacity);
+        chunk->code = GROW_ARRAY(uint32_t, chunk->code, oldCapacity, chunk->capacity);
+        chunk->lines = GROW_ARRAY(int, chunk->lines, oldCapacity, chunk->capacity);
+    }
+    chunk->code[chunk->count] = instruction;
+    chunk->lines[chunk->count] = line;
+    chunk->count++;
+}
+
+int RegChunk_AddConstant(RegChunk *chunk, Value value)
+{
+    writeValueArray(&chunk->constants, value);
+    return chunk->constants.count - 1;
+}
+
+static const char *opcodeName(uint8_t opcode)
+{
+#define REG_OPCODE_NAME(name) #name,
+    static const char *names[] = {REG_OPCODE_LIST(REG_OPCODE_NAME)};
+#undef REG_OPCODE_NAME
+    if (opcode >= ROP_COUNT)
+        return "ROP_UNKNOWN";
+    return names[opcode];
+}
+
+// RK operands print as r<n> for registers and k<n> for constants
+static void printRK(RegChunk *chunk, int rk)
+{
+    if (!REG_IS_CONSTANT(rk))
+    {
+        printf(" r%d", rk);
+        return;
+    }
+    printf(" k%d '", REG_CONSTANT_INDEX(rk));
+    Value_printValue(chunk->constants.values[REG_CONSTANT_INDEX(rk)], 32);
+    printf("'");
+}
+
+void RegChunk_Disassemble(RegChunk *chunk, const char *name)
+{
+    printf("== %s ==\n", name);
+    for (int offset = 0; offset < chunk->count; offset++)
+    {
+        uint32_t instruction = chunk->code[offset];
+        uint8_t op = REG_GET_OP(instruction);
+        printf("%04d %4d %-20s", offset, chunk->lines[offset], opcodeName(op));
+        switch (op)
+        {
+        case ROP_MOVE:
+            printf(" r%d r%d", REG_GET_A(instruction), REG_GET_B(instruction));
+            break;
+        case ROP_LOADK:
+            printRK(chunk, REG_GET_BX(instruction) | REG_CONSTANT_BIT);
+            printf(" -> r%d", REG_GET_A(instruction));
+            break;
+        case ROP_GET_GLOBAL:
+        case ROP_DEFINE_GLOBAL:
+        case ROP_SET_GLOBAL:
+            printf(" r%d g%d", REG_GET_A(instruction), REG_GET_BX(instruction));
+            break;
+        case ROP_NOT:
+        case ROP_NEGATE:
+            printf(" r%d", REG_GET_A(instruction));
+            printRK(chunk, REG_GET_B(instruction));
+            break;
+        case ROP_PRINT:
+            printRK(chunk, REG_GET_B(instruction));
+            break;
+        case ROP_JUMP:
+        case ROP_JUMP_IF_FALSE:
+        case ROP_JUMP_IF_TRUE:
+            printf(" r%d -> %d", REG_GET_A(instruction), offset + 1 + REG_GET_SBX(instruction));
+            break;
+        case ROP_RETURN:
+            break;
+        default: // the three address arithmetic and comparison ops
+            printf(" r%d", REG_GET_A(instruction));
+            printRK(chunk, REG_GET_B(instruction));
+            printRK(chunk, REG_GET_C(instruction));
+            break;
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,932 @@
+#include "regvm.h"
+
+#include "common.h"
+#include "memory.h"
+#include "object.h"
+#include "regchunk.h"
+#include "scanner.h"
+#include "value.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Single pass compiler for the register backend. Same grammar and the same Pratt
+ * parser shape as compiler.c, but every expression hands back an Operand describing
+ * WHERE its value is instead of pushing it. The consumer decides whether it can read
+ * it in place (a local's register, a constant) or needs it in a particular register.
+ */
+
+typedef struct
+{
+    Token current;
+    Token previous;
+    bool hadError;
+    bool panicMode;
+} Parser;
+
+typedef enum
+{
+    PREC_NONE,
+    PREC_ASSIGNMENT, // =
+    PREC_OR,         // or
+    PREC_AND,        // and
+    PREC_EQUALITY,   // == !=
+    PREC_COMPARISON, // < > <= >=
+    PREC_TERM,       // + -
+    PREC_FACTOR,     // * /
+    PREC_UNARY,      // ! -
+    PREC_CALL,       // . ()
+    PREC_PRIMARY
+} Precedence;
+
+typedef enum
+{
+    OPERAND_CONSTANT, // index is a constant pool index
+    OPERAND_LOCAL,    // index is the register of a local, must not be written to
+    OPERAND_TEMP,     // index is a temporary register this expression owns
+} OperandKind;
+
+typedef struct
+{
+    OperandKind kind;
+    int index;
+    // for OPERAND_TEMP: the instruction that wrote the temp, if it is the last one emitted
+    // its A can be retargeted to write somewhere else directly. -1 when that's not safe
+    int pc;
+} Operand;
+
+typedef Operand (*PrefixFn)(bool canAssign);
+typedef Operand (*InfixFn)(Operand left, bool canAssign);
+
+typedef struct
+{
+    PrefixFn prefix;
+    InfixFn infix;
+    Precedence precedence;
+} ParseRule;
+
+typedef struct
+{
+    Token name; // name of the variable
+    int depth;  // scope depth of the block where the local was declared, -1 until initialized
+} Local;
+
+typedef struct
+{
+    Local locals[UINT8_COUNT]; // local i lives in register i
+    int localCount;
+    int scopeDepth;
+    int freeRegister;             // first register that holds neither a local nor a live temp
+    int localStores[UINT8_COUNT]; // bumped every time a local is assigned, see binary()
+} RegCompiler;
+
+static Parser parser;
+static RegCompiler *current = NULL;
+static RegChunk *compilingChunk;
+
+static RegChunk *currentChunk()
+{
+    return compilingChunk;
+}
+
+static void errorAt(Token *token, const char *message)
+{
+    if (parser.panicMode)
+        return;
+    parser.panicMode = true;
+
+    fprintf(stderr, "[line %d] Error", token->line);
+    if (token->type == TOKEN_EOF)
+    {
+        fprintf(stderr, " at end");
+    }
+    else if (token->type != TOKEN_ERROR)
+    {
+        fprintf(stderr, " at '%.*s'", token->length, token->start);
+    }
+    fprintf(stderr, ": %s\n", message);
+    parser.hadError = true;
+}
+
+static void error(const char *message)
+{
+    errorAt(&parser.previous, message);
+}
+
+static void errorAtCurrent(const char *message)
+{
+    errorAt(&parser.current, message);
+}
+
+static void advance()
+{
+    parser.previous = parser.current;
+    for (;;)
+    {
+        parser.current = Scanner_ScanToken();
+        if (parser.current.type != TOKEN_ERROR)
+            break;
+        errorAtCurrent(parser.current.start);
+    }
+}
+
+static void consume(TokenType type, const char *message)
+{
+    if (parser.current.type == type)
+    {
+        advance();
+        return;
+    }
+    errorAtCurrent(message);
+}
+
+static bool check(TokenType type)
+{
+    return parser.current.type == type;
+}
+
+static bool match(TokenType type)
+{
+    if (!check(type))
+        return false;
+    advance();
+    return true;
+}
+
+/**
+ * @brief Emit one instruction
+ *
+ * @return int - its index in the chunk
+ */
+static int emit(uint32_t instruction)
+{
+    RegChunk_WriteChunk(currentChunk(), instruction, parser.previous.line);
+    return currentChunk()->count - 1;
+}
+
+static int emitABC(uint8_t op, int a, int b, int c)
+{
+    return emit(REG_ENCODE_ABC(op, a, b, c));
+}
+
+static int emitABx(uint8_t op, int a, int bx)
+{
+    return emit(REG_ENCODE_ABX(op, a, bx));
+}
+
+static int makeConstant(Value value)
+{
+    // reuse an identical constant if it is one of the ones RK operands can reach, so a
+    // long script doesn't push its common literals out of RK range. Strings are interned
+    // so this catches those as well
+    ValueArray *constants = &currentChunk()->constants;
+    for (int i = 0; i < constants->count && i <= REG_MAX_RK_CONSTANT; i++)
+    {
+        if (Value_valueEquals(constants->values[i], value))
+            return i;
+    }
+
+    if (IS_OBJ(value))
+        Memory_PushRoot(AS_OBJ(value));
+    int constant = RegChunk_AddConstant(currentChunk(), value);
+    if (IS_OBJ(value))
+        Memory_PopRoot();
+    if (constant > REG_MAX_BX)
+    {
+        error("Too many constants in one chunk.");
+        return 0;
+    }
+    return constant;
+}
+
+static int globalSlot(Token *name)
+{
+    int slot = Vm_GlobalSlot(copyString(name->start, name->length));
+    if (slot > REG_MAX_BX)
+    {
+        error("Too many global variables.");
+        return 0;
+    }
+    return slot;
+}
+
+/**
+ * @brief Temporaries are handed out and given back in stack order, the newest one is
+ * always the one at freeRegister - 1.
+ *
+ * @return int - the new temporary register
+ */
+static int reserveRegister()
+{
+    if (current->freeRegister >= REG_MAX_REGISTERS)
+    {
+        error("Expression needs too many registers.");
+        return 0;
+    }
+    int reg = current->freeRegister++;
+    if (current->freeRegister > currentChunk()->maxRegisters)
+        currentChunk()->maxRegisters = current->freeRegister;
+    return reg;
+}
+
+static void freeOperand(Operand *operand)
+{
+    if (operand->kind == OPERAND_TEMP && operand->index == current->freeRegister - 1)
+        current->freeRegister--;
+}
+
+// free two operands, the one in the higher register first to keep stack order
+static void freeOperands(Operand *a, Operand *b)
+{
+    if (a->kind == OPERAND_TEMP && b->kind == OPERAND_TEMP && a->index > b->index)
+    {
+        freeOperand(a);
+        freeOperand(b);
+        return;
+    }
+    freeOperand(b);
+    freeOperand(a);
+}
+
+static Operand constantOperand(Value value)
+{
+    return (Operand){OPERAND_CONSTANT, makeConstant(value), -1};
+}
+
+static Operand tempOperand(int reg, int pc)
+{
+    return (Operand){OPERAND_TEMP, reg, pc};
+}
+
+/**
+ * @brief Make operand live in some register, loading it into a new temp if it is a
+ * constant. Locals are used where they are.
+ *
+ * @return int - the register
+ */
+static int toRegister(Operand *operand)
+{
+    if (operand->kind == OPERAND_CONSTANT)
+    {
+        int reg = reserveRegister();
+        int pc = emitABx(ROP_LOADK, reg, operand->index);
+        *operand = tempOperand(reg, pc);
+    }
+    return operand->index;
+}
+
+/**
+ * @brief Encode operand as a B/C operand, constants in the first 256 slots are read
+ * straight out of the pool
+ *
+ * @return int - RK operand
+ */
+static int toRK(Operand *operand)
+{
+    if (operand->kind == OPERAND_CONSTANT && operand->index <= REG_MAX_RK_CONSTANT)
+        return REG_CONSTANT_BIT | operand->index;
+    return toRegister(operand);
+}
+
+/**
+ * @brief Put operand's value in register reg using as few instructions as possible. If
+ * the value was just computed into a temp, the instruction that did it is retargeted to
+ * write reg directly, so 'i = i + 1' is a single ROP_ADD.
+ */
+static void moveTo(Operand *operand, int reg)
+{
+    RegChunk *chunk = currentChunk();
+    switch (operand->kind)
+    {
+    case OPERAND_CONSTANT:
+        emitABx(ROP_LOADK, reg, operand->index);
+        break;
+    case OPERAND_LOCAL:
+        if (operand->index != reg)
+            emitABC(ROP_MOVE, reg, operand->index, 0);
+        break;
+    case OPERAND_TEMP:
+        if (operand->index == reg)
+            break;
+        if (operand->pc >= 0 && operand->pc == chunk->count - 1 &&
+            (int)REG_GET_A(chunk->code[operand->pc]) == operand->index)
+        {
+            chunk->code[operand->pc] = (chunk->code[operand->pc] & ~(0xffu << 6)) | ((uint32_t)reg << 6);
+            break;
+        }
+        emitABC(ROP_MOVE, reg, operand->index, 0);
+        break;
+    }
+}
+
+/**
+ * @brief Put operand's value in a fresh temp at the top of the registers in use
+ */
+static Operand toNextRegister(Operand operand)
+{
+    freeOperand(&operand);
+    int reg = reserveRegister();
+    moveTo(&operand, reg);
+    return tempOperand(reg, operand.kind == OPERAND_TEMP && operand.index == reg ? operand.pc : -1);
+}
+
+static int emitJump(uint8_t op, int reg)
+{
+    return emit(REG_ENCODE_ASBX(op, reg, 0));
+}
+
+static void patchJump(int jump)
+{
+    int offset = currentChunk()->count - (jump + 1);
+    if (offset > REG_MAX_SBX)
+        error("ASKING TOO MUCH OF BRANCH. Too much code to jump over.");
+    uint32_t instruction = currentChunk()->code[jump];
+    currentChunk()->code[jump] =
+        REG_ENCODE_ASBX(REG_GET_OP(instruction), REG_GET_A(instruction), offset);
+}
+
+static void emitLoop(int loopStart)
+{
+    int offset = loopStart - (currentChunk()->count + 1);
+    if (-offset > REG_MAX_SBX)
+        error("Loop body too large.");
+    emit(REG_ENCODE_ASBX(ROP_JUMP, 0, offset));
+}
+
+static void initCompiler(RegCompiler *compiler)
+{
+    memset(compiler, 0, sizeof(RegCompiler));
+    current = compiler;
+}
+
+static void endCompiler()
+{
+    emitABC(ROP_RETURN, 0, 0, 0);
+#ifdef DEBUG_PRINT_CODE
+    if (!parser.hadError)
+        RegChunk_Disassemble(currentChunk(), "register code");
+#endif // DEBUG_PRINT_CODE
+}
+
+static void beginScope()
+{
+    current->scopeDepth++;
+}
+
+static void endScope()
+{
+    current->scopeDepth--;
+    // locals are just registers, nothing to pop at runtime
+    while (current->localCount > 0 &&
+           current->locals[current->localCount - 1].depth > current->scopeDepth)
+    {
+        current->localCount--;
+    }
+    current->freeRegister = current->localCount;
+}
+
+static Operand expression();
+static void statement();
+static void declaration();
+static ParseRule *getRule(TokenType type);
+static Operand parsePrecedence(Precedence precedence);
+
+static bool identifiersEqual(Token *a, Token *b)
+{
+    if (a->length != b->length)
+        return false;
+    return memcmp(a->start, b->start, a->length) == 0;
+}
+
+static int resolveLocal(Token *name)
+{
+    for (int i = current->localCount - 1; i >= 0; i--)
+    {
+        Local *local = &current->locals[i];
+        if (identifiersEqual(name, &local->name))
+        {
+            if (local->depth == -1)
+                error("Can't read local variable in its own initializer.");
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void addLocal(Token name)
+{
+    if (current->localCount == REG_MAX_REGISTERS)
+    {
+        error("Too many local variables in function.");
+        return;
+    }
+    Local *local = &current->locals[current->localCount++];
+    local->name = name;
+    local->depth = -1;
+}
+
+static void declareVariable()
+{
+    if (current->scopeDepth == 0)
+        return;
+
+    Token *name = &parser.previous;
+    for (int i = current->localCount - 1; i >= 0; i--)
+    {
+        Local *local = &current->locals[i];
+        if (local->depth != -1 && local->depth < current->scopeDepth)
+            break;
+        if (identifiersEqual(name, &local->name))
+            error("Already a variable with this name in this scope.");
+    }
+    addLocal(*name);
+}
+
+/**
+ * @brief 'left op right' into a new temp. left is settled BEFORE right is compiled so
+ * constants and locals are read in place and temps stay in stack order.
+ */
+static Operand binary(Operand left, bool canAssign)
+{
+    TokenType operatorType = parser.previous.type;
+    ParseRule *rule = getRule(operatorType);
+
+    int b = toRK(&left);
+    // a local on the left is read when the instruction runs, which is AFTER the right
+    // operand. If the right operand assigns that local ('a + (a = 1)') the old value has
+    // to be saved first, see below
+    int storesBefore = left.kind == OPERAND_LOCAL ? current->localStores[left.index] : 0;
+    int rightStart = currentChunk()->count;
+
+    Operand right = parsePrecedence((Precedence)(rule->precedence + 1));
+    int c = toRK(&right);
+
+    if (left.kind == OPERAND_LOCAL && current->localStores[left.index] != storesBefore)
+    {
+        // copy the local into a register nothing has used so far, in front of the
+        // right operand's code. Jumps are relative and never cross into the right
+        // operand from outside, so shifting its code by one doesn't break them
+        RegChunk *chunk = currentChunk();
+        if (chunk->maxRegisters >= REG_MAX_REGISTERS)
+            error("Expression needs too many registers.");
+        int saved = chunk->maxRegisters++;
+        emitABC(ROP_MOVE, 0, 0, 0); // grow by one, then shift down
+        memmove(&chunk->code[rightStart + 1], &chunk->code[rightStart],
+                (chunk->count - 1 - rightStart) * sizeof(uint32_t));
+        memmove(&chunk->lines[rightStart + 1], &chunk->lines[rightStart],
+                (chunk->count - 1 - rightStart) * sizeof(int));
+        chunk->code[rightStart] = REG_ENCODE_ABC(ROP_MOVE, saved, left.index, 0);
+        if (right.pc >= rightStart)
+            right.pc++;
+        b = saved;
+    }
+
+    freeOperands(&left, &right);
+    int target = reserveRegister();
+
+    uint8_t op;
+    switch (operatorType)
+    {
+    case TOKEN_PLUS:
+        op = ROP_ADD;
+        break;
+    case TOKEN_MINUS:
+        op = ROP_SUBTRACT;
+        break;
+    case TOKEN_STAR:
+        op = ROP_MULTIPLY;
+        break;
+    case TOKEN_SLASH:
+        op = ROP_DIVIDE;
+        break;
+    case TOKEN_BANG_EQUAL:
+        op = ROP_NOT_EQUAL;
+        break;
+    case TOKEN_EQUAL_EQUAL:
+        op = ROP_EQUAL;
+        break;
+    case TOKEN_GREATER:
+        op = ROP_GREATER;
+        break;
+    case TOKEN_GREATER_EQUAL:
+        op = ROP_GREATER_EQUAL;
+        break;
+    case TOKEN_LESS:
+        op = ROP_LESS;
+        break;
+    case TOKEN_LESS_EQUAL:
+        op = ROP_LESS_EQUAL;
+        break;
+    default:
+        return left; // Unreachable.
+    }
+    return tempOperand(target, emitABC(op, target, b, c));
+}
+
+/**
+ * @brief and/or: the result lives in one temp, the right operand is only evaluated
+ * (and moved into it) if the left one didn't decide the outcome
+ */
+static Operand logical(Operand left, Precedence precedence, uint8_t skipOp)
+{
+    Operand result = toNextRegister(left);
+    int endJump = emitJump(skipOp, result.index);
+
+    Operand right = parsePrecedence(precedence);
+    moveTo(&right, result.index);
+    freeOperand(&right);
+
+    patchJump(endJump);
+    return tempOperand(result.index, -1);
+}
+
+static Operand and_(Operand left, bool canAssign)
+{
+    return logical(left, PREC_AND, ROP_JUMP_IF_FALSE);
+}
+
+static Operand or_(Operand left, bool canAssign)
+{
+    return logical(left, PREC_OR, ROP_JUMP_IF_TRUE);
+}
+
+static Operand literal(bool canAssign)
+{
+    switch (parser.previous.type)
+    {
+    case TOKEN_FALSE:
+        return constantOperand(BOOL_VAL(false));
+    case TOKEN_TRUE:
+        return constantOperand(BOOL_VAL(true));
+    default:
+        return constantOperand(NIL_VAL);
+    }
+}
+
+static Operand grouping(bool canAssign)
+{
+    Operand operand = expression();
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+    return operand;
+}
+
+static Operand number(bool canAssign)
+{
+    return constantOperand(NUMBER_VAL(strtod(parser.previous.start, NULL)));
+}
+
+static Operand string(bool canAssign)
+{
+    return constantOperand(
+        OBJ_VAL(copyString(parser.previous.start + 1, parser.previous.length - 2)));
+}
+
+static Operand namedVariable(Token name, bool canAssign)
+{
+    int local = resolveLocal(&name);
+    if (local != -1)
+    {
+        if (canAssign && match(TOKEN_EQUAL))
+        {
+            Operand value = expression();
+            moveTo(&value, local);
+            freeOperand(&value);
+            current->localStores[local]++;
+        }
+        return (Operand){OPERAND_LOCAL, local, -1};
+    }
+
+    int slot = globalSlot(&name);
+    if (canAssign && match(TOKEN_EQUAL))
+    {
+        Operand value = expression();
+        emitABx(ROP_SET_GLOBAL, toRegister(&value), slot);
+        return value;
+    }
+    int reg = reserveRegister();
+    return tempOperand(reg, emitABx(ROP_GET_GLOBAL, reg, slot));
+}
+
+static Operand variable(bool canAssign)
+{
+    return namedVariable(parser.previous, canAssign);
+}
+
+static Operand unary(bool canAssign)
+{
+    TokenType operatorType = parser.previous.type;
+    Operand operand = parsePrecedence(PREC_UNARY);
+    int b = toRK(&operand);
+    freeOperand(&operand);
+    int target = reserveRegister();
+    uint8_t op = operatorType == TOKEN_BANG ? ROP_NOT : ROP_NEGATE;
+    return tempOperand(target, emitABC(op, target, b, 0));
+}
+
+static ParseRule rules[] = {
+    [TOKEN_LEFT_PAREN] = {grouping, NULL, PREC_NONE},
+    [TOKEN_RIGHT_PAREN] = {NULL, NULL, PREC_NONE},
+    [TOKEN_LEFT_BRACE] = {NULL, NULL, PREC_NONE},
+    [TOKEN_RIGHT_BRACE] = {NULL, NULL, PREC_NONE},
+    [TOKEN_LEFT_BRACKET] = {NULL, NULL, PREC_NONE},
+    [TOKEN_RIGHT_BRACKET] = {NULL, NULL, PREC_NONE},
+    [TOKEN_COMMA] = {NULL, NULL, PREC_NONE},
+    [TOKEN_DOT] = {NULL, NULL, PREC_NONE},
+    [TOKEN_MINUS] = {unary, binary, PREC_TERM},
+    [TOKEN_PLUS] = {NULL, binary, PREC_TERM},
+    [TOKEN_SEMICOLON] = {NULL, NULL, PREC_NONE},
+    [TOKEN_SLASH] = {NULL, binary, PREC_FACTOR},
+    [TOKEN_STAR] = {NULL, binary, PREC_FACTOR},
+    [TOKEN_BANG] = {unary, NULL, PREC_NONE},
+    [TOKEN_BANG_EQUAL] = {NULL, binary, PREC_EQUALITY},
+    [TOKEN_EQUAL] = {NULL, NULL, PREC_NONE},
+    [TOKEN_EQUAL_EQUAL] = {NULL, binary, PREC_EQUALITY},
+    [TOKEN_GREATER] = {NULL, binary, PREC_COMPARISON},
+    [TOKEN_GREATER_EQUAL] = {NULL, binary, PREC_COMPARISON},
+    [TOKEN_LESS] = {NULL, binary, PREC_COMPARISON},
+    [TOKEN_LESS_EQUAL] = {NULL, binary, PREC_COMPARISON},
+    [TOKEN_IDENTIFIER] = {variable, NULL, PREC_NONE},
+    [TOKEN_STRING] = {string, NULL, PREC_NONE},
+    [TOKEN_NUMBER] = {number, NULL, PREC_NONE},
+    [TOKEN_AND] = {NULL, and_, PREC_AND},
+    [TOKEN_CATCH] = {NULL, NULL, PREC_NONE},
+    [TOKEN_CLASS] = {NULL, NULL, PREC_NONE},
+    [TOKEN_ELSE] = {NULL, NULL, PREC_NONE},
+    [TOKEN_FALSE] = {literal, NULL, PREC_NONE},
+    [TOKEN_FOR] = {NULL, NULL, PREC_NONE},
+    [TOKEN_FUN] = {NULL, NULL, PREC_NONE},
+    [TOKEN_IF] = {NULL, NULL, PREC_NONE},
+    [TOKEN_NIL] = {literal, NULL, PREC_NONE},
+    [TOKEN_OR] = {NULL, or_, PREC_OR},
+    [TOKEN_PRINT] = {NULL, NULL, PREC_NONE},
+    [TOKEN_RETURN] = {NULL, NULL, PREC_NONE},
+    [TOKEN_SUPER] = {NULL, NULL, PREC_NONE},
+    [TOKEN_THIS] = {NULL, NULL, PREC_NONE},
+    [TOKEN_THROW] = {NULL, NULL, PREC_NONE},
+    [TOKEN_TRUE] = {literal, NULL, PREC_NONE},
+    [TOKEN_TRY] = {NULL, NULL, PREC_NONE},
+    [TOKEN_VAR] = {NULL, NULL, PREC_NONE},
+    [TOKEN_WHILE] = {NULL, NULL, PREC_NONE},
+    [TOKEN_ERROR] = {NULL, NULL, PREC_NONE},
+    [TOKEN_EOF] = {NULL, NULL, PREC_NONE},
+};
+
+static ParseRule *getRule(TokenType type)
+{
+    return &rules[type];
+}
+
+static Operand parsePrecedence(Precedence precedence)
+{
+    advance();
+    PrefixFn prefixRule = getRule(parser.previous.type)->prefix;
+    if (prefixRule == NULL)
+    {
+        error("Expect expression.");
+        return constantOperand(NIL_VAL);
+    }
+
+    bool canAssign = (precedence <= PREC_ASSIGNMENT);
+    Operand operand = prefixRule(canAssign);
+
+    while (precedence <= getRule(parser.current.type)->precedence)
+    {
+        advance();
+        operand = getRule(parser.previous.type)->infix(operand, canAssign);
+
+        if (canAssign && match(TOKEN_EQUAL))
+            error("Invalid assignment target.");
+    }
+    return operand;
+}
+
+static Operand expression()
+{
+    return parsePrecedence(PREC_ASSIGNMENT);
+}
+
+/**
+ * @brief Compile a condition and jump over what follows when it is false
+ *
+ * @return int - the jump to patch
+ */
+static int conditionJump()
+{
+    Operand condition = expression();
+    int reg = toRegister(&condition);
+    freeOperand(&condition);
+    return emitJump(ROP_JUMP_IF_FALSE, reg);
+}
+
+static void block()
+{
+    while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF))
+        declaration();
+    consume(TOKEN_RIGHT_BRACE, "Expect '}' after block");
+}
+
+static void varDeclaration()
+{
+    consume(TOKEN_IDENTIFIER, "Expect variable name.");
+    Token name = parser.previous;
+    declareVariable();
+
+    Operand value = match(TOKEN_EQUAL) ? expression() : constantOperand(NIL_VAL);
+    consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
+
+    if (current->scopeDepth > 0)
+    {
+        // local i lives in register i, the initializer's value goes straight there
+        int reg = current->localCount - 1;
+        moveTo(&value, reg);
+        current->freeRegister = current->localCount;
+        if (current->freeRegister > currentChunk()->maxRegisters)
+            currentChunk()->maxRegisters = current->freeRegister;
+        current->locals[reg].depth = current->scopeDepth;
+        return;
+    }
+    int reg = toRegister(&value);
+    emitABx(ROP_DEFINE_GLOBAL, reg, globalSlot(&name));
+    freeOperand(&value);
+}
+
+static void expressionStatement()
+{
+    Operand operand = expression();
+    consume(TOKEN_SEMICOLON, "Expect ';' after expression. ");
+    freeOperand(&operand);
+}
+
+static void printStatement()
+{
+    Operand operand = expression();
+    consume(TOKEN_SEMICOLON, "Expect ';' after value.");
+    emitABC(ROP_PRINT, 0, toRK(&operand), 0);
+    freeOperand(&operand);
+}
+
+static void ifStatement()
+{
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
+    int thenJump = conditionJump();
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+    statement();
+    int elseJump = emitJump(ROP_JUMP, 0);
+    patchJump(thenJump);
+    if (match(TOKEN_ELSE))
+        statement();
+    patchJump(elseJump);
+}
+
+static void whileStatement()
+{
+    int loopStart = currentChunk()->count;
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
+    int exitJump = conditionJump();
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+    statement();
+    emitLoop(loopStart);
+    patchJump(exitJump);
+}
+
+static void forStatement()
+{
+    beginScope();
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
+    if (match(TOKEN_SEMICOLON))
+    {
+        // No initializer.
+    }
+    else if (match(TOKEN_VAR))
+    {
+        varDeclaration();
+    }
+    else
+    {
+        expressionStatement();
+    }
+
+    int loopStart = currentChunk()->count;
+    int exitJump = -1;
+    if (!match(TOKEN_SEMICOLON))
+    {
+        exitJump = conditionJump();
+        consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
+    }
+
+    if (!match(TOKEN_RIGHT_PAREN))
+    {
+        int bodyJump = emitJump(ROP_JUMP, 0);
+        int incrementStart = currentChunk()->count;
+        Operand increment = expression();
+        freeOperand(&increment);
+        consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
+
+        emitLoop(loopStart);
+        loopStart = incrementStart;
+        patchJump(bodyJump);
+    }
+
+    statement();
+    emitLoop(loopStart);
+    if (exitJump != -1)
+        patchJump(exitJump);
+    endScope();
+}
+
+static void synchronize()
+{
+    parser.panicMode = false;
+    while (parser.current.type != TOKEN_EOF)
+    {
+        if (parser.previous.type == TOKEN_SEMICOLON)
+            return;
+        switch (parser.current.type)
+        {
+        case TOKEN_CLASS:
+        case TOKEN_FUN:
+        case TOKEN_VAR:
+        case TOKEN_FOR:
+        case TOKEN_IF:
+        case TOKEN_WHILE:
+        case TOKEN_PRINT:
+        case TOKEN_RETURN:
+            return;
+        default:; // Do nothing.
+        }
+        advance();
+    }
+}
+
+static void statement()
+{
+    if (match(TOKEN_PRINT))
+    {
+        printStatement();
+    }
+    else if (match(TOKEN_IF))
+    {
+        ifStatement();
+    }
+    else if (match(TOKEN_FOR))
+    {
+        forStatement();
+    }
+    else if (match(TOKEN_WHILE))
+    {
+        whileStatement();
+    }
+    else if (match(TOKEN_LEFT_BRACE))
+    {
+        beginScope();
+        block();
+        endScope();
+    }
+    else
+    {
+        expressionStatement();
+    }
+}
+
+static void declaration()
+{
+    // functions only exist on the stack backend so far
+    if (match(TOKEN_FUN) || match(TOKEN_RETURN))
+        error("Functions are not supported by the register backend.");
+    else if (match(TOKEN_CLASS))
+        error("Classes are not supported by the register backend.");
+    else if (match(TOKEN_TRY) || match(TOKEN_THROW))
+        error("Exceptions are not supported by the register backend.");
+    else if (match(TOKEN_VAR))
+        varDeclaration();
+    else
+        statement();
+
+    // every temporary dies with the statement that made it
+    current->freeRegister = current->localCount;
+
+    if (parser.panicMode)
+        synchronize();
+}
+
+bool RegCompiler_Compile(const char *source, RegChunk *chunk)
+{
+    Scanner_InitScanner(source);
+    RegCompiler compiler;
+    initCompiler(&compiler);
+    compilingChunk = chunk;
+
+    parser.hadError = false;
+    parser.panicMode = false;
+
+    advance();
+    while (!match(TOKEN_EOF))
+        declaration();
+
+    endCompiler();
+    return !parser.hadError;
+}
@@ -0,0 +1,254 @@
+#include "regvm.h"
+
+#include "common.h"
+#include "memory.h"
+#include "object.h"
+#include "regchunk.h"
+#include "value.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static RegChunk *runningChunk;
+static const uint32_t *runningIp;
+
+static void runtimeError(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputs("\n", stderr);
+
+    size_t instruction = runningIp - runningChunk->code - 1;
+    fprintf(stderr, "[line %d] in script\n", runningChunk->lines[instruction]);
+    vm.stackTop = vm.stack;
+}
+
+static bool isFalsey(Value value)
+{
+    return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+/**
+ * @brief Register backend counterpart of Vm_Run. The registers are a window on the VM's
+ * value stack starting at base, constants are read straight from the chunk's pool.
+ */
+static InterpretResult run(RegChunk *chunk, Value *base)
+{
+    const uint32_t *ip = chunk->code;
+    const Value *constants = chunk->constants.values;
+
+    #define R(index) (base[(index)])
+    #define RK(operand) \
+        (REG_IS_CONSTANT(operand) ? constants[REG_CONSTANT_INDEX(operand)] : base[(operand)])
+    // errors need to know where we are, ip is otherwise only kept in a local
+    #define RUNTIME_ERROR(...)                \
+        do                                    \
+        {                                     \
+            runningIp = ip;                   \
+            runtimeError(__VA_ARGS__);        \
+            return INTERPRET_RUNTIME_ERROR;   \
+        } while (false)
+    #define NUMBER_OP(valueType, op)                                           \
+        do                                                                     \
+        {                                                                      \
+            Value b = RK(REG_GET_B(instruction));                              \
+            Value c = RK(REG_GET_C(instruction));                              \
+            if (!IS_NUMBER(b) || !IS_NUMBER(c))                                \
+                RUNTIME_ERROR("Operands must be numbers.");                    \
+            R(REG_GET_A(instruction)) = valueType(AS_NUMBER(b) op AS_NUMBER(c)); \
+        } while (false)
+    #define NEGATED_COMPARE(op)                                                \
+        do                                                                     \
+        {                                                                      \
+            Value b = RK(REG_GET_B(instruction));                              \
+            Value c = RK(REG_GET_C(instruction));                              \
+            if (!IS_NUMBER(b) || !IS_NUMBER(c))                                \
+                RUNTIME_ERROR("Operands must be numbers.");                    \
+            R(REG_GET_A(instruction)) = BOOL_VAL(!(AS_NUMBER(b) op AS_NUMBER(c))); \
+        } while (false)
+
+    // same dispatch scheme as Vm_Run, see there
+    #ifdef USE_COMPUTED_GOTO
+        #define REG_OPCODE_LABEL(name) &&label_##name,
+        static void *dispatchTable[] = {REG_OPCODE_LIST(REG_OPCODE_LABEL)};
+        #undef REG_OPCODE_LABEL
+        _Static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == ROP_COUNT,
+                       "dispatchTable must have one entry per opcode");
+
+        #define INTERPRET_LOOP DISPATCH();
+        #define CASE_CODE(name) label_##name
+        #define DISPATCH()                                    \
+            do                                                \
+            {                                                 \
+                instruction = *ip++;                          \
+                goto *dispatchTable[REG_GET_OP(instruction)]; \
+            } while (false)
+    #else
+        #define INTERPRET_LOOP             \
+            loop:                          \
+            instruction = *ip++;           \
+            switch (REG_GET_OP(instruction))
+        #define CASE_CODE(name) case name
+        #define DISPATCH() goto loop
+    #endif // end USE_COMPUTED_GOTO
+
+    uint32_t instruction;
+    INTERPRET_LOOP
+    {
+        CASE_CODE(ROP_MOVE):
+            R(REG_GET_A(instruction)) = R(REG_GET_B(instruction));
+            DISPATCH();
+        CASE_CODE(ROP_LOADK):
+            R(REG_GET_A(instruction)) = constants[REG_GET_BX(instruction)];
+            DISPATCH();
+        CASE_CODE(ROP_GET_GLOBAL):
+        {
+            uint32_t slot = REG_GET_BX(instruction);
+            Value value = vm.globalValues.values[slot];
+            if (IS_UNDEFINED(value))
+                RUNTIME_ERROR("Undefined variable '%s'.",
+                              AS_CSTRING(vm.globalIdentifiers.values[slot]));
+            R(REG_GET_A(instruction)) = value;
+            DISPATCH();
+        }
+        CASE_CODE(ROP_DEFINE_GLOBAL):
+            vm.globalValues.values[REG_GET_BX(instruction)] = R(REG_GET_A(instruction));
+            DISPATCH();
+        CASE_CODE(ROP_SET_GLOBAL):
+        {
+            uint32_t slot = REG_GET_BX(instruction);
+            // assigning never defines a global, the 'var' must have run first
+            if (IS_UNDEFINED(vm.globalValues.values[slot]))
+                RUNTIME_ERROR("Undefined variable '%s'.",
+                              AS_CSTRING(vm.globalIdentifiers.values[slot]));
+            vm.globalValues.values[slot] = R(REG_GET_A(instruction));
+            DISPATCH();
+        }
+        CASE_CODE(ROP_ADD):
+        {
+            Value b = RK(REG_GET_B(instruction));
+            Value c = RK(REG_GET_C(instruction));
+            if (IS_NUMBER(b) && IS_NUMBER(c))
+                R(REG_GET_A(instruction)) = NUMBER_VAL(AS_NUMBER(b) + AS_NUMBER(c));
+            else if (IS_STRING(b) && IS_STRING(c))
+                R(REG_GET_A(instruction)) = OBJ_VAL(concatenateStrings(AS_STRING(b), AS_STRING(c)));
+            else
+                RUNTIME_ERROR("Operands must be two numbers or two strings.");
+            DISPATCH();
+        }
+        CASE_CODE(ROP_SUBTRACT):
+            NUMBER_OP(NUMBER_VAL, -);
+            DISPATCH();
+        CASE_CODE(ROP_MULTIPLY):
+            NUMBER_OP(NUMBER_VAL, *);
+            DISPATCH();
+        CASE_CODE(ROP_DIVIDE):
+            NUMBER_OP(NUMBER_VAL, /);
+            DISPATCH();
+        CASE_CODE(ROP_EQUAL):
+            R(REG_GET_A(instruction)) = BOOL_VAL(
+                Value_valueEquals(RK(REG_GET_B(instruction)), RK(REG_GET_C(instruction))));
+            DISPATCH();
+        CASE_CODE(ROP_NOT_EQUAL):
+            R(REG_GET_A(instruction)) = BOOL_VAL(
+                !Value_valueEquals(RK(REG_GET_B(instruction)), RK(REG_GET_C(instruction))));
+            DISPATCH();
+        CASE_CODE(ROP_GREATER):
+            NUMBER_OP(BOOL_VAL, >);
+            DISPATCH();
+        // >= and <= are the negation of < and >, NaN operands included, like the stack VM
+        CASE_CODE(ROP_GREATER_EQUAL):
+            NEGATED_COMPARE(<);
+            DISPATCH();
+        CASE_CODE(ROP_LESS):
+            NUMBER_OP(BOOL_VAL, <);
+            DISPATCH();
+        CASE_CODE(ROP_LESS_EQUAL):
+            NEGATED_COMPARE(>);
+            DISPATCH();
+        CASE_CODE(ROP_NOT):
+            R(REG_GET_A(instruction)) = BOOL_VAL(isFalsey(RK(REG_GET_B(instruction))));
+            DISPATCH();
+        CASE_CODE(ROP_NEGATE):
+        {
+            Value b = RK(REG_GET_B(instruction));
+            if (!IS_NUMBER(b))
+                RUNTIME_ERROR("Operand must be a number.");
+            R(REG_GET_A(instruction)) = NUMBER_VAL(-AS_NUMBER(b));
+            DISPATCH();
+        }
+        CASE_CODE(ROP_PRINT):
+            Value_printValue(RK(REG_GET_B(instruction)), 31);
+            printf("\n");
+            DISPATCH();
+        CASE_CODE(ROP_JUMP):
+            ip += REG_GET_SBX(instruction);
+            DISPATCH();
+        CASE_CODE(ROP_JUMP_IF_FALSE):
+            if (isFalsey(R(REG_GET_A(instruction))))
+                ip += REG_GET_SBX(instruction);
+            DISPATCH();
+        CASE_CODE(ROP_JUMP_IF_TRUE):
+            if (!isFalsey(R(REG_GET_A(instruction))))
+                ip += REG_GET_SBX(instruction);
+            DISPATCH();
+        CASE_CODE(ROP_RETURN):
+            return INTERPRET_OK;
+    }
+
+    RUNTIME_ERROR("Unknown opcode %d.", REG_GET_OP(instruction));
+
+    #undef R
+    #undef RK
+    #undef RUNTIME_ERROR
+    #undef NUMBER_OP
+    #undef NEGATED_COMPARE
+    #undef INTERPRET_LOOP
+    #undef CASE_CODE
+    #undef DISPATCH
+}
+
+void RegVm_MarkRoots()
+{
+    if (runningChunk == NULL)
+        return;
+    for (int i = 0; i < runningChunk->constants.count; i++)
+        Memory_MarkValue(runningChunk->constants.values[i]);
+}
+
+InterpretResult RegVm_Interpret(const char *source)
+{
+    RegChunk chunk;
+    RegChunk_InitChunk(&chunk);
+    // its constants are only reachable from here, from compilation on
+    runningChunk = &chunk;
+    if (!RegCompiler_Compile(source, &chunk))
+    {
+        runningChunk = NULL;
+        RegChunk_FreeChunk(&chunk);
+        return INTERPRET_COMPILE_ERROR;
+    }
+
+    // the registers sit on the VM's value stack, reserved once like a stack chunk's depth
+    if (!Vm_ReserveStack(chunk.maxRegisters))
+    {
+        fprintf(stderr, "Stack overflow.\n");
+        runningChunk = NULL;
+        RegChunk_FreeChunk(&chunk);
+        return INTERPRET_RUNTIME_ERROR;
+    }
+    Value *base = vm.stackTop;
+    for (int i = 0; i < chunk.maxRegisters; i++)
+        base[i] = NIL_VAL;
+    vm.stackTop = base + chunk.maxRegisters;
+
+    InterpretResult result = run(&chunk, base);
+    vm.stackTop = base;
+
+    runningChunk = NULL;
+    RegChunk_FreeChunk(&chunk);
+    return result;
+}
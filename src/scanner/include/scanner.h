@@ -10,6 +10,8 @@ typedef enum
     TOKEN_RIGHT_PAREN,
     TOKEN_LEFT_BRACE,
     TOKEN_RIGHT_BRACE,
+    TOKEN_LEFT_BRACKET,
+    TOKEN_RIGHT_BRACKET,
     TOKEN_COMMA,
     TOKEN_DOT,
     TOKEN_MINUS,
@@ -32,6 +34,7 @@ typedef enum
     TOKEN_NUMBER,
     // Keywords.
     TOKEN_AND,
+    TOKEN_CATCH,
     TOKEN_CLASS,
     TOKEN_ELSE,
     TOKEN_FALSE,
@@ -44,7 +47,9 @@ typedef enum
     TOKEN_RETURN,
     TOKEN_SUPER,
     TOKEN_THIS,
+    TOKEN_THROW,
     TOKEN_TRUE,
+    TOKEN_TRY,
     TOKEN_VAR,
     TOKEN_WHILE,
 
@@ -66,6 +71,13 @@ typedef struct
     int line;          // line number associated with the token
 } Token;
 
+typedef struct
+{
+    const char *start;   // starting char of lexeme
+    const char *current; // char currently on
+    int line;            // line lexeme is on
+} Scanner;
+
 /**
  * @brief Our scanner has a state, thus we should initialize it.
  *
@@ -80,3 +92,10 @@ void Scanner_InitScanner(const char *source);
  * @return Token
  */
 Token Scanner_ScanToken();
+
+/**
+ * @brief Snapshot of where the scanner is, so the compiler can look ahead at tokens and
+ * then rewind with Scanner_RestoreState.
+ */
+Scanner Scanner_SaveState();
+void Scanner_RestoreState(Scanner state);
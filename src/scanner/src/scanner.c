@@ -5,13 +5,6 @@
 #include <stdio.h>
 #include <string.h>
 
-typedef struct
-{
-    const char *start;   // starting char of lexeme
-    const char *current; // char currently on
-    int line;            // line lexeme is on
-} Scanner;
-
 Scanner scanner;
 
 void Scanner_InitScanner(const char *source)
@@ -21,6 +14,16 @@ void Scanner_InitScanner(const char *source)
     scanner.line = 1; // we will be pointing to the first line upon starting interpreter
 }
 
+Scanner Scanner_SaveState()
+{
+    return scanner;
+}
+
+void Scanner_RestoreState(Scanner state)
+{
+    scanner = state;
+}
+
 /**
  * Checks if a character is a digit.
  *
@@ -226,7 +229,17 @@ static TokenType identifierType()
     case 'a':
         return checkKeyword(1, 2, "nd", TOKEN_AND);
     case 'c':
-        return checkKeyword(1, 4, "lass", TOKEN_CLASS);
+        if (scanner.current - scanner.start > 1)
+        {
+            switch (scanner.start[1])
+            {
+            case 'a':
+                return checkKeyword(2, 3, "tch", TOKEN_CATCH);
+            case 'l':
+                return checkKeyword(2, 3, "ass", TOKEN_CLASS);
+            }
+        }
+        break;
     case 'e':
         return checkKeyword(1, 3, "lse", TOKEN_ELSE);
     case 'f':
@@ -261,8 +274,12 @@ static TokenType identifierType()
             switch (scanner.start[1])
             {
             case 'h':
+                if (scanner.current - scanner.start > 2 && scanner.start[2] == 'r')
+                    return checkKeyword(3, 2, "ow", TOKEN_THROW);
                 return checkKeyword(2, 2, "is", TOKEN_THIS);
             case 'r':
+                if (scanner.current - scanner.start > 2 && scanner.start[2] == 'y')
+                    return checkKeyword(3, 0, "", TOKEN_TRY);
                 return checkKeyword(2, 2, "ue", TOKEN_TRUE);
             }
         }
@@ -385,6 +402,10 @@ Token Scanner_ScanToken()
         return Scanner_MakeToken(TOKEN_LEFT_BRACE); // single char token
     case '}':
         return Scanner_MakeToken(TOKEN_RIGHT_BRACE); // single char token
+    case '[':
+        return Scanner_MakeToken(TOKEN_LEFT_BRACKET); // single char token
+    case ']':
+        return Scanner_MakeToken(TOKEN_RIGHT_BRACKET); // single char token
     case ';':
         return Scanner_MakeToken(TOKEN_SEMICOLON); // single char token
     case ',':
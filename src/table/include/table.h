@@ -20,6 +20,11 @@ void initTable(Table *table);
 void freeTable(Table *table);
 bool tableSet(Table *table, ObjString *key, Value value);
 ObjString *tableFindString(Table *table, const char *chars, int length, uint32_t hash);
+// tableFindString for the characters of first followed by those of second
+ObjString *tableFindJoined(Table *table, const char *first, int firstLength, const char *second,
+                           int secondLength, uint32_t hash);
 void tableAddAll(Table *from, Table *to);
 bool tableGet(Table *table, ObjString *key, Value *value);
 bool tableDelete(Table *table, ObjString *key);
+void tableRemoveWhite(Table *table);
+void markTable(Table *table);
@@ -128,6 +128,7 @@ static void adjustCapacity(Table *table, int capacity)
         table->count++; // increment count every time we find non-tombstone entry
     }
 
+    FREE_ARRAY(Entry, table->entries, table->capacity); // the old array is no longer needed
     table->entries = entries;   // store the array
     table->capacity = capacity; // and its capacity into hash tables struct
 }
@@ -226,6 +227,12 @@ void tableAddAll(Table *from, Table *to)
  * @return ObjString*
  */
 ObjString *tableFindString(Table *table, const char *chars, int length, uint32_t hash)
+{
+    return tableFindJoined(table, chars, length, "", 0, hash);
+}
+
+ObjString *tableFindJoined(Table *table, const char *first, int firstLength, const char *second,
+                           int secondLength, uint32_t hash)
 {
     // if no entries in table yet, no strings are interned, return NULL
     if (table->count == 0)
@@ -241,9 +248,10 @@ ObjString *tableFindString(Table *table, const char *chars, int length, uint32_t
             if (IS_NIL(entry->value))
                 return NULL;
         }
-        else if (entry->key->length == length &&
+        else if (entry->key->length == firstLength + secondLength &&
                  entry->key->hash == hash &&
-                 memcmp(entry->key->chars, chars, length) == 0)
+                 memcmp(entry->key->chars, first, firstLength) == 0 &&
+                 memcmp(entry->key->chars + firstLength, second, secondLength) == 0)
         {
             // We found it.
             return entry->key;
@@ -251,4 +259,34 @@ ObjString *tableFindString(Table *table, const char *chars, int length, uint32_t
 
         index = (index + 1) % table->capacity;
     }
-}
\ No newline at end of file
+}
+/**
+ * @brief Delete every entry whose key the collector didn't mark, right before it frees
+ * those keys. Makes vm.strings a weak table.
+ *
+ * @param table
+ */
+void tableRemoveWhite(Table *table)
+{
+    for (int i = 0; i < table->capacity; i++)
+    {
+        Entry *entry = &table->entries[i];
+        if (entry->key != NULL && !entry->key->obj.isMarked)
+            tableDelete(table, entry->key);
+    }
+}
+
+/**
+ * @brief Mark every key and value of the table, for the collector.
+ *
+ * @param table
+ */
+void markTable(Table *table)
+{
+    for (int i = 0; i < table->capacity; i++)
+    {
+        Entry *entry = &table->entries[i];
+        Memory_MarkObject((Obj *)entry->key);
+        Memory_MarkValue(entry->value);
+    }
+}
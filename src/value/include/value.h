@@ -5,6 +5,72 @@
 typedef struct Obj Obj;
 typedef struct ObjString ObjString;
 
+#ifdef NAN_BOXING
+
+#include <string.h>
+
+/*
+ * NaN boxing. A double whose exponent bits are all set and whose quiet bit is set is a
+ * "quiet NaN", and the hardware only ever produces ONE of those. That leaves the other
+ * 51 mantissa bits free to encode every non-number Value in a single 64 bit word:
+ *
+ *   nil/true/false : QNAN with a small tag in the lowest two bits
+ *   undefined      : QNAN with tag 0, internal marker for a global slot with no value yet
+ *   Obj *          : QNAN with the sign bit set and the pointer in the low 48 bits
+ *   number         : any other bit pattern, the double itself
+ */
+#define SIGN_BIT ((uint64_t)0x8000000000000000)
+#define QNAN ((uint64_t)0x7ffc000000000000)
+
+#define TAG_UNDEFINED 0 // 00.
+#define TAG_NIL 1   // 01.
+#define TAG_FALSE 2 // 10.
+#define TAG_TRUE 3  // 11.
+
+typedef uint64_t Value;
+
+// Macros to check an urbanC Values type
+#define IS_BOOL(value) (((value) | 1) == TRUE_VAL)
+#define IS_NIL(value) ((value) == NIL_VAL)
+#define IS_UNDEFINED(value) ((value) == UNDEFINED_VAL)
+#define IS_NUMBER(value) (((value) & QNAN) != QNAN)
+#define IS_OBJ(value) \
+    (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
+
+// Give Value type produce a C type. Calls here MUST be guarded
+// behind the IS_* macros
+#define AS_BOOL(value) ((value) == TRUE_VAL)
+#define AS_NUMBER(value) Value_valueToNum(value)
+#define AS_OBJ(value) \
+    ((Obj *)(uintptr_t)((value) & ~(SIGN_BIT | QNAN)))
+
+// Macros to promote C val to urbanC val
+#define BOOL_VAL(b) ((b) ? TRUE_VAL : FALSE_VAL)
+#define FALSE_VAL ((Value)(uint64_t)(QNAN | TAG_FALSE))
+#define TRUE_VAL ((Value)(uint64_t)(QNAN | TAG_TRUE))
+#define NIL_VAL ((Value)(uint64_t)(QNAN | TAG_NIL))
+#define UNDEFINED_VAL ((Value)(uint64_t)(QNAN | TAG_UNDEFINED))
+#define NUMBER_VAL(num) Value_numToValue(num)
+#define OBJ_VAL(obj) \
+    (Value)(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(obj))
+
+// type punning through memcpy, compilers turn this into a plain register move
+static inline double Value_valueToNum(Value value)
+{
+    double num;
+    memcpy(&num, &value, sizeof(Value));
+    return num;
+}
+
+static inline Value Value_numToValue(double num)
+{
+    Value value;
+    memcpy(&value, &num, sizeof(double));
+    return value;
+}
+
+#else
+
 // Data types we'll support. Will serve as the tag
 // in the "tagged" union
 typedef enum
@@ -12,7 +78,8 @@ typedef enum
     VAL_BOOL,
     VAL_NIL,
     VAL_NUMBER,
-    VAL_OBJ
+    VAL_OBJ,
+    VAL_UNDEFINED // internal marker for a global slot with no value yet, never seen by scripts
 } ValueType;
 
 // TAGGED union
@@ -32,6 +99,7 @@ typedef struct
 #define IS_NIL(value) ((value).type == VAL_NIL)
 #define IS_NUMBER(value) ((value).type == VAL_NUMBER)
 #define IS_OBJ(value) ((value).type == VAL_OBJ)
+#define IS_UNDEFINED(value) ((value).type == VAL_UNDEFINED)
 
 // Give Value tyoe produce a C type. Calls here MUST be guarded
 // behing the IS_* macros
@@ -45,6 +113,9 @@ typedef struct
 #define NIL_VAL ((Value){VAL_NIL, {.number = 0}})
 #define NUMBER_VAL(value) ((Value){VAL_NUMBER, {.number = value}})
 #define OBJ_VAL(object) ((Value){VAL_OBJ, {.obj = (Obj *)object}})
+#define UNDEFINED_VAL ((Value){VAL_UNDEFINED, {.number = 0}})
+
+#endif // NAN_BOXING
 
 /**
  * Consider an snippet of code that looks like:
@@ -1,4 +1,3 @@
-#include "debug.h"
 #include "memory.h"
 #include "object.h"
 #include "value.h"
@@ -36,26 +35,32 @@ void freeValueArray(ValueArray *array)
     Value_initValueArray(array);
 }
 
+static void printColored(const char *text, int colorCode)
+{
+    printf("\033[%dm%s\033[0m", colorCode, text);
+}
+
 void Value_printValue(Value value, uint16_t colorCode)
 {
     char buffer[100];
-    switch (value.type)
+    if (IS_BOOL(value))
     {
-    case VAL_BOOL:
         snprintf(buffer, sizeof(buffer), AS_BOOL(value) ? "true" : "false");
-        Print_Color(buffer, colorCode);
-        break;
-    case VAL_NIL:
+        printColored(buffer, colorCode);
+    }
+    else if (IS_NIL(value))
+    {
         snprintf(buffer, sizeof(buffer), "nil");
-        Print_Color(buffer, colorCode);
-        break;
-    case VAL_NUMBER:
+        printColored(buffer, colorCode);
+    }
+    else if (IS_NUMBER(value))
+    {
         snprintf(buffer, sizeof(buffer), "%g", AS_NUMBER(value));
-        Print_Color(buffer, colorCode);
-        break;
-    case VAL_OBJ:
+        printColored(buffer, colorCode);
+    }
+    else if (IS_OBJ(value))
+    {
         printObject(value);
-        break;
     }
 }
 
@@ -66,6 +71,16 @@ void Value_printValue(Value value, uint16_t colorCode)
 // “strict equality” operator, ===.
 bool Value_valueEquals(Value a, Value b)
 {
+#ifdef NAN_BOXING
+    // numbers still compare as doubles so NaN != NaN and 0 == -0, the bit patterns
+    // of those differ from what IEEE 754 says about their equality
+    if (IS_NUMBER(a) && IS_NUMBER(b))
+    {
+        return AS_NUMBER(a) == AS_NUMBER(b);
+    }
+    // every other Value is equal only to the exact same bits: same singleton or same Obj*
+    return a == b;
+#else
     // if types not the same, def not equal
     if (a.type != b.type)
     {
@@ -78,6 +93,7 @@ bool Value_valueEquals(Value a, Value b)
     case VAL_BOOL:
         return AS_BOOL(a) == AS_BOOL(b);
     case VAL_NIL:
+    case VAL_UNDEFINED:
         return true;
     case VAL_NUMBER:
         return AS_NUMBER(a) == AS_NUMBER(b);
@@ -86,4 +102,5 @@ bool Value_valueEquals(Value a, Value b)
     default:
         return false;
     }
-}
\ No newline at end of file
+#endif // NAN_BOXING
+}
@@ -1,8 +1,12 @@
+#include "value.h"
+
 #include "unity.h"
 #include "unity/unity.h"
 #include "unity/unity_internals.h"
 #include "unity_internals.h"
 
+#include <math.h>
+
 void setUp(void) 
 {
 }
@@ -16,11 +20,74 @@ void Test_Value_Example(void)
     TEST_ASSERT_EQUAL(1,1);
 }
 
+void Test_Value_NumbersRoundTrip(void)
+{
+    Value value = NUMBER_VAL(-12.5);
+    TEST_ASSERT_TRUE(IS_NUMBER(value));
+    TEST_ASSERT_FALSE(IS_NIL(value));
+    TEST_ASSERT_FALSE(IS_BOOL(value));
+    TEST_ASSERT_FALSE(IS_OBJ(value));
+    TEST_ASSERT_EQUAL_DOUBLE(-12.5, AS_NUMBER(value));
+}
+
+void Test_Value_SingletonsAreDistinct(void)
+{
+    TEST_ASSERT_TRUE(IS_NIL(NIL_VAL));
+    TEST_ASSERT_TRUE(IS_BOOL(BOOL_VAL(true)));
+    TEST_ASSERT_TRUE(IS_BOOL(BOOL_VAL(false)));
+    TEST_ASSERT_TRUE(AS_BOOL(BOOL_VAL(true)));
+    TEST_ASSERT_FALSE(AS_BOOL(BOOL_VAL(false)));
+    TEST_ASSERT_FALSE(IS_NUMBER(NIL_VAL));
+    TEST_ASSERT_TRUE(IS_UNDEFINED(UNDEFINED_VAL));
+    TEST_ASSERT_FALSE(IS_NIL(UNDEFINED_VAL));
+    TEST_ASSERT_FALSE(IS_BOOL(UNDEFINED_VAL));
+    TEST_ASSERT_FALSE(IS_NUMBER(UNDEFINED_VAL));
+    TEST_ASSERT_FALSE(Value_valueEquals(NIL_VAL, BOOL_VAL(false)));
+    TEST_ASSERT_FALSE(Value_valueEquals(NUMBER_VAL(0), BOOL_VAL(false)));
+}
+
+void Test_Value_EqualityFollowsIEEE(void)
+{
+    // NaN is never equal to itself, even when both sides carry the same bits
+    TEST_ASSERT_FALSE(Value_valueEquals(NUMBER_VAL(NAN), NUMBER_VAL(NAN)));
+    // different bits, same number
+    TEST_ASSERT_TRUE(Value_valueEquals(NUMBER_VAL(0.0), NUMBER_VAL(-0.0)));
+    TEST_ASSERT_TRUE(Value_valueEquals(NUMBER_VAL(3), NUMBER_VAL(3.0)));
+    // a NaN produced by arithmetic is still a number and not mistaken for a boxed value
+    TEST_ASSERT_TRUE(IS_NUMBER(NUMBER_VAL(0.0 / 0.0)));
+}
+
+void Test_Value_ObjectsCompareByIdentity(void)
+{
+    // only the pointer is stored, nothing is dereferenced here
+    static long a, b;
+    Value valueA = OBJ_VAL(&a);
+    TEST_ASSERT_TRUE(IS_OBJ(valueA));
+    TEST_ASSERT_FALSE(IS_NUMBER(valueA));
+    TEST_ASSERT_EQUAL_PTR(&a, AS_OBJ(valueA));
+    TEST_ASSERT_TRUE(Value_valueEquals(valueA, OBJ_VAL(&a)));
+    TEST_ASSERT_FALSE(Value_valueEquals(valueA, OBJ_VAL(&b)));
+}
+
+void Test_Value_NanBoxedValueIsOneWord(void)
+{
+#ifdef NAN_BOXING
+    TEST_ASSERT_EQUAL(8, sizeof(Value));
+#else
+    TEST_IGNORE_MESSAGE("built without NAN_BOXING");
+#endif
+}
+
 int main(void)
 {
     UNITY_BEGIN();
 
     RUN_TEST(Test_Value_Example);
+    RUN_TEST(Test_Value_NumbersRoundTrip);
+    RUN_TEST(Test_Value_SingletonsAreDistinct);
+    RUN_TEST(Test_Value_EqualityFollowsIEEE);
+    RUN_TEST(Test_Value_ObjectsCompareByIdentity);
+    RUN_TEST(Test_Value_NanBoxedValueIsOneWord);
  
     return UNITY_END();
 }
@@ -0,0 +1,7 @@
+#pragma once
+
+/**
+ * @brief Bind the natives every script can use (clock, math, hashing, fibers and lists) as globals.
+ * Called once by Vm_InitVm.
+ */
+void Natives_DefineCore();
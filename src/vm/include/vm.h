@@ -2,23 +2,107 @@
 
 #include "chunk.h"
 
+#include "memory.h"
+#include "object.h"
 #include "table.h"
 #include "value.h"
 
-#define STACK_MAX 256
+// the value stack starts at this many slots and grows by the same amount at a time
+#define STACK_SEGMENT 256
+// most slots the value stack may grow to before we report a stack overflow
+#define STACK_MAX (STACK_SEGMENT * 4096)
+// most calls that may be in progress at once, one more is a stack overflow
+#define FRAMES_MAX 1024
+// slots allocated below vm.stack: Vm_Run's cached top of stack needs somewhere to spill
+// to when the stack is empty
+#define STACK_GUARD 1
+
+// how many of the most recently executed instructions the trace keeps, power of two
+#define TRACE_BUFFER_SIZE 256
+
+/**
+ * One executed instruction as remembered by the execution trace. Kept small, recording
+ * one is a handful of stores so tracing can stay on under real load.
+ */
+typedef struct
+{
+    ObjFunction *function; // function the instruction belongs to
+    uint32_t offset;       // ip offset of the instruction in its chunk
+    uint32_t stackDepth;   // values on the stack right before it ran
+    uint8_t opcode;        // opcode as executed, so quickened forms show up as such
+} TraceEntry;
 
 typedef struct
 {
-    Chunk *chunk;
-    uint8_t *ip; // location of next byte to be executed. Will point to location in bytecode array to be executed
-    Value stack[STACK_MAX];
+    bool enabled;
+    uint64_t count; // instructions recorded so far, the ring holds the last TRACE_BUFFER_SIZE
+    TraceEntry entries[TRACE_BUFFER_SIZE];
+} TraceBuffer;
+
+typedef struct
+{
+    /*
+     * The running fiber's stack and frames. They are its own, another fiber's are
+     * swapped in by resume() and yield(), see ObjFiber.
+     */
+    ObjFiber *fiber;     // fiber these belong to
+    ObjFiber *mainFiber; // runs the script, the only fiber that can't yield
+    CallFrame *frames;   // heap allocated, grown on demand up to FRAMES_MAX
+    int frameCapacity;
+    int frameCount; // calls in progress, frames[frameCount - 1] is the running one
+    /*
+     * Heap allocated and grown on demand, see Vm_ReserveStack. Pushes never check for
+     * room: the compiler knows how deep each function's stack gets and the room is
+     * reserved when a call to it starts.
+     */
+    Value *stack;
+    int stackCapacity; // number of slots allocated for stack
     /* points at element just PAST element containing top, stack is EMPTY when pointing
      *  at 0 element in array
      */
     Value *stackTop;
-    Table globals;
+    ObjUpvalue *openUpvalues; // upvalues still pointing into the stack, highest slot first
+    Value exception;          // being thrown, from a runtime error or a 'throw'
+    /*
+     * Globals live in a dense array. The compiler resolves every global name to a slot
+     * index once, so the VM reads/writes them with a plain indexed load instead of a
+     * hash lookup. A slot is UNDEFINED_VAL until its 'var' runs.
+     */
+    ValueArray globalValues;      // slot -> current value
+    ValueArray globalIdentifiers; // slot -> OBJ_VAL(name), only needed for error messages
+    Table globalSlots;            // name -> NUMBER_VAL(slot), lets later code find an existing slot
     Table strings; // STRING INTERNING
-    Obj *objects;  // VM store a ptr to head of LL
+    ObjString *initString; // "init", looked up on every instantiation
+    ObjShape *emptyShape;  // root of the shape tree, the shape of every new instance
+    /*
+     * Garbage collector, see Memory_CollectGarbage and Memory_CollectYoung. Objects are
+     * young until they survive a collection, then old. The gray stack is the marked
+     * objects whose references haven't been followed yet and the remembered set the old
+     * objects that may refer to young ones, both are malloc'ed directly so growing them
+     * never starts a collection.
+     */
+    Obj *youngObjects;     // allocated since the last collection, head of an intrusive list
+    Obj *oldObjects;       // survived a collection
+    size_t bytesAllocated; // live bytes handed out by Memory_Reallocate
+    size_t nextGC;         // collect everything when bytesAllocated goes past this
+    size_t nurseryBytes;   // allocated since the last collection, see GC_NURSERY_SIZE
+    int grayCount;
+    int grayCapacity;
+    Obj **grayStack;
+    int rememberedCount;
+    int rememberedCapacity;
+    Obj **remembered;
+    // incremental full collections, see Memory_SetIncremental
+    GcPhase gcPhase;
+    int gcSliceWork;     // 0 when full collections stop the world
+    size_t sliceBytes;   // allocated since the last slice
+    Obj *clearCursor;    // next old object to unmark
+    Obj **sweepLink;     // the link to the next old object to sweep
+    Obj *sweepingYoung;  // young objects of before the sweep, swept after the old ones
+    GcStats gcStats;
+    Obj *tempRoots[GC_TEMP_ROOTS_MAX]; // see Memory_PushRoot
+    int tempRootCount;
+    TraceBuffer trace; // ring of recently executed instructions, see Vm_SetTracing
 } VM;
 
 /**
@@ -43,5 +127,84 @@ void Vm_FreeVm();
  * @return InterpretResult - INTERPRET_OK if no errors, INTERPRET_COMPILE_ERROR if compilation error, INTERPRET_RUNTIME_ERROR if runtime error
  */
 InterpretResult Vm_Interpret(const char *source);
+
+/**
+ * @brief Find the slot of a global variable, creating an (undefined) slot the first time a
+ * name is seen. Slots are never removed, so code compiled earlier (e.g. a previous REPL
+ * line) keeps working and a global may be referenced before its definition has run.
+ *
+ * @param name - interned name of the global
+ * @return int - index into vm.globalValues
+ */
+int Vm_GlobalSlot(ObjString *name);
+
+/**
+ * @brief Turn the execution trace on or off. While on, every executed instruction is
+ * recorded in a fixed-size ring buffer (nothing is printed). The buffer is dumped to
+ * stderr when a runtime error happens, or whenever Vm_DumpTrace is called. Takes effect
+ * the next time a chunk starts running. When off, the dispatch loop pays nothing for it.
+ *
+ * @param enabled
+ */
+void Vm_SetTracing(bool enabled);
+
+/**
+ * @brief Print the recorded instructions, oldest first.
+ *
+ * @param out - stream to print to
+ */
+void Vm_DumpTrace(FILE *out);
+
+/**
+ * @brief Make sure there is room for at least slots more values above stackTop, growing
+ * the stack a segment at a time if there isn't. Growing may move the stack: stackTop, the
+ * call frames and the open upvalues are rebased, any other pointer into it must be re-read
+ * afterwards.
+ *
+ * @param slots - number of values about to be pushed
+ * @return false if that would take the stack past STACK_MAX
+ */
+bool Vm_ReserveStack(int slots);
+
+/**
+ * @brief Make a C function callable from scripts as the global 'name'.
+ *
+ * @param name - name of the global it is bound to
+ * @param function - implementation, see NativeFn
+ * @param arity - number of arguments it takes, or NATIVE_VARIADIC
+ */
+void Vm_DefineNative(const char *name, NativeFn function, int arity);
+
+/**
+ * @brief Raise a runtime error from inside a native, at the line of the call. The native
+ * returns what this returns and the error is thrown from the call, a script's try block
+ * may catch it.
+ *
+ * @param format - printf style message
+ * @return Value - the marker the VM recognizes as "the native failed"
+ */
+Value Vm_NativeError(const char *format, ...);
+
+/**
+ * @brief Suspend the running fiber and run fiber until it yields or returns. For the
+ * resume() native: the native's arguments are dropped and its slot gets what fiber hands
+ * back, once the running fiber is resumed in turn. The native returns straight after,
+ * Vm_Run notices the stack changed and carries on in fiber.
+ *
+ * @param fiber - a new or suspended fiber
+ * @param value - what the yield() fiber is suspended in returns, or the argument of its
+ * function when it is new
+ * @param args - the native's args
+ * @return Value - NIL_VAL, or Vm_NativeError's marker if fiber can't be resumed
+ */
+Value Vm_ResumeFiber(ObjFiber *fiber, Value value, Value *args);
+
+/**
+ * @brief Suspend the running fiber and go back to the one that resumed it, whose resume()
+ * returns value. Same contract as Vm_ResumeFiber, for the yield() native.
+ *
+ * @return Value - NIL_VAL, or Vm_NativeError's marker when called on the main fiber
+ */
+Value Vm_YieldFiber(Value value, Value *args);
 void Vm_Push(Value value);
 Value Vm_Pop();
\ No newline at end of file
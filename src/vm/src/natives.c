@@ -0,0 +1,193 @@
+#include "natives.h"
+
+#include "object.h"
+#include "value.h"
+#include "vm.h"
+
+#include <math.h>
+#include <time.h>
+
+/**
+ * @brief Seconds since some fixed point in the past, from the monotonic clock. Only the
+ * difference between two calls means anything, which is what benchmarks need.
+ */
+static Value clockNative(int argCount, Value *args)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return NUMBER_VAL((double)now.tv_sec + (double)now.tv_nsec / 1e9);
+}
+
+// one argument math natives are all the same apart from the C function they wrap
+#define MATH_NATIVE(name, cFunction)                                  \
+    static Value name##Native(int argCount, Value *args)              \
+    {                                                                 \
+        if (!IS_NUMBER(args[0]))                                      \
+            return Vm_NativeError(#name "() expects a number.");      \
+        return NUMBER_VAL(cFunction(AS_NUMBER(args[0])));             \
+    }
+
+MATH_NATIVE(sqrt, sqrt)
+MATH_NATIVE(floor, floor)
+MATH_NATIVE(abs, fabs)
+
+#undef MATH_NATIVE
+
+/**
+ * @brief min() and max() take any number of arguments, at least one
+ *
+ * @param wantLarger - true for max
+ */
+static Value extremum(const char *name, int argCount, Value *args, bool wantLarger)
+{
+    if (argCount == 0)
+        return Vm_NativeError("%s() expects at least one argument.", name);
+    double result = 0;
+    for (int i = 0; i < argCount; i++)
+    {
+        if (!IS_NUMBER(args[i]))
+            return Vm_NativeError("%s() expects numbers.", name);
+        double value = AS_NUMBER(args[i]);
+        if (i == 0 || (wantLarger ? value > result : value < result))
+            result = value;
+    }
+    return NUMBER_VAL(result);
+}
+
+static Value minNative(int argCount, Value *args)
+{
+    return extremum("min", argCount, args, false);
+}
+
+static Value maxNative(int argCount, Value *args)
+{
+    return extremum("max", argCount, args, true);
+}
+
+/**
+ * @brief Hash of a string. Strings already carry their FNV-1a hash for interning, so this
+ * never has to look at the characters.
+ */
+static Value hashNative(int argCount, Value *args)
+{
+    if (!IS_STRING(args[0]))
+        return Vm_NativeError("hash() expects a string.");
+    return NUMBER_VAL((double)AS_STRING(args[0])->hash);
+}
+
+/**
+ * @brief Fiber(function) makes a fiber that runs function, which takes at most one
+ * argument. Nothing runs until the first resume().
+ */
+static Value fiberNative(int argCount, Value *args)
+{
+    ObjFunction *function = NULL;
+    if (IS_CLOSURE(args[0]))
+        function = AS_CLOSURE(args[0])->function;
+    else if (IS_FUNCTION(args[0]))
+        function = AS_FUNCTION(args[0]);
+    else
+        return Vm_NativeError("Fiber() expects a function.");
+    if (function->arity > 1)
+        return Vm_NativeError("A fiber's function takes at most one argument.");
+    return OBJ_VAL(newFiber(args[0]));
+}
+
+/**
+ * @brief resume(fiber, value) runs fiber until it yields or returns and evaluates to what
+ * it yielded or returned. value, nil if left out, is what the fiber's yield() returns.
+ */
+static Value resumeNative(int argCount, Value *args)
+{
+    if (argCount != 1 && argCount != 2)
+        return Vm_NativeError("resume() expects a fiber and an optional value.");
+    if (!IS_FIBER(args[0]))
+        return Vm_NativeError("resume() expects a fiber.");
+    return Vm_ResumeFiber(AS_FIBER(args[0]), argCount == 2 ? args[1] : NIL_VAL, args);
+}
+
+/**
+ * @brief yield(value) suspends the running fiber, its resume() evaluates to value (nil if
+ * left out). Evaluates to the value of the resume() that continues it.
+ */
+static Value yieldNative(int argCount, Value *args)
+{
+    if (argCount > 1)
+        return Vm_NativeError("yield() expects at most one value.");
+    return Vm_YieldFiber(argCount == 1 ? args[0] : NIL_VAL, args);
+}
+
+// isDone(fiber) is true once the fiber's function has returned
+static Value isDoneNative(int argCount, Value *args)
+{
+    if (!IS_FIBER(args[0]))
+        return Vm_NativeError("isDone() expects a fiber.");
+    return BOOL_VAL(AS_FIBER(args[0])->state == FIBER_DONE);
+}
+
+// len(value) is the number of items of a list or characters of a string
+static Value lenNative(int argCount, Value *args)
+{
+    if (IS_LIST(args[0]))
+        return NUMBER_VAL(AS_LIST(args[0])->count);
+    if (IS_STRING(args[0]))
+        return NUMBER_VAL(AS_STRING(args[0])->length);
+    return Vm_NativeError("len() expects a list or a string.");
+}
+
+// push(list, value) adds value at the end of list
+static Value pushNative(int argCount, Value *args)
+{
+    if (!IS_LIST(args[0]))
+        return Vm_NativeError("push() expects a list.");
+    listAppend(AS_LIST(args[0]), args[1]);
+    return NIL_VAL;
+}
+
+// pop(list) removes the last item of list and evaluates to it
+static Value popNative(int argCount, Value *args)
+{
+    if (!IS_LIST(args[0]))
+        return Vm_NativeError("pop() expects a list.");
+    ObjList *list = AS_LIST(args[0]);
+    if (list->count == 0)
+        return Vm_NativeError("Can't pop from an empty list.");
+    list->count--;
+    return listGet(list, list->count);
+}
+
+/**
+ * @brief sum(list) adds up a list of numbers. A numeric list is a plain double array, the
+ * loop has no tags to check and nothing to unbox.
+ */
+static Value sumNative(int argCount, Value *args)
+{
+    if (!IS_LIST(args[0]))
+        return Vm_NativeError("sum() expects a list.");
+    ObjList *list = AS_LIST(args[0]);
+    if (!list->isNumeric)
+        return Vm_NativeError("sum() expects a list of numbers.");
+    double total = 0;
+    for (int i = 0; i < list->count; i++)
+        total += list->as.numbers[i];
+    return NUMBER_VAL(total);
+}
+
+void Natives_DefineCore()
+{
+    Vm_DefineNative("clock", clockNative, 0);
+    Vm_DefineNative("sqrt", sqrtNative, 1);
+    Vm_DefineNative("floor", floorNative, 1);
+    Vm_DefineNative("abs", absNative, 1);
+    Vm_DefineNative("min", minNative, NATIVE_VARIADIC);
+    Vm_DefineNative("max", maxNative, NATIVE_VARIADIC);
+    Vm_DefineNative("hash", hashNative, 1);
+    Vm_DefineNative("Fiber", fiberNative, 1);
+    Vm_DefineNative("resume", resumeNative, NATIVE_VARIADIC);
+    Vm_DefineNative("yield", yieldNative, NATIVE_VARIADIC);
+    Vm_DefineNative("isDone", isDoneNative, 1);
+    Vm_DefineNative("len", lenNative, 1);
+    Vm_DefineNative("push", pushNative, 2);
+    Vm_DefineNative("pop", popNative, 1);
+    Vm_DefineNative("sum", sumNative, 1);
+}
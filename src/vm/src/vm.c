@@ -5,6 +5,7 @@
 #include "compiler.h"
 #include "debug.h"
 #include "memory.h"
+#include "natives.h"
 #include "object.h"
 #include "value.h"
 
@@ -15,30 +16,125 @@
 // Globally declared virtual machine
 VM vm;
 
+// park the running fiber: the VM's stack and frames go back into it
+static void saveFiber(ObjFiber *fiber)
+{
+    fiber->stack = vm.stack;
+    fiber->stackCapacity = vm.stackCapacity;
+    fiber->stackTop = vm.stackTop;
+    fiber->frames = vm.frames;
+    fiber->frameCount = vm.frameCount;
+    fiber->frameCapacity = vm.frameCapacity;
+    fiber->openUpvalues = vm.openUpvalues;
+    // its stack was written to freely while it ran
+    Memory_Remember((Obj *)fiber);
+}
+
+// make fiber the running one, the running one must have been saved first
+static void loadFiber(ObjFiber *fiber)
+{
+    vm.fiber = fiber;
+    vm.stack = fiber->stack;
+    vm.stackCapacity = fiber->stackCapacity;
+    vm.stackTop = fiber->stackTop;
+    vm.frames = fiber->frames;
+    vm.frameCount = fiber->frameCount;
+    vm.frameCapacity = fiber->frameCapacity;
+    vm.openUpvalues = fiber->openUpvalues;
+}
+
 static void Vm_ResetStack()
 {
+    // an error ends every fiber between the running one and the main one. Their stacks
+    // are kept, closures may still have upvalues open in them
+    while (vm.fiber != vm.mainFiber)
+    {
+        ObjFiber *fiber = vm.fiber;
+        saveFiber(fiber);
+        fiber->state = FIBER_DONE;
+        loadFiber(fiber->resumer);
+        fiber->resumer = NULL;
+    }
     vm.stackTop = vm.stack; // reset stack ptr to first element
+    vm.frameCount = 0;
+    vm.openUpvalues = NULL;
 }
 
-// VARIADIC OOOOOOOOOHHHHHHHHH
-static void runtimeError(const char *format, ...)
+// print where each call in frames is, innermost first
+static void printFrames(CallFrame *frames, int frameCount)
 {
-    va_list args;
-    va_start(args, format);         // create ptr to spot on stack where variable args were stored
-    vfprintf(stderr, format, args); // this is what printf uses under the hood too
-    va_end(args);                   // for portability
+    // each frame's ip is just past the instruction it was running
+    for (int i = frameCount - 1; i >= 0; i--)
+    {
+        CallFrame *frame = &frames[i];
+        ObjFunction *function = frame->function;
+        size_t instruction = frame->ip - function->chunk.code - 1;
+        fprintf(stderr, "[line %d] in ", function->chunk.lines[instruction]);
+        if (function->name == NULL)
+            fprintf(stderr, "script\n");
+        else
+            fprintf(stderr, "%s()\n", function->name->chars);
+    }
+}
+
+/**
+ * @brief Nothing catches vm.exception: print it with the calls it was thrown through, the
+ * running fiber's first and then those of each fiber waiting in a resume() for it, and
+ * reset the stacks.
+ */
+static void reportException()
+{
+    // a runtime error's exception is its message, a thrown string is printed as is too
+    if (IS_STRING(vm.exception))
+        fputs(AS_CSTRING(vm.exception), stderr);
+    else if (IS_NUMBER(vm.exception))
+        fprintf(stderr, "Uncaught exception: %g", AS_NUMBER(vm.exception));
+    else
+        fputs("Uncaught exception.", stderr);
     fputs("\n", stderr);
 
-    size_t instruction = vm.ip - vm.chunk->code - 1;
-    int line = vm.chunk->lines[instruction];
-    fprintf(stderr, "[line %d] in script\n", line);
+    printFrames(vm.frames, vm.frameCount);
+    for (ObjFiber *fiber = vm.fiber->resumer; fiber != NULL; fiber = fiber->resumer)
+        printFrames(fiber->frames, fiber->frameCount);
+    if (vm.trace.enabled)
+        Vm_DumpTrace(stderr);
+    vm.exception = NIL_VAL;
     Vm_ResetStack();
 }
 
-static Value peek(int distance)
+// VARIADIC OOOOOOOOOHHHHHHHHH
+static void raiseError(const char *format, va_list args)
+{
+    // the message becomes the exception, a catch block gets it as a string
+    va_list measure;
+    va_copy(measure, args);
+    int length = vsnprintf(NULL, 0, format, measure); // this is what printf uses under the hood too
+    va_end(measure);
+    ObjString *message = allocateString(length);
+    vsnprintf(message->chars, length + 1, format, args);
+    vm.exception = OBJ_VAL(internString(message));
+}
+
+/**
+ * @brief Raise a runtime error. Nothing is printed yet, the caller hands control to
+ * throwException which finds the catch block or reports it.
+ */
+static void runtimeError(const char *format, ...)
 {
-    // return value froms stakc but don't pop it
-    return vm.stackTop[-1 - distance];
+    va_list args;
+    va_start(args, format); // create ptr to spot on stack where variable args were stored
+    raiseError(format, args);
+    va_end(args);           // for portability
+}
+
+Value Vm_NativeError(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    raiseError(format, args);
+    va_end(args);
+    // never a value a script can see, so it can't be confused with a real result
+    return UNDEFINED_VAL;
 }
 
 /**
@@ -53,294 +149,1653 @@ static bool isFalsey(Value value)
     return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
 }
 
-static void concatenate()
+/**
+ * @brief Record the instruction that was just read in the trace ring buffer. Only ever
+ * called while tracing is on. Vm_Run keeps ip and the stack top in locals, so it hands
+ * them over instead of this reading the (stale) vm fields.
+ *
+ * @param opcode
+ * @param function - function being run
+ * @param offset - offset of the opcode byte in the function's chunk
+ * @param stackDepth - values on the stack before the instruction runs
+ */
+static inline void recordTrace(uint8_t opcode, ObjFunction *function, uint32_t offset,
+                               uint32_t stackDepth)
+{
+    TraceEntry *entry = &vm.trace.entries[vm.trace.count++ & (TRACE_BUFFER_SIZE - 1)];
+    entry->function = function;
+    entry->offset = offset;
+    entry->stackDepth = stackDepth;
+    entry->opcode = opcode;
+}
+
+#ifdef PROFILE_OPCODE_PAIRS
+#include <stdlib.h>
+
+#define OPCODE_PAIR_REPORT_LENGTH 20
+
+// opcodePairCounts[a][b] is how many times opcode b was dispatched right after opcode a.
+// Pairs that keep showing up at the top are the candidates for new superinstructions.
+static uint64_t opcodePairCounts[OP_COUNT][OP_COUNT];
+
+typedef struct
+{
+    uint8_t first;
+    uint8_t second;
+    uint64_t count;
+} OpcodePair;
+
+static int compareOpcodePairs(const void *a, const void *b)
+{
+    uint64_t countA = ((const OpcodePair *)a)->count;
+    uint64_t countB = ((const OpcodePair *)b)->count;
+    return (countA < countB) - (countA > countB); // descending
+}
+
+/**
+ * @brief Print the most frequently executed adjacent opcode pairs to stderr. Pairs are
+ * counted in execution order, so they span jumps; a pair is only fusable when the two
+ * instructions are also adjacent in the bytecode with no jump landing between them.
+ */
+static void printOpcodePairProfile()
+{
+    static OpcodePair pairs[OP_COUNT * OP_COUNT];
+    int pairCount = 0;
+    uint64_t total = 0;
+    for (int first = 0; first < OP_COUNT; first++)
+    {
+        for (int second = 0; second < OP_COUNT; second++)
+        {
+            uint64_t count = opcodePairCounts[first][second];
+            if (count == 0)
+                continue;
+            pairs[pairCount++] = (OpcodePair){(uint8_t)first, (uint8_t)second, count};
+            total += count;
+        }
+    }
+    qsort(pairs, pairCount, sizeof(OpcodePair), compareOpcodePairs);
+
+    fprintf(stderr, "== opcode pair profile: %llu pairs executed ==\n", (unsigned long long)total);
+    for (int i = 0; i < pairCount && i < OPCODE_PAIR_REPORT_LENGTH; i++)
+    {
+        fprintf(stderr, "%12llu %5.1f%%  %-20s -> %s\n", (unsigned long long)pairs[i].count,
+                100.0 * (double)pairs[i].count / (double)total,
+                Debug_OpcodeName(pairs[i].first), Debug_OpcodeName(pairs[i].second));
+    }
+}
+#endif // PROFILE_OPCODE_PAIRS
+
+static const char *globalName(int slot)
+{
+    return AS_CSTRING(vm.globalIdentifiers.values[slot]);
+}
+
+/**
+ * @brief Make room for one more call frame. Frames start out few, so a fiber that never
+ * calls deep stays small. Growing may move them, nothing must hold a CallFrame pointer
+ * across a call.
+ *
+ * @return false if there are FRAMES_MAX already
+ */
+static bool growFrames()
+{
+    if (vm.frameCapacity == FRAMES_MAX)
+        return false;
+    int oldCapacity = vm.frameCapacity;
+    vm.frameCapacity = GROW_CAPACITY(oldCapacity);
+    if (vm.frameCapacity > FRAMES_MAX)
+        vm.frameCapacity = FRAMES_MAX;
+    vm.frames = GROW_ARRAY(CallFrame, vm.frames, oldCapacity, vm.frameCapacity);
+    return true;
+}
+
+/**
+ * @brief Start a call: push a frame whose slots begin at the callee, which the caller
+ * pushed just below its arguments. Nothing is copied, the arguments already are the
+ * callee's first locals.
+ *
+ * @param function - function being called
+ * @param closure - closure wrapping function, NULL when called as a plain function
+ * @param argCount - number of arguments on the stack
+ * @return false if a runtime error was reported
+ */
+static bool call(ObjFunction *function, ObjClosure *closure, int argCount)
 {
-    ObjString *b = AS_STRING(Vm_Pop());
-    ObjString *a = AS_STRING(Vm_Pop());
+    if (argCount != function->arity)
+    {
+        runtimeError("Expected %d arguments but got %d.", function->arity, argCount);
+        return false;
+    }
+    if (vm.frameCount == vm.frameCapacity && !growFrames())
+    {
+        runtimeError("Stack overflow.");
+        return false;
+    }
+    // like the script, the callee's whole stack is reserved up front so its pushes never check
+    if (!Vm_ReserveStack(function->chunk.maxStackDepth))
+    {
+        runtimeError("Stack overflow.");
+        return false;
+    }
+
+    CallFrame *frame = &vm.frames[vm.frameCount++];
+    frame->function = function;
+    frame->closure = closure;
+    frame->ip = function->chunk.code;
+    frame->slots = vm.stackTop - argCount - 1;
+    return true;
+}
 
-    int length = a->length + b->length;             // calculate length of the two strings to be concatenated
-    char *chars = ALLOCATE(char, length + 1);       // allocate char array for the whole new string
-    memcpy(chars, a->chars, a->length);             // copy chars from first string into allocated memory
-    memcpy(chars + a->length, b->chars, b->length); // same process for second string
-    chars[length] = '\0';                           // NULL TERMINATE YOUR STRINGS
+// call a method: a plain function, or a closure if it captures anything
+static bool callMethod(Value method, int argCount)
+{
+    if (IS_CLOSURE(method))
+        return call(AS_CLOSURE(method)->function, AS_CLOSURE(method), argCount);
+    return call(AS_FUNCTION(method), NULL, argCount);
+}
 
-    ObjString *result = takeString(chars, length);
-    Vm_Push(OBJ_VAL(result));
+static bool callValue(Value callee, int argCount)
+{
+    if (IS_BOUND_METHOD(callee))
+    {
+        // the receiver takes the callee's slot, that is where the method finds 'this'
+        ObjBoundMethod *bound = AS_BOUND_METHOD(callee);
+        vm.stackTop[-argCount - 1] = bound->receiver;
+        return callMethod(bound->method, argCount);
+    }
+    if (IS_CLASS(callee))
+    {
+        ObjClass *klass = AS_CLASS(callee);
+        vm.stackTop[-argCount - 1] = OBJ_VAL(newInstance(klass));
+        Value initializer;
+        if (tableGet(&klass->methods, vm.initString, &initializer))
+            return callMethod(initializer, argCount);
+        if (argCount != 0)
+        {
+            runtimeError("Expected 0 arguments but got %d.", argCount);
+            return false;
+        }
+        return true;
+    }
+    if (IS_CLOSURE(callee))
+        return call(AS_CLOSURE(callee)->function, AS_CLOSURE(callee), argCount);
+    if (IS_FUNCTION(callee))
+        return call(AS_FUNCTION(callee), NULL, argCount);
+    runtimeError("Can only call functions.");
+    return false;
+}
+
+/**
+ * @brief Find or create the upvalue for a stack slot. There is only ever one open upvalue
+ * per slot, so closures capturing the same variable see each other's assignments.
+ *
+ * @param local - stack slot of the captured variable
+ * @return ObjUpvalue*
+ */
+static ObjUpvalue *captureUpvalue(Value *local)
+{
+    ObjUpvalue *prevUpvalue = NULL;
+    ObjUpvalue *upvalue = vm.openUpvalues;
+    while (upvalue != NULL && upvalue->location > local)
+    {
+        prevUpvalue = upvalue;
+        upvalue = upvalue->next;
+    }
+    if (upvalue != NULL && upvalue->location == local)
+        return upvalue;
+
+    ObjUpvalue *createdUpvalue = newUpvalue(local);
+    createdUpvalue->fiber = vm.fiber;
+    createdUpvalue->next = upvalue;
+    if (prevUpvalue == NULL)
+        vm.openUpvalues = createdUpvalue;
+    else
+        prevUpvalue->next = createdUpvalue;
+    return createdUpvalue;
+}
+
+/**
+ * @brief Move every variable at or above last off the stack and into its upvalue.
+ *
+ * @param last - lowest stack slot going away
+ */
+static void closeUpvalues(Value *last)
+{
+    while (vm.openUpvalues != NULL && vm.openUpvalues->location >= last)
+    {
+        ObjUpvalue *upvalue = vm.openUpvalues;
+        upvalue->closed = *upvalue->location;
+        upvalue->location = &upvalue->closed;
+        upvalue->fiber = NULL;
+        writeBarrier((Obj *)upvalue, upvalue->closed);
+        vm.openUpvalues = upvalue->next;
+    }
+}
+
+/**
+ * @brief Start a call that replaces the running frame, for 'return f(...)'. The callee and
+ * its arguments are moved down to where the caller's frame starts, so a chain of tail
+ * calls runs in constant stack space. The caller's frame goes away, it doesn't show up in
+ * error reports either.
+ *
+ * @return false if a runtime error was reported
+ */
+static bool tailCall(ObjFunction *function, ObjClosure *closure, int argCount)
+{
+    // checked while the caller is still there to blame
+    if (argCount != function->arity)
+    {
+        runtimeError("Expected %d arguments but got %d.", function->arity, argCount);
+        return false;
+    }
+
+    CallFrame *frame = &vm.frames[vm.frameCount - 1];
+    if (vm.openUpvalues != NULL)
+        closeUpvalues(frame->slots);
+    Value *callee = vm.stackTop - argCount - 1;
+    memmove(frame->slots, callee, sizeof(Value) * (argCount + 1));
+    vm.stackTop = frame->slots + argCount + 1;
+    vm.frameCount--;
+    return call(function, closure, argCount);
+}
+
+/**
+ * @brief Call a new fiber's function on its own stack, which is empty and loaded. The
+ * stack is allocated just big enough for that call, it grows like any other if the
+ * function calls deeper.
+ *
+ * @param value - the function's argument, if it takes one
+ * @return false if a runtime error was reported
+ */
+static bool startFiber(ObjFiber *fiber, Value value)
+{
+    ObjClosure *closure = IS_CLOSURE(fiber->function) ? AS_CLOSURE(fiber->function) : NULL;
+    ObjFunction *function = closure != NULL ? closure->function : AS_FUNCTION(fiber->function);
+    int argCount = function->arity;
+    // value was above the resumer's stack top, nothing else keeps it alive while the new
+    // stack is allocated
+    if (IS_OBJ(value))
+        Memory_PushRoot(AS_OBJ(value));
+    bool reserved = Vm_ReserveStack(1 + argCount + function->chunk.maxStackDepth);
+    if (IS_OBJ(value))
+        Memory_PopRoot();
+    if (!reserved)
+    {
+        runtimeError("Stack overflow.");
+        return false;
+    }
+    Vm_Push(fiber->function);
+    if (argCount == 1)
+        Vm_Push(value);
+    return call(function, closure, argCount);
+}
+
+/**
+ * @brief The running fiber is done, its function returned or threw. It lets go of its
+ * stack and frames straight away and its resumer carries on, in the resume() call that
+ * ran it.
+ */
+static void retireFiber()
+{
+    ObjFiber *fiber = vm.fiber;
+    // after a return nothing is open any more, after a throw closures may still point here
+    closeUpvalues(vm.stack);
+    FREE_ARRAY(Value, vm.stack - STACK_GUARD, vm.stackCapacity + STACK_GUARD);
+    FREE_ARRAY(CallFrame, vm.frames, vm.frameCapacity);
+    vm.stack = vm.stackTop = NULL;
+    vm.stackCapacity = 0;
+    vm.frames = NULL;
+    vm.frameCount = vm.frameCapacity = 0;
+    saveFiber(fiber);
+    fiber->state = FIBER_DONE;
+
+    loadFiber(fiber->resumer);
+    fiber->resumer = NULL;
+}
+
+/**
+ * @brief The try block around the instruction frame is running, innermost first.
+ *
+ * @return ExceptionHandler* - NULL if the instruction isn't in one
+ */
+static ExceptionHandler *findHandler(CallFrame *frame)
+{
+    Chunk *chunk = &frame->function->chunk;
+    uint32_t offset = (uint32_t)(frame->ip - chunk->code - 1);
+    for (int i = 0; i < chunk->handlerCount; i++)
+    {
+        ExceptionHandler *handler = &chunk->handlers[i];
+        if (offset >= handler->start && offset < handler->end)
+            return handler;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Throw vm.exception from where the running frame is. The frames, innermost first,
+ * and then the fibers waiting in resume() are searched for a try block around the
+ * instruction they are running. Only once one is found is anything unwound, so an
+ * exception nothing catches is reported with every frame it came through. Fibers it
+ * passes through are done, it is thrown on out of the resume() in their resumer.
+ *
+ * This is the only place that looks at the exception tables, code that doesn't throw
+ * never pays for a try block.
+ *
+ * @return false if nothing catches it, it was reported and the stacks reset. Otherwise
+ * the frame with the catch block is the running one, ip on the handler and the exception
+ * on top of the stack
+ */
+static bool throwException()
+{
+    bool caught = false;
+    for (ObjFiber *fiber = vm.fiber; fiber != NULL && !caught; fiber = fiber->resumer)
+    {
+        CallFrame *frames = fiber == vm.fiber ? vm.frames : fiber->frames;
+        int frameCount = fiber == vm.fiber ? vm.frameCount : fiber->frameCount;
+        for (int i = frameCount - 1; i >= 0 && !caught; i--)
+            caught = findHandler(&frames[i]) != NULL;
+    }
+    if (!caught)
+    {
+        reportException();
+        return false;
+    }
+
+    for (;;)
+    {
+        for (; vm.frameCount > 0; vm.frameCount--)
+        {
+            CallFrame *frame = &vm.frames[vm.frameCount - 1];
+            ExceptionHandler *handler = findHandler(frame);
+            if (handler == NULL)
+            {
+                closeUpvalues(frame->slots);
+                continue;
+            }
+            // the locals of the try block (and what its code had pushed) go, the
+            // exception takes the first slot above the rest as the catch variable
+            Value *catchSlot = frame->slots + handler->stackDepth;
+            closeUpvalues(catchSlot);
+            *catchSlot = vm.exception;
+            vm.stackTop = catchSlot + 1;
+            frame->ip = frame->function->chunk.code + handler->handler;
+            vm.exception = NIL_VAL;
+            return true;
+        }
+        retireFiber();
+    }
+}
+
+// the caches being filled are the running function's, it holds what they refer to
+static inline void rememberCaches()
+{
+    Memory_Remember((Obj *)vm.frames[vm.frameCount - 1].function);
+}
+
+// remember where instances with shape keep the property a cache's site accesses
+static void cacheProperty(PropertyCache *cache, ObjShape *shape, ObjShape *newShape, int index)
+{
+    rememberCaches();
+    PropertyCacheEntry *entry = &cache->entries[cache->next];
+    cache->next = (cache->next + 1) % PROPERTY_CACHE_WAYS;
+    entry->shape = shape;
+    entry->newShape = newShape;
+    entry->index = (uint32_t)index;
+}
+
+// the entry of cache for shape, NULL on a miss
+static inline PropertyCacheEntry *findCacheEntry(PropertyCache *cache, ObjShape *shape)
+{
+    for (int i = 0; i < PROPERTY_CACHE_WAYS; i++)
+    {
+        if (cache->entries[i].shape == shape)
+            return &cache->entries[i];
+    }
+    return NULL;
+}
+
+// remember which method an invoke site calls for receivers of klass with shape
+static void cacheMethod(PropertyCache *cache, ObjShape *shape, ObjClass *klass, Value method)
+{
+    rememberCaches();
+    PropertyCacheEntry *entry = &cache->entries[cache->next];
+    cache->next = (cache->next + 1) % PROPERTY_CACHE_WAYS;
+    entry->shape = shape;
+    entry->klass = klass;
+    entry->method = method;
+}
+
+// the entry of an invoke site's cache for receivers of klass with shape, NULL on a miss
+static inline PropertyCacheEntry *findMethodEntry(PropertyCache *cache, ObjShape *shape,
+                                                  ObjClass *klass)
+{
+    for (int i = 0; i < PROPERTY_CACHE_WAYS; i++)
+    {
+        if (cache->entries[i].klass == klass && cache->entries[i].shape == shape)
+            return &cache->entries[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Property read that missed its cache: look the field up in the instance's shape
+ * and cache it, or else bind the method of that name. The top of the stack, the instance,
+ * is replaced by the result.
+ *
+ * @return false if a runtime error was reported
+ */
+static bool getPropertySlow(PropertyCache *cache, ObjString *name)
+{
+    ObjInstance *instance = AS_INSTANCE(vm.stackTop[-1]);
+    int index = shapeFieldIndex(instance->shape, name);
+    if (index != -1)
+    {
+        cacheProperty(cache, instance->shape, instance->shape, index);
+        vm.stackTop[-1] = instance->fields[index];
+        return true;
+    }
+
+    Value method;
+    if (!tableGet(&instance->klass->methods, name, &method))
+    {
+        runtimeError("Undefined property '%s'.", name->chars);
+        return false;
+    }
+    vm.stackTop[-1] = OBJ_VAL(newBoundMethod(vm.stackTop[-1], method));
+    return true;
+}
+
+/**
+ * @brief Property write that missed its cache. Adding a field moves the instance to a
+ * child shape, the cache remembers that transition too so the next instance built the
+ * same way takes it without a lookup. Leaves the value on top, the instance goes.
+ */
+static void setPropertySlow(PropertyCache *cache, ObjString *name)
+{
+    ObjInstance *instance = AS_INSTANCE(vm.stackTop[-2]);
+    Value value = vm.stackTop[-1];
+    ObjShape *shape = instance->shape;
+    int index = shapeFieldIndex(shape, name);
+    if (index != -1)
+    {
+        cacheProperty(cache, shape, shape, index);
+        instance->fields[index] = value;
+        writeBarrier((Obj *)instance, value);
+    }
+    else
+    {
+        ObjShape *newShape = shapeAddField(shape, name);
+        cacheProperty(cache, shape, newShape, newShape->fieldCount - 1);
+        instanceAddField(instance, newShape, value);
+    }
+    vm.stackTop[-2] = value;
+    vm.stackTop--;
+}
+
+/**
+ * @brief Invoke that missed its cache and found no field of that name, so it calls the
+ * class' method. The receiver stays in the callee's slot, it becomes the method's 'this'.
+ *
+ * @return false if a runtime error was reported
+ */
+static bool invokeFromClass(PropertyCache *cache, ObjInstance *instance, ObjString *name,
+                            int argCount)
+{
+    Value method;
+    if (!tableGet(&instance->klass->methods, name, &method))
+    {
+        runtimeError("Undefined property '%s'.", name->chars);
+        return false;
+    }
+    cacheMethod(cache, instance->shape, instance->klass, method);
+    return callMethod(method, argCount);
+}
+
+static void concatenate()
+{
+    // both stay on the stack until the result exists, the allocation may collect
+    ObjString *b = AS_STRING(vm.stackTop[-1]);
+    ObjString *a = AS_STRING(vm.stackTop[-2]);
+
+    ObjString *result = concatenateStrings(a, b);
+    vm.stackTop--;
+    vm.stackTop[-1] = OBJ_VAL(result);
 }
 
 /**
  * @brief
  * MOST important function by far in program. Majority of execution will
  * be spent inside of here
+ *
+ * The hot interpreter state is kept in locals so the C compiler can keep it in machine
+ * registers instead of going through the global vm on every operand:
+ *
+ *  - frame, and its ip and slots: the running call, see CallFrame. The captured variables
+ *         of a function without a closure are in frame[-1], its caller's slots
+ *  - ip:  next byte to execute, frame->ip
+ *  - sp:  the stack slot the top value belongs in, vm.stackTop - 1
+ *  - tos: the top value itself. It is cached, *sp is NOT kept up to date. A push spills
+ *         it to *sp before moving up, a pop reloads it from the slot below.
+ *
+ * So a binary op is one load (the left operand) and no store at all. With an empty stack
+ * sp points at the guard slot below vm.stack (see Vm_ReserveStack), which is what the
+ * first push spills the meaningless tos into.
+ *
+ * frame->ip/vm.stackTop are only written back (STORE_FRAME) where something outside this
+ * function looks at them: calls, runtime errors and string allocation.
  */
 static InterpretResult Vm_Run()
 {
+    CallFrame *frame = &vm.frames[vm.frameCount - 1];
+    uint8_t *ip = frame->ip;
+    Value *slots = frame->slots; // locals are addressed from the start of the frame
+    Value *sp = vm.stackTop - 1;
+    Value tos = *sp;
 
     // Read byte pointed to by ip and advance ip
-    #define READ_BYTE() (*vm.ip++)
+    #define READ_BYTE() (*ip++)
     /*
         Read next byte, treat this byte as an index and look up the
         corresponding Value in the chunk's constant table
     */
-    #define READ_CONSTANT() (vm.chunk->constants.values[READ_BYTE()])
+    #define READ_CONSTANT() (frame->function->chunk.constants.values[READ_BYTE()])
     // yank next two bytes from chunk and build 16 bit integer from them
     #define READ_SHORT() \
-        (vm.ip += 2, (uint16_t)((vm.ip[-2] << 8) | vm.ip[-1]))
+        (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+    // operand of the *_LONG instructions, same byte order as READ_SHORT
+    #define READ_UINT24() \
+        (ip += 3, (uint32_t)((ip[-3] << 16) | (ip[-2] << 8) | ip[-1]))
+    #define READ_CONSTANT_LONG() (frame->function->chunk.constants.values[READ_UINT24()])
+
+    // spill the old top into its slot, then the new value becomes the top. value is only
+    // evaluated after the spill, so PUSH(slots[n]) sees an up to date slot even when n is
+    // the slot that was on top
+    #define PUSH(value) (*sp++ = tos, tos = (value))
+    // discard the top, the value below it becomes the cached top
+    #define DROP() (tos = *--sp)
+    // hand the cached state back to the vm before anything else looks at it, and pick
+    // it up again afterwards (the callee may have pushed and popped, or be a new frame)
+    #define STORE_FRAME() (frame->ip = ip, *sp = tos, vm.stackTop = sp + 1)
+    #define LOAD_FRAME()                                  \
+        (frame = &vm.frames[vm.frameCount - 1],           \
+         ip = frame->ip, slots = frame->slots,            \
+         sp = vm.stackTop - 1, tos = *sp)
+    // vm.exception was raised with the frame stored: carry on in the catch block that
+    // gets it, if there is one
+    #define THROW()                                 \
+        do                                          \
+        {                                           \
+            if (!throwException())                  \
+                return INTERPRET_RUNTIME_ERROR;     \
+            LOAD_FRAME();                           \
+            DISPATCH();                             \
+        } while (false)
+    #define RUNTIME_ERROR(...)                \
+        do                                    \
+        {                                     \
+            STORE_FRAME();                    \
+            runtimeError(__VA_ARGS__);        \
+            THROW();                          \
+        } while (false)
+    // a list index is a whole number from 0 to count - 1
+    #define CHECK_INDEX(list, index)                                        \
+        do                                                                  \
+        {                                                                   \
+            if (!IS_NUMBER(index))                                          \
+                RUNTIME_ERROR("List index must be a number.");              \
+            double i = AS_NUMBER(index);                                    \
+            if (!(i >= 0 && i < (list)->count) || i != (int)i)              \
+                RUNTIME_ERROR("List index out of range.");                  \
+        } while (false)
+    // concatenate allocates, which is where a collector will want to see the stack
+    #define CONCATENATE()       \
+        do                      \
+        {                       \
+            STORE_FRAME();      \
+            concatenate();      \
+            LOAD_FRAME();       \
+        } while (false)
+    // call the callee below the argCount arguments on top, the frame must be stored
+    #define CALL_VALUE(callee, argCount)                                                    \
+        do                                                                                  \
+        {                                                                                   \
+            Value calleeValue = (callee);                                                   \
+            if (IS_NATIVE(calleeValue))                                                     \
+            {                                                                               \
+                /* no frame: the native reads its arguments where they are and we put */    \
+                /* the result where the callee was */                                       \
+                ObjNative *native = AS_NATIVE(calleeValue);                                 \
+                if (native->arity != (argCount) && native->arity != NATIVE_VARIADIC)        \
+                    RUNTIME_ERROR("Expected %d arguments but got %d.", native->arity,       \
+                                  (argCount));                                              \
+                Value result = native->function((argCount), vm.stackTop - (argCount));      \
+                if (IS_UNDEFINED(result))                                                   \
+                    THROW(); /* already raised */                                   \
+                if (vm.stackTop != sp + 1)                                                  \
+                {                                                                           \
+                    /* resume() or yield(): another fiber's stack is loaded, run it */      \
+                    LOAD_FRAME();                                                           \
+                    break;                                                                  \
+                }                                                                           \
+                sp -= (argCount);                                                           \
+                tos = result;                                                               \
+            }                                                                               \
+            else                                                                            \
+            {                                                                               \
+                if (!callValue(calleeValue, (argCount)))                                    \
+                    THROW();                                                                \
+                LOAD_FRAME(); /* now running the callee */                                  \
+            }                                                                               \
+        } while (false)
+    // the property ops come in a one byte and a 24 bit cache index form, both share these
+    #define GET_PROPERTY(cacheOperand)                                                  \
+        do                                                                              \
+        {                                                                               \
+            PropertyCache *cache = &frame->function->chunk.caches[(cacheOperand)];      \
+            if (!IS_INSTANCE(tos))                                                      \
+                RUNTIME_ERROR("Only instances have properties.");                       \
+            ObjInstance *instance = AS_INSTANCE(tos);                                   \
+            PropertyCacheEntry *entry = findCacheEntry(cache, instance->shape);         \
+            if (entry != NULL)                                                          \
+            {                                                                           \
+                tos = instance->fields[entry->index];                                   \
+                break;                                                                  \
+            }                                                                           \
+            STORE_FRAME();                                                              \
+            if (!getPropertySlow(cache, PROPERTY_NAME(cache)))                          \
+                THROW();                                                                \
+            LOAD_FRAME();                                                               \
+        } while (false)
+    #define SET_PROPERTY(cacheOperand)                                                  \
+        do                                                                              \
+        {                                                                               \
+            PropertyCache *cache = &frame->function->chunk.caches[(cacheOperand)];      \
+            if (!IS_INSTANCE(sp[-1]))                                                   \
+                RUNTIME_ERROR("Only instances have fields.");                           \
+            ObjInstance *instance = AS_INSTANCE(sp[-1]);                                \
+            PropertyCacheEntry *entry = findCacheEntry(cache, instance->shape);         \
+            if (entry != NULL && entry->newShape == instance->shape)                    \
+            {                                                                           \
+                instance->fields[entry->index] = tos;                                   \
+                writeBarrier((Obj *)instance, tos);                                     \
+                sp--;                                                                   \
+                break;                                                                  \
+            }                                                                           \
+            STORE_FRAME();                                                              \
+            if (entry != NULL)                                                          \
+            {                                                                           \
+                /* a cached transition, the field array may have to grow */             \
+                instanceAddField(instance, entry->newShape, tos);                       \
+                sp--;                                                                   \
+                break;                                                                  \
+            }                                                                           \
+            setPropertySlow(cache, PROPERTY_NAME(cache));                               \
+            LOAD_FRAME();                                                               \
+        } while (false)
+    // 'receiver.name(args)' with the receiver below the argCount arguments on top. A
+    // cached method is called straight away, no bound method is ever made
+    #define INVOKE(cacheOperand, argCount)                                              \
+        do                                                                              \
+        {                                                                               \
+            PropertyCache *cache = &frame->function->chunk.caches[(cacheOperand)];      \
+            int invokeArgs = (argCount);                                                \
+            Value receiver = invokeArgs == 0 ? tos : sp[-invokeArgs];                   \
+            if (!IS_INSTANCE(receiver))                                                 \
+                RUNTIME_ERROR("Only instances have methods.");                          \
+            ObjInstance *instance = AS_INSTANCE(receiver);                              \
+            PropertyCacheEntry *entry =                                                 \
+                findMethodEntry(cache, instance->shape, instance->klass);               \
+            STORE_FRAME();                                                              \
+            if (entry != NULL)                                                          \
+            {                                                                           \
+                if (!callMethod(entry->method, invokeArgs))                             \
+                    THROW();                                                            \
+                LOAD_FRAME();                                                           \
+                break;                                                                  \
+            }                                                                           \
+            /* a field of that name shadows the method, it is called like a variable */ \
+            int index = shapeFieldIndex(instance->shape, PROPERTY_NAME(cache));         \
+            if (index != -1)                                                            \
+            {                                                                           \
+                Value field = instance->fields[index];                                  \
+                vm.stackTop[-invokeArgs - 1] = field;                                   \
+                CALL_VALUE(field, invokeArgs);                                          \
+                break;                                                                  \
+            }                                                                           \
+            if (!invokeFromClass(cache, instance, PROPERTY_NAME(cache), invokeArgs))    \
+                THROW();                                                                \
+            LOAD_FRAME();                                                               \
+        } while (false)
+    // [this, args..., superclass], the method is found in the superclass directly
+    #define SUPER_INVOKE(cacheOperand, argCount)                                        \
+        do                                                                              \
+        {                                                                               \
+            PropertyCache *cache = &frame->function->chunk.caches[(cacheOperand)];      \
+            int superArgs = (argCount);                                                 \
+            ObjClass *superclass = AS_CLASS(tos);                                       \
+            DROP();                                                                     \
+            PropertyCacheEntry *entry = findMethodEntry(cache, NULL, superclass);       \
+            Value method;                                                               \
+            if (entry != NULL)                                                          \
+                method = entry->method;                                                 \
+            else if (tableGet(&superclass->methods, PROPERTY_NAME(cache), &method))     \
+                cacheMethod(cache, NULL, superclass, method);                           \
+            else                                                                        \
+                RUNTIME_ERROR("Undefined property '%s'.", PROPERTY_NAME(cache)->chars); \
+            STORE_FRAME();                                                              \
+            if (!callMethod(method, superArgs))                                         \
+                THROW();                                                                \
+            LOAD_FRAME();                                                               \
+        } while (false)
+    #define PROPERTY_NAME(cache) AS_STRING(frame->function->chunk.constants.values[(cache)->name])
+    #define DEFINE_METHOD(nameValue)                                                    \
+        do                                                                              \
+        {                                                                               \
+            ObjClass *klass = AS_CLASS(sp[-1]);                                         \
+            STORE_FRAME(); /* the table may grow */                                     \
+            tableSet(&klass->methods, AS_STRING(nameValue), tos);                       \
+            writeBarrier((Obj *)klass, tos);                                            \
+            DROP();                                                                     \
+        } while (false)
+    // [this, superclass] -> the superclass' method bound to this
+    #define GET_SUPER(nameValue)                                                        \
+        do                                                                              \
+        {                                                                               \
+            ObjString *name = AS_STRING(nameValue);                                     \
+            Value method;                                                               \
+            if (!tableGet(&AS_CLASS(tos)->methods, name, &method))                      \
+                RUNTIME_ERROR("Undefined property '%s'.", name->chars);                 \
+            DROP();                                                                     \
+            STORE_FRAME();                                                              \
+            ObjBoundMethod *bound = newBoundMethod(tos, method);                        \
+            tos = OBJ_VAL(bound);                                                       \
+        } while (false)
+    // where captured variable index of the running function is, see ObjFunction
+    #define UPVALUE(index)                                                      \
+        (frame->closure != NULL                                               \
+             ? frame->closure->upvalues[(index)]->location                    \
+             : &frame[-1].slots[frame->function->upvalues[(index)].index])
+    // wrap the function constant in a closure, capturing from the running frame. The
+    // captured locals must be in memory for that, so the frame is stored first. The
+    // closure is pushed before capturing allocates upvalues, so a collection finds it
+    #define MAKE_CLOSURE(functionValue)                                         \
+        do                                                                      \
+        {                                                                       \
+            ObjFunction *function = AS_FUNCTION(functionValue);                 \
+            STORE_FRAME();                                                      \
+            ObjClosure *closure = newClosure(function);                         \
+            PUSH(OBJ_VAL(closure));                                             \
+            STORE_FRAME();                                                      \
+            for (int i = 0; i < closure->upvalueCount; i++)                     \
+            {                                                                   \
+                uint8_t index = function->upvalues[i].index;                    \
+                if (function->upvalues[i].isLocal)                              \
+                    closure->upvalues[i] = captureUpvalue(slots + index);       \
+                else                                                            \
+                    closure->upvalues[i] = frame->closure->upvalues[index];     \
+                /* the closure may have grown old in an earlier capture */      \
+                writeBarrier((Obj *)closure, OBJ_VAL(closure->upvalues[i]));    \
+            }                                                                   \
+        } while (false)
+
     // funny looking syntax here, but gives you a way to contain multiple statements
     // inside a block that also permits a semicolon at the end.
-    #define BINARY_OP(valueType, op)                        \
+    #define BINARY_OP(valueType, op, quickOp)               \
         do                                                  \
         {                                                   \
-            if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) \
-            {                                               \
-                runtimeError("Operands must be numbers.");  \
-                return INTERPRET_RUNTIME_ERROR;             \
-            }                                               \
-            double b = AS_NUMBER(Vm_Pop());                 \
-            double a = AS_NUMBER(Vm_Pop());                 \
-            Vm_Push(valueType(a op b));                     \
+            if (!IS_NUMBER(tos) || !IS_NUMBER(sp[-1]))      \
+                RUNTIME_ERROR("Operands must be numbers."); \
+            QUICKEN(quickOp);                               \
+            double b = AS_NUMBER(tos);                      \
+            double a = AS_NUMBER(*--sp);                    \
+            tos = valueType(a op b);                        \
+        } while (false)
+    #define NEGATED_COMPARE(op)                             \
+        do                                                  \
+        {                                                   \
+            if (!IS_NUMBER(tos) || !IS_NUMBER(sp[-1]))      \
+                RUNTIME_ERROR("Operands must be numbers."); \
+            double b = AS_NUMBER(tos);                      \
+            double a = AS_NUMBER(*--sp);                    \
+            tos = BOOL_VAL(!(a op b));                      \
+        } while (false)
+    /*
+        Quickening. The first time a generic arithmetic/comparison instruction runs it
+        patches its own opcode byte (the one just read, at ip - 1) to a form specialized
+        for the operand types it saw. The specialized form only re-checks that guess
+        and, if the guess is wrong, writes the generic opcode back and re-dispatches to
+        it so the slow path (and its error reporting) lives in exactly one place.
+    */
+    #define QUICKEN(quickOp) (ip[-1] = (quickOp))
+    #define DEQUICKEN(genericOp)     \
+        do                           \
+        {                            \
+            ip[-1] = (genericOp);    \
+            ip--;                    \
+            DISPATCH();              \
+        } while (false)
+    #define NUMBER_OP(valueType, op, genericOp)                             \
+        do                                                                  \
+        {                                                                   \
+            Value a = sp[-1];                                               \
+            if (!IS_NUMBER(a) || !IS_NUMBER(tos))                           \
+                DEQUICKEN(genericOp);                                       \
+            sp--;                                                           \
+            tos = valueType(AS_NUMBER(a) op AS_NUMBER(tos));                \
         } while (false)
-    #define READ_STRING() AS_STRING(READ_CONSTANT())
 
-        for (;;)
-        {
+    #ifdef PROFILE_OPCODE_PAIRS
+        #define PROFILE_INSTRUCTION()                                      \
+            do                                                             \
+            {                                                              \
+                if (previousOpcode >= 0)                                   \
+                    opcodePairCounts[previousOpcode][instruction]++;       \
+                previousOpcode = instruction;                              \
+            } while (false)
+        int previousOpcode = -1;
+    #else
+        #define PROFILE_INSTRUCTION() do { } while (false)
+    #endif // end PROFILE_OPCODE_PAIRS
+
+    #define TRACE_INSTRUCTION()                                                     \
+        recordTrace(instruction, frame->function,                                   \
+                    (uint32_t)(ip - frame->function->chunk.code - 1),               \
+                    (uint32_t)(sp + 1 - vm.stack))
+
     /*
-        With this enabled the VM will print out the current state of the stack and
-        the current instruction being executed. This is useful for debugging the VM
+        Bytecode dispatch. Grab byte pointed to by ip, advance ip and get to the C code
+        that implements the instruction's semantics. MOST IMPORTANT PART OF INTERPRETER
+        from a performance perspective.
+
+        With computed gotos every handler ends in its OWN indirect jump through
+        dispatchTable, so the branch predictor learns "what follows OP_X" per opcode
+        instead of sharing one mispredicting jump at the top of a switch. The switch is
+        kept for compilers without labels-as-values.
+
+        Tracing swaps the whole table: traceDispatchTable sends every opcode through
+        the recorder first and then on to the real handler. With tracing off the
+        handlers never see it, there is no per-instruction check at all. The switch
+        loop has to check a flag instead.
     */
-    #ifdef DEBUG_TRACE_EXECUTION
-            char buffer[100];
-            snprintf(buffer, sizeof(buffer), "Num Values on stack: %lu\n", (vm.stackTop - vm.stack));
-            Print_Color(buffer, STACK_ANSI_COLOR_CYAN); // 32 is the color code for green
-            // printf("Num Values on stack: %lu\n", (vm.stackTop - vm.stack));
-            for (Value *slot = vm.stack; slot < vm.stackTop; slot++)
-            {
+    #ifdef USE_COMPUTED_GOTO
+        #define OPCODE_LABEL(name, operandBytes, stackEffect) &&label_##name,
+        static void *dispatchTable[] = {OPCODE_LIST(OPCODE_LABEL)};
+        #undef OPCODE_LABEL
+        _Static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == OP_COUNT,
+                       "dispatchTable must have one entry per opcode");
+        #define OPCODE_TRACE_LABEL(name, operandBytes, stackEffect) &&traceInstruction,
+        static void *traceDispatchTable[] = {OPCODE_LIST(OPCODE_TRACE_LABEL)};
+        #undef OPCODE_TRACE_LABEL
+        void **dispatch = vm.trace.enabled ? traceDispatchTable : dispatchTable;
 
-                Print_Color("[ ", STACK_ANSI_COLOR_CYAN);
-                Value_printValue(*slot, STACK_ANSI_COLOR_CYAN);
-                Print_Color(" ]", STACK_ANSI_COLOR_CYAN);
-            }
-            printf("\n");
-            // Grab relative offset of ip from beginning of bytecide
-            Debug_disassembleInstruction(vm.chunk, (int)(vm.ip - vm.chunk->code));
-    #endif // end DEBUG_TRACE_EXECUTION
-
-        uint8_t instruction;
-        /* grab byte pointed to by ip and advance ip
-           given opcode, get right C code that implements instruction's semantics
-           First byte of instruction will always be opcode. This process is bytecode dispacth
-           MOST IMPORTANT PART OF INTERPRETER from a performance perspective
-        */
-        switch (instruction = READ_BYTE())
-        {
-            case OP_CONSTANT:
-            {
-                Value constant = READ_CONSTANT();
-                Vm_Push(constant);
-                printf("\n");
-                break;
-            }
-            case OP_NIL:
-                Vm_Push(NIL_VAL);
-                break;
-            case OP_TRUE:
-                Vm_Push(BOOL_VAL(true));
-                break;
-            case OP_FALSE:
-                Vm_Push(BOOL_VAL(false));
-                break;
-            case OP_POP:
-                Vm_Pop();
-                break;
-            case OP_GET_LOCAL:
-            {
-                uint8_t slot = READ_BYTE();
-                Vm_Push(vm.stack[slot]);
-                break;
-            }
-            case OP_SET_LOCAL:
-            {
-                uint8_t slot = READ_BYTE();
-                vm.stack[slot] = peek(0);
-                break;
-            }
-            case OP_GET_GLOBAL:
+        #define INTERPRET_LOOP                        \
+            DISPATCH();                               \
+            traceInstruction:                         \
+            TRACE_INSTRUCTION();                      \
+            goto *dispatchTable[instruction];
+        #define CASE_CODE(name) label_##name
+        #define DISPATCH()                            \
+            do                                        \
+            {                                         \
+                instruction = READ_BYTE();            \
+                PROFILE_INSTRUCTION();                \
+                goto *dispatch[instruction];          \
+            } while (false)
+    #else
+        #define INTERPRET_LOOP             \
+            loop:                          \
+            instruction = READ_BYTE();     \
+            PROFILE_INSTRUCTION();         \
+            if (vm.trace.enabled)          \
+                TRACE_INSTRUCTION();       \
+            switch (instruction)
+        #define CASE_CODE(name) case name
+        #define DISPATCH() goto loop
+    #endif // end USE_COMPUTED_GOTO
+
+    // the global ops come in a one byte and a 24 bit slot form, both share these bodies
+    #define GET_GLOBAL(slotOperand)                                               \
+        do                                                                        \
+        {                                                                         \
+            uint32_t slot = (slotOperand);                                        \
+            Value value = vm.globalValues.values[slot];                           \
+            if (IS_UNDEFINED(value))                                              \
+                RUNTIME_ERROR("Undefined variable '%s'.", globalName(slot));      \
+            PUSH(value);                                                          \
+        } while (false)
+    #define DEFINE_GLOBAL(slotOperand)                                            \
+        do                                                                        \
+        {                                                                         \
+            vm.globalValues.values[(slotOperand)] = tos;                          \
+            DROP();                                                               \
+        } while (false)
+    // assigning never defines a global, the 'var' must have run first
+    #define SET_GLOBAL(slotOperand)                                               \
+        do                                                                        \
+        {                                                                         \
+            uint32_t slot = (slotOperand);                                        \
+            Value *global = &vm.globalValues.values[slot];                        \
+            if (IS_UNDEFINED(*global))                                            \
+                RUNTIME_ERROR("Undefined variable '%s'.", globalName(slot));      \
+            *global = tos;                                                        \
+        } while (false)
+
+    uint8_t instruction;
+    INTERPRET_LOOP
+    {
+        CASE_CODE(OP_CONSTANT):
+        {
+            Value constant = READ_CONSTANT();
+            PUSH(constant);
+            DISPATCH();
+        }
+        CASE_CODE(OP_NIL):
+            PUSH(NIL_VAL);
+            DISPATCH();
+        CASE_CODE(OP_TRUE):
+            PUSH(BOOL_VAL(true));
+            DISPATCH();
+        CASE_CODE(OP_FALSE):
+            PUSH(BOOL_VAL(false));
+            DISPATCH();
+        CASE_CODE(OP_POP):
+            DROP();
+            DISPATCH();
+        CASE_CODE(OP_GET_LOCAL):
+        {
+            uint8_t slot = READ_BYTE();
+            PUSH(slots[slot]);
+            DISPATCH();
+        }
+        CASE_CODE(OP_SET_LOCAL):
+        {
+            // if slot is the top itself its memory copy is stale anyway, writing it is harmless
+            uint8_t slot = READ_BYTE();
+            slots[slot] = tos;
+            DISPATCH();
+        }
+        CASE_CODE(OP_GET_GLOBAL):
+            GET_GLOBAL(READ_BYTE());
+            DISPATCH();
+        CASE_CODE(OP_GET_UPVALUE):
+        {
+            // an open upvalue never points at this frame's slots, *location is up to date
+            uint8_t index = READ_BYTE();
+            PUSH(*UPVALUE(index));
+            DISPATCH();
+        }
+        CASE_CODE(OP_SET_UPVALUE):
+        {
+            uint8_t index = READ_BYTE();
+            *UPVALUE(index) = tos;
+            if (frame->closure != NULL)
+                writeBarrier((Obj *)frame->closure->upvalues[index], tos);
+            DISPATCH();
+        }
+        CASE_CODE(OP_DEFINE_GLOBAL):
+            DEFINE_GLOBAL(READ_BYTE());
+            DISPATCH();
+        CASE_CODE(OP_SET_GLOBAL):
+            SET_GLOBAL(READ_BYTE());
+            DISPATCH();
+        CASE_CODE(OP_EQUAL):
+        {
+            Value a = *--sp;
+            tos = BOOL_VAL(Value_valueEquals(a, tos)); // can == on ANY pair of objects
+            DISPATCH();
+        }
+        CASE_CODE(OP_GREATER):
+            BINARY_OP(BOOL_VAL, >, OP_GREATER_NUM);
+            DISPATCH();
+        CASE_CODE(OP_LESS):
+            BINARY_OP(BOOL_VAL, <, OP_LESS_NUM);
+            DISPATCH();
+        CASE_CODE(OP_ADD):
+        {
+            // String contatencation SUPPORTED NICE
+            if (IS_STRING(tos) && IS_STRING(sp[-1]))
             {
-                ObjString *name = READ_STRING();
-                Value value;
-                if (!tableGet(&vm.globals, name, &value))
-                {
-                    runtimeError("Undefined variable '%s'.", name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                Vm_Push(value);
-                break;
+                QUICKEN(OP_ADD_STR);
+                CONCATENATE();
             }
-            case OP_DEFINE_GLOBAL:
+            else if (IS_NUMBER(tos) && IS_NUMBER(sp[-1]))
             {
-                ObjString *name = READ_STRING();
-                tableSet(&vm.globals, name, peek(0));
-                Vm_Pop();
-                break;
+                QUICKEN(OP_ADD_NUM);
+                double b = AS_NUMBER(tos);
+                double a = AS_NUMBER(*--sp);
+                tos = NUMBER_VAL(a + b);
             }
-            case OP_SET_GLOBAL:
+            else
             {
-                ObjString *name = READ_STRING();
-                if (tableSet(&vm.globals, name, peek(0)))
-                {
-                    tableDelete(&vm.globals, name);
-                    runtimeError("Undefined variable '%s'.", name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                break;
+                RUNTIME_ERROR(
+                    "Operands must be two numbers or two strings.");
             }
-            case OP_EQUAL:
+            DISPATCH();
+        }
+        CASE_CODE(OP_NEGATE):
+            // ensure Value type being used for negation is a number
+            if (!IS_NUMBER(tos))
+                RUNTIME_ERROR("Operand must be a number.");
+            tos = NUMBER_VAL(-AS_NUMBER(tos));
+            DISPATCH();
+        CASE_CODE(OP_SUBTRACT):
+            BINARY_OP(NUMBER_VAL, -, OP_SUBTRACT_NUM);
+            DISPATCH();
+        CASE_CODE(OP_MULTIPLY):
+            BINARY_OP(NUMBER_VAL, *, OP_MULTIPLY_NUM);
+            DISPATCH();
+        CASE_CODE(OP_DIVIDE):
+            BINARY_OP(NUMBER_VAL, /, OP_DIVIDE_NUM);
+            DISPATCH();
+        CASE_CODE(OP_NOT):
+            tos = BOOL_VAL(isFalsey(tos));
+            DISPATCH();
+        CASE_CODE(OP_PRINT):
+        {
+            // TODO: fix color printing here
+            Value_printValue(tos, 31);
+            printf("\n");
+            DROP();
+            DISPATCH();
+        }
+        CASE_CODE(OP_JUMP):
+        {
+            uint16_t offset = READ_SHORT();
+            ip += offset;
+            DISPATCH();
+        }
+        CASE_CODE(OP_JUMP_IF_FALSE):
+        {
+            // offset tells us how much to increment ip in the event that the if statement is false.
+            // offset will jump over the body of the conditional
+            uint16_t offset = READ_SHORT();
+            if (isFalsey(tos))
+                ip += offset;
+            DISPATCH();
+        }
+        CASE_CODE(OP_LOOP):
+        {
+            uint16_t offset = READ_SHORT();
+            ip -= offset;
+            DISPATCH();
+        }
+        CASE_CODE(OP_CALL):
+        {
+            int argCount = READ_BYTE();
+            STORE_FRAME();
+            CALL_VALUE(vm.stackTop[-1 - argCount], argCount);
+            DISPATCH();
+        }
+        CASE_CODE(OP_TAIL_CALL):
+        {
+            int argCount = READ_BYTE();
+            STORE_FRAME();
+            Value callee = vm.stackTop[-1 - argCount];
+            // a native never had a frame to reuse and a function without a closure reads
+            // its captures from the frame below it, which must stay the declaring one.
+            // Those are ordinary calls, the OP_RETURN after this returns their result
+            if (IS_CLOSURE(callee) ||
+                (IS_FUNCTION(callee) && !AS_FUNCTION(callee)->capturesCallerFrame))
             {
-                Value b = Vm_Pop();
-                Value a = Vm_Pop();
-                Vm_Push(BOOL_VAL(Value_valueEquals(a, b))); // can == on ANY pair of objects
-                break;
+                ObjClosure *closure = IS_CLOSURE(callee) ? AS_CLOSURE(callee) : NULL;
+                ObjFunction *function = closure != NULL ? closure->function : AS_FUNCTION(callee);
+                if (!tailCall(function, closure, argCount))
+                    THROW();
+                LOAD_FRAME();
+                DISPATCH();
             }
-            case OP_GREATER:
-                BINARY_OP(BOOL_VAL, >);
-                break;
-            case OP_LESS:
-                BINARY_OP(BOOL_VAL, <);
-                break;
-            case OP_ADD:
+            CALL_VALUE(callee, argCount);
+            DISPATCH();
+        }
+        CASE_CODE(OP_INLINE_CALL):
+        {
+            int argCount = READ_BYTE();
+            Value expected = READ_CONSTANT();
+            uint8_t skip = READ_BYTE();
+            Value callee = argCount == 0 ? tos : sp[-argCount];
+            // still the function the compiler inlined: run the copy of its body that follows
+            if (IS_OBJ(callee) && AS_OBJ(callee) == AS_OBJ(expected))
+                DISPATCH();
+            // the global was reassigned, really call it. It returns to past the copy
+            ip += skip;
+            STORE_FRAME();
+            CALL_VALUE(callee, argCount);
+            DISPATCH();
+        }
+        CASE_CODE(OP_DROP_UNDER):
+            // the top stays, the callee and arguments of an inlined call go
+            sp -= READ_BYTE();
+            DISPATCH();
+        CASE_CODE(OP_CLOSURE):
+            MAKE_CLOSURE(READ_CONSTANT());
+            DISPATCH();
+        CASE_CODE(OP_CLASS):
+        {
+            Value name = READ_CONSTANT();
+            STORE_FRAME();
+            PUSH(OBJ_VAL(newClass(AS_STRING(name))));
+            DISPATCH();
+        }
+        CASE_CODE(OP_INHERIT):
+        {
+            // [superclass, subclass], methods are copied down so lookups never walk a chain
+            Value superclass = sp[-1];
+            if (!IS_CLASS(superclass))
+                RUNTIME_ERROR("Superclass must be a class.");
+            STORE_FRAME();
+            tableAddAll(&AS_CLASS(superclass)->methods, &AS_CLASS(tos)->methods);
+            Memory_Remember(AS_OBJ(tos));
+            DROP();
+            DISPATCH();
+        }
+        CASE_CODE(OP_METHOD):
+            DEFINE_METHOD(READ_CONSTANT());
+            DISPATCH();
+        CASE_CODE(OP_GET_PROPERTY):
+            GET_PROPERTY(READ_BYTE());
+            DISPATCH();
+        CASE_CODE(OP_SET_PROPERTY):
+            SET_PROPERTY(READ_BYTE());
+            DISPATCH();
+        CASE_CODE(OP_GET_SUPER):
+            GET_SUPER(READ_CONSTANT());
+            DISPATCH();
+        CASE_CODE(OP_INVOKE):
+        {
+            uint8_t cacheIndex = READ_BYTE();
+            INVOKE(cacheIndex, READ_BYTE());
+            DISPATCH();
+        }
+        CASE_CODE(OP_SUPER_INVOKE):
+        {
+            uint8_t cacheIndex = READ_BYTE();
+            SUPER_INVOKE(cacheIndex, READ_BYTE());
+            DISPATCH();
+        }
+        CASE_CODE(OP_THROW):
+            vm.exception = tos;
+            STORE_FRAME();
+            THROW();
+        CASE_CODE(OP_BUILD_LIST):
+        {
+            int count = READ_BYTE();
+            // the items are the top count values, in memory once the frame is stored
+            STORE_FRAME();
+            ObjList *list = newList(vm.stackTop - count, count);
+            sp -= count;
+            tos = *sp;
+            PUSH(OBJ_VAL(list));
+            DISPATCH();
+        }
+        CASE_CODE(OP_GET_INDEX):
+        {
+            // [list, index]
+            Value list = sp[-1];
+            if (!IS_LIST(list))
+                RUNTIME_ERROR("Only lists can be indexed.");
+            CHECK_INDEX(AS_LIST(list), tos);
+            tos = listGet(AS_LIST(list), (int)AS_NUMBER(tos));
+            sp--;
+            DISPATCH();
+        }
+        CASE_CODE(OP_SET_INDEX):
+        {
+            // [list, index, item], the item stays as the value of the assignment
+            Value list = sp[-2];
+            if (!IS_LIST(list))
+                RUNTIME_ERROR("Only lists can be indexed.");
+            CHECK_INDEX(AS_LIST(list), sp[-1]);
+            int index = (int)AS_NUMBER(sp[-1]);
+            if (AS_LIST(list)->isNumeric && IS_NUMBER(tos))
             {
-                // String contatencation SUPPORTED NICE
-                if (IS_STRING(peek(0)) && IS_STRING(peek(1)))
-                {
-                    concatenate();
-                }
-                else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1)))
-                {
-                    double b = AS_NUMBER(Vm_Pop());
-                    double a = AS_NUMBER(Vm_Pop());
-                    Vm_Push(NUMBER_VAL(a + b));
-                }
-                else
-                {
-                    runtimeError(
-                        "Operands must be two numbers or two strings.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                break;
+                AS_LIST(list)->as.numbers[index] = AS_NUMBER(tos);
             }
-            case OP_NEGATE:
-                // ensure Value type being used for negation is a number
-                if (!IS_NUMBER(peek(0)))
-                {
-                    runtimeError("Operand must be a number.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                Vm_Push(NUMBER_VAL(-AS_NUMBER(Vm_Pop())));
-                break;
-            case OP_SUBTRACT:
-                BINARY_OP(NUMBER_VAL, -);
-                break;
-            case OP_MULTIPLY:
-                BINARY_OP(NUMBER_VAL, *);
-                break;
-            case OP_DIVIDE:
-                BINARY_OP(NUMBER_VAL, /);
-                break;
-            case OP_NOT:
-                Vm_Push(BOOL_VAL(isFalsey(Vm_Pop())));
-                break;
-            case OP_PRINT:
+            else
             {
-                // TODO: fix color printing here
-                Value_printValue(Vm_Pop(), 31);
-                printf("\n");
-                break;
+                STORE_FRAME(); // may turn the list into one of Values, which allocates
+                listSet(AS_LIST(list), index, tos);
             }
-            case OP_JUMP:
+            sp -= 2;
+            DISPATCH();
+        }
+        CASE_CODE(OP_CLOSE_UPVALUE):
+            // the captured local is the top, spill it so it can be moved to the heap
+            *sp = tos;
+            closeUpvalues(sp);
+            DROP();
+            DISPATCH();
+        CASE_CODE(OP_RETURN):
+        {
+            Value result = tos;
+            // the callee's locals are all below the result, so they are in memory
+            if (vm.openUpvalues != NULL)
+                closeUpvalues(frame->slots);
+            vm.frameCount--;
+            if (vm.frameCount == 0)
             {
-                uint16_t offset = READ_SHORT();
-                vm.ip += offset;
-                break;
+                vm.stackTop = frame->slots;
+                // the script itself returned, Exit interpreter with an empty stack
+                if (vm.fiber == vm.mainFiber)
+                    return INTERPRET_OK;
+                // a fiber's function returned, back to whoever resumed it
+                retireFiber();
+                LOAD_FRAME();
+                tos = result;
+                DISPATCH();
             }
-            case OP_JUMP_IF_FALSE:
+
+            // the result takes the callee's slot 0, everything above it is dropped
+            sp = frame->slots;
+            tos = result;
+            frame = &vm.frames[vm.frameCount - 1];
+            ip = frame->ip;
+            slots = frame->slots;
+            DISPATCH();
+        }
+        CASE_CODE(OP_NOT_EQUAL):
+        {
+            Value a = *--sp;
+            tos = BOOL_VAL(!Value_valueEquals(a, tos));
+            DISPATCH();
+        }
+        // >= and <= are defined as the negation of < and >, NaN operands included
+        CASE_CODE(OP_GREATER_EQUAL):
+            NEGATED_COMPARE(<);
+            DISPATCH();
+        CASE_CODE(OP_LESS_EQUAL):
+            NEGATED_COMPARE(>);
+            DISPATCH();
+        CASE_CODE(OP_ADD_LOCAL_CONST):
+        {
+            // the result always gets pushed, so spill first: the local may be the top
+            uint8_t slot = READ_BYTE();
+            *sp++ = tos;
+            Value a = slots[slot];
+            Value b = READ_CONSTANT();
+            if (IS_NUMBER(a) && IS_NUMBER(b))
             {
-                // offset tells us how much to increment ip in the event that the if statement is false.
-                // offset will jump over the body of the conditional
-                uint16_t offset = READ_SHORT();
-                if (isFalsey(peek(0)))
-                    vm.ip += offset;
-                break;
+                tos = NUMBER_VAL(AS_NUMBER(a) + AS_NUMBER(b));
             }
-            case OP_LOOP:
+            else if (IS_STRING(a) && IS_STRING(b))
             {
-                uint16_t offset = READ_SHORT();
-                vm.ip -= offset;
-                break;
+                tos = a;
+                PUSH(b);
+                CONCATENATE();
             }
-            case OP_RETURN:
+            else
             {
-                // Exit interpreter
-                return INTERPRET_OK;
+                RUNTIME_ERROR(
+                    "Operands must be two numbers or two strings.");
             }
+            DISPATCH();
+        }
+        CASE_CODE(OP_JUMP_IF_FALSE_POP):
+        {
+            uint16_t offset = READ_SHORT();
+            bool falsey = isFalsey(tos);
+            DROP();
+            if (falsey)
+                ip += offset;
+            DISPATCH();
+        }
+        CASE_CODE(OP_CONSTANT_LONG):
+            PUSH(READ_CONSTANT_LONG());
+            DISPATCH();
+        CASE_CODE(OP_GET_GLOBAL_LONG):
+            GET_GLOBAL(READ_UINT24());
+            DISPATCH();
+        CASE_CODE(OP_DEFINE_GLOBAL_LONG):
+            DEFINE_GLOBAL(READ_UINT24());
+            DISPATCH();
+        CASE_CODE(OP_SET_GLOBAL_LONG):
+            SET_GLOBAL(READ_UINT24());
+            DISPATCH();
+        CASE_CODE(OP_JUMP_LONG):
+        {
+            uint32_t offset = READ_UINT24();
+            ip += offset;
+            DISPATCH();
+        }
+        CASE_CODE(OP_JUMP_IF_FALSE_LONG):
+        {
+            uint32_t offset = READ_UINT24();
+            if (isFalsey(tos))
+                ip += offset;
+            DISPATCH();
         }
+        CASE_CODE(OP_JUMP_IF_FALSE_POP_LONG):
+        {
+            uint32_t offset = READ_UINT24();
+            bool falsey = isFalsey(tos);
+            DROP();
+            if (falsey)
+                ip += offset;
+            DISPATCH();
+        }
+        CASE_CODE(OP_LOOP_LONG):
+        {
+            uint32_t offset = READ_UINT24();
+            ip -= offset;
+            DISPATCH();
+        }
+        CASE_CODE(OP_CLOSURE_LONG):
+            MAKE_CLOSURE(READ_CONSTANT_LONG());
+            DISPATCH();
+        CASE_CODE(OP_CLASS_LONG):
+        {
+            Value name = READ_CONSTANT_LONG();
+            STORE_FRAME();
+            PUSH(OBJ_VAL(newClass(AS_STRING(name))));
+            DISPATCH();
+        }
+        CASE_CODE(OP_METHOD_LONG):
+            DEFINE_METHOD(READ_CONSTANT_LONG());
+            DISPATCH();
+        CASE_CODE(OP_GET_PROPERTY_LONG):
+            GET_PROPERTY(READ_UINT24());
+            DISPATCH();
+        CASE_CODE(OP_SET_PROPERTY_LONG):
+            SET_PROPERTY(READ_UINT24());
+            DISPATCH();
+        CASE_CODE(OP_GET_SUPER_LONG):
+            GET_SUPER(READ_CONSTANT_LONG());
+            DISPATCH();
+        CASE_CODE(OP_INVOKE_LONG):
+        {
+            uint32_t cacheIndex = READ_UINT24();
+            INVOKE(cacheIndex, READ_BYTE());
+            DISPATCH();
+        }
+        CASE_CODE(OP_SUPER_INVOKE_LONG):
+        {
+            uint32_t cacheIndex = READ_UINT24();
+            SUPER_INVOKE(cacheIndex, READ_BYTE());
+            DISPATCH();
+        }
+        CASE_CODE(OP_ADD_NUM):
+            NUMBER_OP(NUMBER_VAL, +, OP_ADD);
+            DISPATCH();
+        CASE_CODE(OP_ADD_STR):
+            if (!IS_STRING(tos) || !IS_STRING(sp[-1]))
+                DEQUICKEN(OP_ADD);
+            CONCATENATE();
+            DISPATCH();
+        CASE_CODE(OP_SUBTRACT_NUM):
+            NUMBER_OP(NUMBER_VAL, -, OP_SUBTRACT);
+            DISPATCH();
+        CASE_CODE(OP_MULTIPLY_NUM):
+            NUMBER_OP(NUMBER_VAL, *, OP_MULTIPLY);
+            DISPATCH();
+        CASE_CODE(OP_DIVIDE_NUM):
+            NUMBER_OP(NUMBER_VAL, /, OP_DIVIDE);
+            DISPATCH();
+        CASE_CODE(OP_GREATER_NUM):
+            NUMBER_OP(BOOL_VAL, >, OP_GREATER);
+            DISPATCH();
+        CASE_CODE(OP_LESS_NUM):
+            NUMBER_OP(BOOL_VAL, <, OP_LESS);
+            DISPATCH();
     }
+
+    // only reachable if the switch was handed a byte that is not an opcode
+    RUNTIME_ERROR("Unknown opcode %d.", instruction);
+
     // Explicit scoping for these macros, only used by run() function
     #undef READ_BYTE
     #undef READ_SHORT
+    #undef READ_UINT24
+    #undef READ_CONSTANT_LONG
+    #undef PUSH
+    #undef DROP
+    #undef STORE_FRAME
+    #undef LOAD_FRAME
+    #undef THROW
+    #undef CHECK_INDEX
+    #undef RUNTIME_ERROR
+    #undef CONCATENATE
+    #undef CALL_VALUE
+    #undef GET_PROPERTY
+    #undef SET_PROPERTY
+    #undef PROPERTY_NAME
+    #undef DEFINE_METHOD
+    #undef GET_SUPER
+    #undef INVOKE
+    #undef SUPER_INVOKE
+    #undef UPVALUE
+    #undef MAKE_CLOSURE
+    #undef GET_GLOBAL
+    #undef DEFINE_GLOBAL
+    #undef SET_GLOBAL
     #undef READ_CONSTANT
     #undef BINARY_OP
-    #undef READ_STRING
+    #undef NEGATED_COMPARE
+    #undef QUICKEN
+    #undef DEQUICKEN
+    #undef NUMBER_OP
+    #undef PROFILE_INSTRUCTION
+    #undef TRACE_INSTRUCTION
+    #undef INTERPRET_LOOP
+    #undef CASE_CODE
+    #undef DISPATCH
 }
 
 InterpretResult Vm_Interpret(const char *source)
 {
-    // create new empty chunk
-    Chunk chunk;
-    Chunk_InitChunk(&chunk);
+    // take user program and compile it into the script's implicit function
+    ObjFunction *function = Compiler_Compile(source);
+    if (function == NULL)
+        return INTERPRET_COMPILE_ERROR;
 
-    // take user program and fill chunk w bytecode
-    if (!Compiler_Compile(source, &chunk))
+    // the script is called like any other function, with itself in slot 0
+    Vm_Push(OBJ_VAL(function));
+    if (!call(function, NULL, 0))
     {
-        // if errors in the program, free chunk and ERROR
-        Chunk_FreeChunk(&chunk);
-        return INTERPRET_COMPILE_ERROR;
+        throwException(); // there is no try block yet, this reports it
+        return INTERPRET_RUNTIME_ERROR;
     }
 
-    // else compiled chunk will be executed by vm
-    vm.chunk = &chunk;
-    vm.ip = vm.chunk->code;
-
     // execute chunk
     InterpretResult result = Vm_Run();
 
-    Chunk_FreeChunk(&chunk);
+#ifdef DEBUG_PRINT_CODE
+    // same chunk again, now showing which instructions the VM quickened while running
+    disassembleChunk(&function->chunk, "quickened code");
+#endif // DEBUG_PRINT_CODE
+
     return result;
 }
 
+int Vm_GlobalSlot(ObjString *name)
+{
+    Value slot;
+    if (tableGet(&vm.globalSlots, name, &slot))
+        return (int)AS_NUMBER(slot);
+
+    // first time we see this name, hand out the next slot. It stays undefined until
+    // OP_DEFINE_GLOBAL runs for it. The name may be a string nothing refers to yet
+    Memory_PushRoot((Obj *)name);
+    writeValueArray(&vm.globalValues, UNDEFINED_VAL);
+    writeValueArray(&vm.globalIdentifiers, OBJ_VAL(name));
+    int newSlot = vm.globalValues.count - 1;
+    tableSet(&vm.globalSlots, name, NUMBER_VAL(newSlot));
+    Memory_PopRoot();
+    return newSlot;
+}
+
 void Vm_InitVm()
 {
-    vm.objects = NULL;
+    // everything a collection looks at is set before the first allocation
+    vm.youngObjects = vm.oldObjects = NULL;
+    vm.bytesAllocated = 0;
+    vm.nextGC = GC_INITIAL_THRESHOLD;
+    vm.nurseryBytes = 0;
+    vm.grayCount = vm.grayCapacity = 0;
+    vm.grayStack = NULL;
+    vm.rememberedCount = vm.rememberedCapacity = 0;
+    vm.remembered = NULL;
+    vm.gcPhase = GC_IDLE;
+    vm.gcSliceWork = 0;
+    vm.sliceBytes = 0;
+    vm.clearCursor = NULL;
+    vm.sweepLink = NULL;
+    vm.sweepingYoung = NULL;
+    vm.gcStats = (GcStats){0};
+    vm.tempRootCount = 0;
+    vm.fiber = vm.mainFiber = NULL;
+    vm.frames = NULL;
+    vm.frameCapacity = 0;
+    vm.frameCount = 0;
+    vm.trace.enabled = false;
+    vm.trace.count = 0;
+    vm.stack = NULL;
+    vm.stackCapacity = 0;
+    vm.stackTop = NULL;
+    vm.openUpvalues = NULL;
+    vm.exception = NIL_VAL;
+    Value_initValueArray(&vm.globalValues);
+    Value_initValueArray(&vm.globalIdentifiers);
+    initTable(&vm.globalSlots);
     initTable(&vm.strings);
+    vm.initString = NULL;
+    vm.emptyShape = NULL;
+    Vm_ReserveStack(STACK_SEGMENT);
+    vm.initString = copyString("init", 4);
+    vm.emptyShape = newShape(NULL, NULL);
+    // the script runs on the stack allocated above, as the main fiber
+    vm.mainFiber = newFiber(NIL_VAL);
+    vm.mainFiber->state = FIBER_ACTIVE;
+    vm.fiber = vm.mainFiber;
     Vm_ResetStack(); // VM state must be initialized
+    Natives_DefineCore();
 }
 
 void Vm_FreeVm()
 {
-    initTable(&vm.globals);
+    // every fiber's stack and frames are freed with it, the running one's included
+    saveFiber(vm.fiber);
+    vm.stack = vm.stackTop = NULL;
+    vm.stackCapacity = 0;
+    vm.frames = NULL;
+    vm.frameCount = vm.frameCapacity = 0;
+    vm.fiber = vm.mainFiber = NULL;
+    freeValueArray(&vm.globalValues);
+    freeValueArray(&vm.globalIdentifiers);
+    freeTable(&vm.globalSlots);
     freeTable(&vm.strings);
+    vm.initString = NULL;
+    vm.emptyShape = NULL;
     freeObjects();
+#ifdef PROFILE_OPCODE_PAIRS
+    printOpcodePairProfile();
+#endif // PROFILE_OPCODE_PAIRS
+}
+
+void Vm_SetTracing(bool enabled)
+{
+    vm.trace.enabled = enabled;
+}
+
+void Vm_DumpTrace(FILE *out)
+{
+    uint64_t recorded = vm.trace.count < TRACE_BUFFER_SIZE ? vm.trace.count : TRACE_BUFFER_SIZE;
+    fprintf(out, "== execution trace: last %llu of %llu instructions ==\n",
+            (unsigned long long)recorded, (unsigned long long)vm.trace.count);
+    fprintf(out, "%8s %6s  %-16s  %-26s %s\n", "offset", "line", "function", "opcode", "stack");
+    for (uint64_t i = vm.trace.count - recorded; i < vm.trace.count; i++)
+    {
+        TraceEntry *entry = &vm.trace.entries[i & (TRACE_BUFFER_SIZE - 1)];
+        // the collector keeps recorded functions alive, so their line info is still there
+        Chunk *chunk = &entry->function->chunk;
+        const char *name = entry->function->name != NULL ? entry->function->name->chars : "script";
+        fprintf(out, "%8u %6d  %-16s", entry->offset, chunk->lines[entry->offset], name);
+        fprintf(out, "  %-26s %u\n", Debug_OpcodeName(entry->opcode), entry->stackDepth);
+    }
+}
+
+void Vm_DefineNative(const char *name, NativeFn function, int arity)
+{
+    ObjString *string = copyString(name, (int)strlen(name));
+    int slot = Vm_GlobalSlot(string);
+    vm.globalValues.values[slot] = OBJ_VAL(newNative(function, arity, string));
+}
+
+Value Vm_ResumeFiber(ObjFiber *fiber, Value value, Value *args)
+{
+    if (fiber->state == FIBER_DONE)
+        return Vm_NativeError("Can't resume a finished fiber.");
+    if (fiber->state == FIBER_ACTIVE)
+        return Vm_NativeError("Can't resume a fiber that is already running.");
+
+    // the native's slot stays on top, it is where the value handed back goes
+    vm.stackTop = args;
+    saveFiber(vm.fiber);
+    fiber->resumer = vm.fiber;
+    writeBarrier((Obj *)fiber, OBJ_VAL(vm.fiber));
+    bool isNew = fiber->state == FIBER_NEW;
+    fiber->state = FIBER_ACTIVE;
+    loadFiber(fiber);
+    if (isNew)
+        return startFiber(fiber, value) ? NIL_VAL : UNDEFINED_VAL;
+    // the yield() it is suspended in returns value
+    vm.stackTop[-1] = value;
+    return NIL_VAL;
+}
+
+Value Vm_YieldFiber(Value value, Value *args)
+{
+    ObjFiber *fiber = vm.fiber;
+    if (fiber == vm.mainFiber)
+        return Vm_NativeError("Can't yield from the main fiber.");
+
+    vm.stackTop = args;
+    saveFiber(fiber);
+    fiber->state = FIBER_SUSPENDED;
+    loadFiber(fiber->resumer);
+    fiber->resumer = NULL;
+    vm.stackTop[-1] = value;
+    return NIL_VAL;
+}
+
+bool Vm_ReserveStack(int slots)
+{
+    int used = (int)(vm.stackTop - vm.stack);
+    if (used + slots <= vm.stackCapacity)
+        return true;
+    if (used + slots > STACK_MAX)
+        return false;
+
+    // grow in whole segments, so a run of small reservations doesn't realloc every time.
+    // A fiber's first reservation is exact, most never need more than their function's
+    int capacity = vm.stackCapacity == 0 ? used + slots : vm.stackCapacity;
+    while (capacity < used + slots)
+        capacity += STACK_SEGMENT;
+    // the guard slot below vm.stack is allocated with it, see Vm_Run
+    Value *oldStack = vm.stack;
+    Value *block = vm.stack == NULL ? NULL : vm.stack - STACK_GUARD;
+    int oldSlots = vm.stack == NULL ? 0 : vm.stackCapacity + STACK_GUARD;
+    block = GROW_ARRAY(Value, block, oldSlots, capacity + STACK_GUARD);
+    block[0] = NIL_VAL;
+    vm.stack = block + STACK_GUARD;
+    vm.stackCapacity = capacity;
+    vm.stackTop = vm.stack + used; // stack may have moved, rebase the top
+    // and every frame's window, the same way Lua's correctstack does it
+    for (int i = 0; i < vm.frameCount; i++)
+        vm.frames[i].slots = vm.stack + (vm.frames[i].slots - oldStack);
+    for (ObjUpvalue *upvalue = vm.openUpvalues; upvalue != NULL; upvalue = upvalue->next)
+        upvalue->location = vm.stack + (upvalue->location - oldStack);
+    return true;
 }
 
 void Vm_Push(Value value)
 {
-    // TODO: Errork checking here, dynamic expand stack??
+    // no bounds check, room was reserved by Vm_ReserveStack before the chunk started
     *vm.stackTop = value; // deref and save value into stack
     vm.stackTop++;        // move top of stack to next entry
 }
 
 Value Vm_Pop()
 {
-    // TODO: Errork checking here
+    // compiled code never pops more than it pushed
     vm.stackTop--;
     return *vm.stackTop;
 }
\ No newline at end of file
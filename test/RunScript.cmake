@@ -0,0 +1,55 @@
+# Runs one test script and checks what it printed. Expectations live in the script itself:
+#
+#   print 1 + 2; // expect: 3                 one line of stdout, in order
+#   // expect runtime error: <message>        must exit 70 with <message> on stderr
+#   // expect compile error: <message>        must exit 65 with <message> on stderr
+#
+# Colour escape codes are stripped before comparing. Usage:
+#   cmake -DURBANC=<binary> -DBACKEND=<stack|register> [-DFLAGS=<options>] -DSCRIPT=<file>
+#         -P RunScript.cmake
+
+separate_arguments(FLAGS)
+execute_process(
+    COMMAND ${URBANC} ${FLAGS} --backend=${BACKEND} ${SCRIPT}
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors
+    RESULT_VARIABLE exitCode
+    )
+
+string(ASCII 27 escape)
+string(REGEX REPLACE "${escape}\\[[0-9;]*m" "" output "${output}")
+
+file(READ ${SCRIPT} source)
+string(REGEX MATCHALL "// expect: [^\n]*" expectLines "${source}")
+set(expected "")
+foreach(line ${expectLines})
+    string(REGEX REPLACE "^// expect: " "" line "${line}")
+    string(APPEND expected "${line}\n")
+endforeach()
+
+set(expectedExit 0)
+set(expectedError "")
+if(source MATCHES "// expect runtime error: ([^\n]*)")
+    set(expectedExit 70)
+    set(expectedError "${CMAKE_MATCH_1}")
+elseif(source MATCHES "// expect compile error: ([^\n]*)")
+    set(expectedExit 65)
+    set(expectedError "${CMAKE_MATCH_1}")
+endif()
+
+if(NOT exitCode EQUAL expectedExit)
+    message(FATAL_ERROR "${SCRIPT} (${BACKEND}): exit code ${exitCode}, expected ${expectedExit}\n"
+                        "stderr:\n${errors}")
+endif()
+if(NOT expectedError STREQUAL "")
+    string(FIND "${errors}" "${expectedError}" found)
+    if(found EQUAL -1)
+        message(FATAL_ERROR "${SCRIPT} (${BACKEND}): expected error '${expectedError}'\n"
+                            "stderr:\n${errors}")
+    endif()
+endif()
+# a compile error stops before anything runs, only the message matters
+if(NOT expectedExit EQUAL 65 AND NOT output STREQUAL expected)
+    message(FATAL_ERROR "${SCRIPT} (${BACKEND}): output mismatch\n"
+                        "expected:\n${expected}\ngot:\n${output}")
+endif()
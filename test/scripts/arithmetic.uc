@@ -0,0 +1,8 @@
+print 1 + 2; // expect: 3
+print 10 - 4 * 2; // expect: 2
+print (10 - 4) * 2; // expect: 12
+print 7 / 2; // expect: 3.5
+print -(3 + 4); // expect: -7
+print --5; // expect: 5
+print 1 + 2 * 3 - 4 / 2; // expect: 5
+print 0.1 + 0.2 == 0.3; // expect: false
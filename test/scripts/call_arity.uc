@@ -0,0 +1,5 @@
+// backends: stack
+fun pair(a, b) { return a; }
+print pair(1, 2); // expect: 1
+pair(1);
+// expect runtime error: Expected 2 arguments but got 1.
@@ -0,0 +1,4 @@
+// backends: stack
+var notAFunction = "text";
+notAFunction();
+// expect runtime error: Can only call functions.
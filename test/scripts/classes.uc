@@ -0,0 +1,95 @@
+// backends: stack
+class Point {
+    init(x, y) {
+        this.x = x;
+        this.y = y;
+    }
+    sum() { return this.x + this.y; }
+    scale(by) {
+        this.x = this.x * by;
+        this.y = this.y * by;
+        return this;
+    }
+}
+
+var p = Point(1, 2);
+print p.x; // expect: 1
+print p.sum(); // expect: 3
+print p.scale(10).sum(); // expect: 30
+print p; // expect: Point instance
+print Point; // expect: Point
+
+// a bound method remembers its receiver
+var sum = p.sum;
+print sum(); // expect: 30
+
+// fields added outside of init, in different orders, give instances different shapes.
+// One access site sees all of them
+class Bag {}
+fun make(order) {
+    var bag = Bag();
+    if (order) {
+        bag.a = "a1";
+        bag.b = "b1";
+    } else {
+        bag.b = "b2";
+        bag.a = "a2";
+    }
+    return bag;
+}
+fun show(bag) { return bag.a + bag.b; }
+print show(make(true)); // expect: a1b1
+print show(make(false)); // expect: a2b2
+print show(make(true)); // expect: a1b1
+
+// overwriting a field keeps the shape
+var bag = make(true);
+bag.a = "new";
+print show(bag); // expect: newb1
+
+// a field shadows a method of the same name
+class Shadow {
+    name() { return "method"; }
+}
+var s = Shadow();
+print s.name(); // expect: method
+s.name = "field";
+print s.name; // expect: field
+
+// inheritance and super
+class Animal {
+    init(name) { this.name = name; }
+    speak() { return this.name + " makes a sound"; }
+}
+class Dog < Animal {
+    speak() { return super.speak() + ", woof"; }
+}
+print Dog("rex").speak(); // expect: rex makes a sound, woof
+
+// methods capture like any function
+fun counterClass() {
+    var count = 0;
+    class Counter {
+        next() {
+            count = count + 1;
+            return count;
+        }
+    }
+    return Counter();
+}
+var counter = counterClass();
+counter.next();
+print counter.next(); // expect: 2
+
+// init always returns the instance
+class Early {
+    init() {
+        this.done = true;
+        return;
+    }
+}
+print Early().done; // expect: true
+print Early().init(); // expect: Early instance
+
+print p.missing;
+// expect runtime error: Undefined property 'missing'.
@@ -0,0 +1,99 @@
+// backends: stack
+// a returned function keeps its variables alive after the frame is gone
+fun makeCounter() {
+    var count = 0;
+    fun counter() {
+        count = count + 1;
+        return count;
+    }
+    return counter;
+}
+var c1 = makeCounter();
+var c2 = makeCounter();
+print c1(); // expect: 1
+print c1(); // expect: 2
+print c2(); // expect: 1
+
+// two closures over the same variable share it, open or closed
+fun makePair() {
+    var shared = "before";
+    fun get() { return shared; }
+    fun set(value) { shared = value; }
+    set("during");
+    print get(); // expect: during
+    shared = "after";
+    print get(); // expect: after
+    return get;
+}
+print makePair()(); // expect: after
+
+// a local helper only ever called in place reads and writes the caller's variables
+fun sum(n) {
+    var total = 0;
+    fun add(x) { total = total + x; }
+    var i = 1;
+    while (i <= n) {
+        add(i);
+        i = i + 1;
+    }
+    return total;
+}
+print sum(100); // expect: 5050
+
+{
+    var greeting = "hi";
+    fun greet(name) { return greeting + " " + name; }
+    print greet("block"); // expect: hi block
+    greeting = "bye";
+    print greet("block"); // expect: bye block
+}
+
+// captured through an enclosing function's own capture
+fun outer() {
+    var x = "outer";
+    fun middle() {
+        fun inner() { return x; }
+        return inner;
+    }
+    return middle;
+}
+print outer()()(); // expect: outer
+
+// passing a function on lets it escape too
+fun apply(f) { return f(); }
+fun wrap() {
+    var secret = 42;
+    fun reveal() { return secret; }
+    return apply(reveal);
+}
+print wrap(); // expect: 42
+
+// every iteration gets its own variable
+var first;
+var second;
+{
+    var i = 0;
+    while (i < 2) {
+        var j = i;
+        fun show() { return j; }
+        if (i == 0) first = show;
+        else second = show;
+        i = i + 1;
+    }
+}
+print first(); // expect: 0
+print second(); // expect: 1
+
+// recursion counts as escaping, the body mentions the function
+{
+    var calls = 0;
+    fun down(n) {
+        calls = calls + 1;
+        if (n > 0) down(n - 1);
+    }
+    down(4);
+    print calls; // expect: 5
+}
+
+print makeCounter; // expect: <function: makeCounter>
+print c1; // expect: <function: counter>
@@ -0,0 +1,21 @@
+print 1 < 2; // expect: true
+print 2 < 1; // expect: false
+print 2 <= 2; // expect: true
+print 3 >= 4; // expect: false
+print 1 == 1; // expect: true
+print 1 != 1; // expect: false
+print "a" == "a"; // expect: true
+print "a" == "b"; // expect: false
+print nil == false; // expect: false
+print nil == nil; // expect: true
+print 1 == "1"; // expect: false
+print !true; // expect: false
+print !nil; // expect: true
+print !0; // expect: false
+
+// >= and <= are the negation of < and >, so NaN compares the same on both backends
+var nan = 0 / 0;
+print nan == nan; // expect: false
+print nan < 1; // expect: false
+print nan >= 1; // expect: true
+print nan <= 1; // expect: true
@@ -0,0 +1,19 @@
+if (true) print "then"; // expect: then
+if (false) print "no"; else print "else"; // expect: else
+if (nil) print "no";
+var i = 0;
+while (i < 3) {
+    print i; // expect: 0
+             // expect: 1
+             // expect: 2
+    i = i + 1;
+}
+for (var j = 0; j < 6; j = j + 2) print j; // expect: 0
+                                          // expect: 2
+                                          // expect: 4
+var total = 0;
+for (var k = 1; k <= 100; k = k + 1) {
+    if (k == 50) total = total + 1000;
+    else total = total + k;
+}
+print total; // expect: 6000
@@ -0,0 +1,111 @@
+// backends: stack
+// runtime errors are thrown as their message
+try {
+    print 1 + nil;
+} catch (e) {
+    print e; // expect: Operands must be two numbers or two strings.
+}
+
+// throw takes any value
+try {
+    throw "boom";
+} catch (e) {
+    print e; // expect: boom
+}
+try {
+    throw 42;
+} catch (e) {
+    print e + 1; // expect: 43
+}
+
+// nothing thrown, the catch block is skipped
+try {
+    print "fine"; // expect: fine
+} catch (e) {
+    print "unreachable";
+}
+
+// the innermost try catches, a rethrow reaches the outer one
+try {
+    try {
+        throw "inner";
+    } catch (e) {
+        print "caught " + e; // expect: caught inner
+        throw e + " again";
+    }
+} catch (e) {
+    print "caught " + e; // expect: caught inner again
+}
+
+// throws unwind through calls, locals declared before the try survive
+fun fail(n) {
+    if (n == 0) throw "bottom";
+    return fail(n - 1) + 1;
+}
+fun guarded() {
+    var before = "kept";
+    try {
+        var inside = "dropped";
+        fail(20);
+    } catch (e) {
+        return before + " " + e;
+    }
+}
+print guarded(); // expect: kept bottom
+
+// closures made inside the try keep their variables after the unwind
+var saved;
+try {
+    var captured = "captured";
+    fun get() { return captured; }
+    saved = get;
+    throw nil;
+} catch (e) {
+    print e; // expect: nil
+}
+print saved(); // expect: captured
+
+// a return inside try is not turned into a tail call, so the callee's throw is caught here
+fun wrapped() {
+    try {
+        return fail(3);
+    } catch (e) {
+        return "handled " + e;
+    }
+}
+print wrapped(); // expect: handled bottom
+
+// errors raised by natives are caught too
+try {
+    resume(1);
+} catch (e) {
+    print e; // expect: resume() expects a fiber.
+}
+
+// a throw inside a fiber ends it and comes out of resume
+fun risky() {
+    yield("first");
+    throw "from fiber";
+}
+var fiber = Fiber(risky);
+print resume(fiber); // expect: first
+try {
+    resume(fiber);
+} catch (e) {
+    print e; // expect: from fiber
+}
+print isDone(fiber); // expect: true
+
+// the loop keeps going after a catch
+var caught = 0;
+for (var i = 0; i < 100; i = i + 1) {
+    try {
+        if (i >= 50) throw i;
+    } catch (e) {
+        caught = caught + 1;
+    }
+}
+print caught; // expect: 50
+
+throw "uncaught";
+// expect runtime error: uncaught
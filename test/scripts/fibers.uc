@@ -0,0 +1,106 @@
+// backends: stack
+// a generator: every yield hands a value back to the resume that ran it
+fun counter(limit) {
+    var i = 0;
+    while (i < limit) {
+        yield(i);
+        i = i + 1;
+    }
+    return "done";
+}
+var gen = Fiber(counter);
+print resume(gen, 3); // expect: 0
+print resume(gen); // expect: 1
+print resume(gen); // expect: 2
+print isDone(gen); // expect: false
+print resume(gen); // expect: done
+print isDone(gen); // expect: true
+print gen; // expect: <fiber>
+
+// values go both ways, resume's second argument is what yield returns
+fun accumulate() {
+    var total = 0;
+    while (true) total = total + yield(total);
+}
+var acc = Fiber(accumulate);
+resume(acc);
+resume(acc, 5);
+print resume(acc, 10); // expect: 15
+
+// fibers resume each other, yield goes back to the most recent resumer
+fun inner() {
+    yield("inner 1");
+    return "inner done";
+}
+fun outer() {
+    var f = Fiber(inner);
+    yield(resume(f));
+    yield(resume(f));
+    return "outer done";
+}
+var o = Fiber(outer);
+print resume(o); // expect: inner 1
+print resume(o); // expect: inner done
+print resume(o); // expect: outer done
+
+// a fiber keeps its own call frames while suspended
+fun deep(n) {
+    if (n == 0) return yield("bottom");
+    return deep(n - 1) + 1;
+}
+var d = Fiber(deep);
+print resume(d, 50); // expect: bottom
+print resume(d, 0); // expect: 50
+
+// closures see the same variables whichever fiber runs them
+var shared = 0;
+fun bump() {
+    shared = shared + 1;
+    yield();
+    shared = shared + 1;
+}
+var a = Fiber(bump);
+var b = Fiber(bump);
+resume(a);
+resume(b);
+print shared; // expect: 2
+resume(a);
+resume(b);
+print shared; // expect: 4
+
+// many fibers at once
+fun spin(n) {
+    while (true) n = n + yield(n);
+}
+var first = nil;
+var i = 0;
+var sum = 0;
+while (i < 2000) {
+    var f = Fiber(spin);
+    if (first == nil) first = f;
+    sum = sum + resume(f, i);
+    i = i + 1;
+}
+print sum == 1999000; // expect: true
+print resume(first, 7); // expect: 7
+
+// a closure keeps a suspended fiber's variable after the fiber itself is dropped
+var peek;
+fun parked() {
+    var local = "still here";
+    fun get() { return local; }
+    peek = get;
+    yield();
+}
+var dropped = Fiber(parked);
+resume(dropped);
+dropped = nil;
+var garbage = "";
+for (var i = 0; i < 100000; i = i + 1) {
+    garbage = garbage + "x";
+    if (len(garbage) > 50) garbage = "";
+}
+print peek(); // expect: still here
+
+resume(gen);
+// expect runtime error: Can't resume a finished fiber.
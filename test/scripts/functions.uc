@@ -0,0 +1,50 @@
+// backends: stack
+fun add(a, b) {
+    return a + b;
+}
+print add(1, 2); // expect: 3
+print add("con", "cat"); // expect: concat
+
+fun fib(n) {
+    if (n < 2) return n;
+    return fib(n - 2) + fib(n - 1);
+}
+print fib(20); // expect: 6765
+
+// no return value gives nil, so does a bare return
+fun nothing() {}
+print nothing(); // expect: nil
+fun early(n) {
+    if (n > 0) return;
+    print "not reached";
+}
+print early(1); // expect: nil
+
+// locals of the caller survive the call, the callee's go away with it
+fun square(x) {
+    var result = x * x;
+    return result;
+}
+{
+    var before = 10;
+    var sq = square(4);
+    var after = 20;
+    print before + sq + after; // expect: 46
+}
+
+// arguments are evaluated left to right, calls nest inside arguments
+fun sub(a, b) { return a - b; }
+print sub(sub(10, 3), add(1, 1)); // expect: 5
+
+// functions are values
+var f = add;
+print f(20, 22); // expect: 42
+print add; // expect: <function: add>
+
+// a deep (but not too deep) recursion grows the value stack as it goes
+fun count(n) {
+    if (n == 0) return 0;
+    var local = 1;
+    return local + count(n - 1);
+}
+print count(1000); // expect: 1000
@@ -0,0 +1,58 @@
+// backends: stack
+// enough garbage for several collections, everything still reachable must survive them
+class Node {
+    init(value, next) {
+        this.value = value;
+        this.next = next;
+    }
+}
+
+// a linked list that stays alive while its neighbours' garbage is collected
+var head = nil;
+for (var i = 0; i < 1000; i = i + 1) head = Node(i, head);
+
+var text = "";
+for (var i = 0; i < 20000; i = i + 1) {
+    // dropped straight away
+    var temporary = "garbage " + "string";
+    var pair = [temporary, Node(i, nil)];
+    if (i / 100 == floor(i / 100)) text = text + "x";
+}
+print len(text); // expect: 200
+
+var total = 0;
+for (var node = head; node != nil; node = node.next) total = total + node.value;
+print total; // expect: 499500
+
+// interned strings that were collected are made again, and still compare equal
+for (var i = 0; i < 20000; i = i + 1) {
+    var a = "inter" + "ned";
+}
+print "inter" + "ned" == "interned"; // expect: true
+
+// closures keep their captured variables, even once the frame is long gone
+fun counter() {
+    var count = 0;
+    fun increment() {
+        count = count + 1;
+        return count;
+    }
+    return increment;
+}
+var counters = [];
+for (var i = 0; i < 1000; i = i + 1) push(counters, counter());
+for (var i = 0; i < 20000; i = i + 1) counters[0]();
+print counters[0](); // expect: 20001
+
+// a suspended fiber keeps what is on its stack
+fun holder() {
+    var kept = ["kept"];
+    yield();
+    return kept[0];
+}
+var fiber = Fiber(holder);
+resume(fiber);
+for (var i = 0; i < 20000; i = i + 1) {
+    var junk = [i, "junk"];
+}
+print resume(fiber); // expect: kept
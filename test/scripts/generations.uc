@@ -0,0 +1,96 @@
+// backends: stack
+// enough short lived strings to run a few young collections
+fun churn() {
+    var s = "";
+    for (var i = 0; i < 5000; i = i + 1) {
+        s = s + "x";
+        if (len(s) > 100) s = "";
+    }
+}
+
+// a string nothing else has made yet, so it is young
+fun young(s) { return s + "."; }
+
+// objects made early have survived a collection and are old by the time they are changed
+class Holder {
+    init() { this.value = nil; }
+}
+var holder = Holder();
+var items = [1, 2, 3];
+var mixed = ["a", "b"];
+fun makeBox() {
+    var boxed = "start";
+    fun get() { return boxed; }
+    fun set(v) { boxed = v; }
+    return [get, set];
+}
+var box = makeBox();
+churn();
+churn();
+
+// old objects now get young values, which must survive the young collections after
+holder.value = young("fresh field");
+holder.added = young("new field");
+items[1] = young("young item");
+push(mixed, young("pushed item"));
+box[1](young("young upvalue"));
+churn();
+churn();
+print holder.value; // expect: fresh field.
+print holder.added; // expect: new field.
+print items[1]; // expect: young item.
+print mixed[2]; // expect: pushed item.
+print box[0](); // expect: young upvalue.
+
+// an old instance gets a closure made later
+fun makeGreeter(name) {
+    fun greet() { return "hi " + name; }
+    return greet;
+}
+holder.greet = makeGreeter(young("bob"));
+churn();
+print holder.greet(); // expect: hi bob.
+
+// a suspended fiber's stack gets young values while it runs again
+fun keeper() {
+    var kept = "first";
+    while (true) {
+        yield(kept);
+        kept = young("kept again");
+    }
+}
+var fiber = Fiber(keeper);
+print resume(fiber); // expect: first
+churn();
+resume(fiber);
+churn();
+print resume(fiber); // expect: kept again.
+
+// a store through a closure into a variable on a parked, old fiber's stack
+var setParked;
+var getParked;
+fun parked() {
+    var x = "x";
+    fun set(v) { x = v; }
+    fun get() { return x; }
+    setParked = set;
+    getParked = get;
+    yield();
+}
+var parkedFiber = Fiber(parked);
+resume(parkedFiber);
+churn();
+churn();
+setParked([1, young("two"), 3]);
+churn();
+churn();
+print getParked(); // expect: [1, two., 3]
+
+// instances that die young never reach the old generation
+var i = 0;
+while (i < 20000) {
+    var node = Holder();
+    node.value = young("node value");
+    i = i + 1;
+}
+print holder.value; // expect: fresh field.
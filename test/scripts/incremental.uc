@@ -0,0 +1,93 @@
+// backends: stack
+// flags: --gc-slice=20
+// tiny slices keep full collections running while the objects below are moved around
+class Node {
+    init(value, next) {
+        this.value = value;
+        this.next = next;
+    }
+}
+
+fun build(n) {
+    var head = nil;
+    for (var i = 0; i < n; i = i + 1) head = Node("v" + "x", head);
+    return head;
+}
+
+fun count(list) {
+    var n = 0;
+    while (list != nil) {
+        n = n + 1;
+        list = list.next;
+    }
+    return n;
+}
+
+// two lists whose nodes keep moving from one to the other, the only reference to a
+// node is often in a local or in an object the collector has already looked at
+var a = build(20000);
+var b = nil;
+for (var round = 0; round < 20000; round = round + 1) {
+    var node = a;
+    a = a.next;
+    node.next = b;
+    b = node;
+    node.value = "moved" + "!";
+}
+print count(a) + count(b); // expect: 20000
+print b.value; // expect: moved!
+
+// lists and closures filled while a collection runs
+var items = [];
+fun keeper(value) {
+    fun get() { return value; }
+    return get;
+}
+for (var i = 0; i < 20000; i = i + 1) {
+    push(items, keeper(Node(i, nil)));
+    if (i > 0) items[i - 1] = items[i];
+}
+print len(items); // expect: 20000
+print items[0]().value; // expect: 1
+print items[19999]().value; // expect: 19999
+
+// a fiber parked in the middle of a collection keeps what is on its stack
+fun worker() {
+    var mine = build(100);
+    while (true) yield(count(mine));
+}
+var fiber = Fiber(worker);
+var total = 0;
+for (var i = 0; i < 2000; i = i + 1) {
+    total = total + resume(fiber);
+    build(10);
+}
+print total; // expect: 200000
+
+// a store through a closure into a variable on a parked fiber's stack, after the fiber
+// got marked and old
+fun churn() {
+    var s = "";
+    for (var i = 0; i < 5000; i = i + 1) {
+        s = s + "x";
+        if (len(s) > 100) s = "";
+    }
+}
+var setParked;
+var getParked;
+fun parked() {
+    var x = "x";
+    fun set(v) { x = v; }
+    fun get() { return x; }
+    setParked = set;
+    getParked = get;
+    yield();
+}
+var parkedFiber = Fiber(parked);
+resume(parkedFiber);
+churn();
+churn();
+setParked([1, "two", 3]);
+churn();
+churn();
+print getParked(); // expect: [1, two, 3]
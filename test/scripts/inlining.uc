@@ -0,0 +1,51 @@
+// backends: stack
+// small global helpers are inlined at their call sites
+fun square(x) { return x * x; }
+fun add(a, b) { return a + b; }
+fun answer() { return 42; }
+fun greet(name) { return "hi " + name; }
+
+print square(7); // expect: 49
+print add(square(2), square(3)); // expect: 13
+print answer(); // expect: 42
+print greet("there"); // expect: hi there
+
+// parameters are the arguments' own slots, the caller's names don't leak in
+var x = 100;
+{
+    var a = 1;
+    var b = 2;
+    print add(b, a) + x; // expect: 103
+    var result = square(a + b);
+    print result; // expect: 9
+}
+
+// a global named like a caller's local still means the global
+var scale = 10;
+fun scaled(v) { return v * scale; }
+{
+    var scale = 2;
+    print scaled(3); // expect: 30
+}
+
+// inlined inside another function, on temporaries
+fun sumOfSquares(n) {
+    var total = 0;
+    var i = 1;
+    while (i <= n) {
+        total = total + square(i);
+        i = i + 1;
+    }
+    return total;
+}
+print sumOfSquares(10); // expect: 385
+
+// reassigning the global makes the inlined copies call the new function
+fun twice(v) { return square(v) + square(v); }
+square = greet;
+print twice("x"); // expect: hi xhi x
+
+// wrong argument count is a real call and a real error
+fun one(v) { return v; }
+print one(1, 2);
+// expect runtime error: Expected 1 arguments but got 2.
@@ -0,0 +1,55 @@
+// backends: stack
+class Counter {
+    init() { this.count = 0; }
+    add(by, times) {
+        this.count = this.count + by * times;
+        return this;
+    }
+    get() { return this.count; }
+}
+
+var c = Counter();
+print c.add(2, 3).add(1, 1).get(); // expect: 7
+
+// one call site sees receivers of different classes and shapes
+class Cat {
+    speak() { return "meow"; }
+}
+class Cow {
+    speak() { return "moo"; }
+}
+fun speak(animal) { return animal.speak(); }
+var cat = Cat();
+var cow = Cow();
+print speak(cat); // expect: meow
+print speak(cow); // expect: moo
+cat.name = "tom";
+print speak(cat); // expect: meow
+print speak(cow); // expect: moo
+
+// a field holding a function is called instead of the method, even after the site cached it
+class Box {
+    value() { return "method"; }
+}
+fun field() { return "field"; }
+fun callValue(box) { return box.value(); }
+var box = Box();
+print callValue(box); // expect: method
+box.value = field;
+print callValue(box); // expect: field
+box.value = clock;
+print callValue(box) > 0; // expect: true
+
+// super calls pass their arguments through
+class Base {
+    describe(a, b) { return "base " + a + b; }
+}
+class Derived < Base {
+    describe(a, b) { return super.describe(a, b) + " derived"; }
+}
+var d = Derived();
+print d.describe("x", "y"); // expect: base xy derived
+print d.describe("1", "2"); // expect: base 12 derived
+
+print c.get(1);
+// expect runtime error: Expected 0 arguments but got 1.
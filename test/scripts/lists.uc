@@ -0,0 +1,87 @@
+// backends: stack
+var numbers = [1, 2, 3];
+print numbers; // expect: [1, 2, 3]
+print numbers[0] + numbers[2]; // expect: 4
+print len(numbers); // expect: 3
+print []; // expect: []
+print len([]); // expect: 0
+
+// assignment evaluates to the item, like any other assignment
+print numbers[1] = 20; // expect: 20
+print numbers; // expect: [1, 20, 3]
+
+// push and pop at the end
+push(numbers, 4);
+print numbers; // expect: [1, 20, 3, 4]
+print pop(numbers); // expect: 4
+print len(numbers); // expect: 3
+
+// a non-number switches the list to boxed items, the numbers in it are kept
+var mixed = [1, 2];
+mixed[0] = "one";
+print mixed; // expect: [one, 2]
+push(mixed, nil);
+push(mixed, 3);
+print mixed; // expect: [one, 2, nil, 3]
+var grown = [];
+push(grown, 1.5);
+push(grown, true);
+print grown; // expect: [1.5, true]
+
+// any expression as an index, lists in lists
+var grid = [[1, 2], [3, 4]];
+var row = 1;
+print grid[row][row - 1]; // expect: 3
+grid[0][1] = grid[1][1] * 10;
+print grid; // expect: [[1, 40], [3, 4]]
+
+// lists are objects, shared and compared by identity
+var alias = numbers;
+alias[0] = 100;
+print numbers[0]; // expect: 100
+print [1] == [1]; // expect: false
+print alias == numbers; // expect: true
+
+// building one up in a loop and adding it up
+var squares = [];
+for (var i = 0; i < 1000; i = i + 1) push(squares, i * i);
+print len(squares); // expect: 1000
+print sum(squares); // expect: 3.32834e+08
+var total = 0;
+for (var i = 0; i < len(squares); i = i + 1) total = total + squares[i];
+print total == sum(squares); // expect: true
+
+// functions in lists escape their frame like any other stored function
+fun makeAdders() {
+    var n = 10;
+    fun add(x) { return x + n; }
+    return [add];
+}
+print makeAdders()[0](5); // expect: 15
+
+// errors are catchable
+try {
+    print numbers[3];
+} catch (e) {
+    print e; // expect: List index out of range.
+}
+try {
+    print numbers[0.5];
+} catch (e) {
+    print e; // expect: List index out of range.
+}
+try {
+    pop([]);
+} catch (e) {
+    print e; // expect: Can't pop from an empty list.
+}
+try {
+    sum(["a"]);
+} catch (e) {
+    print e; // expect: sum() expects a list of numbers.
+}
+print len("four"); // expect: 4
+
+var notList = "abc";
+notList[0];
+// expect runtime error: Only lists can be indexed.
@@ -0,0 +1,11 @@
+print true and false; // expect: false
+print false or "fallback"; // expect: fallback
+print nil or nil; // expect: nil
+print 1 and 2; // expect: 2
+print nil and undefinedButNeverRead; // expect: nil
+print "first" or undefinedButNeverRead; // expect: first
+{
+    var a = false;
+    var b = a or a and true;
+    print b; // expect: false
+}
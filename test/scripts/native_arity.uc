@@ -0,0 +1,3 @@
+// backends: stack
+abs(1, 2);
+// expect runtime error: Expected 1 arguments but got 2.
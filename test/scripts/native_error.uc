@@ -0,0 +1,4 @@
+// backends: stack
+print sqrt(4); // expect: 2
+sqrt("four");
+// expect runtime error: sqrt() expects a number.
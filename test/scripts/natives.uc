@@ -0,0 +1,24 @@
+// backends: stack
+print sqrt(16); // expect: 4
+print floor(2.7); // expect: 2
+print abs(-3); // expect: 3
+print max(1, 5, 3); // expect: 5
+print min(4, -2, 8); // expect: -2
+print max(7); // expect: 7
+print hash("abc") == hash("ab" + "c"); // expect: true
+print hash("abc") == hash("abd"); // expect: false
+
+// natives are ordinary values
+print sqrt; // expect: <native function: sqrt>
+var root = sqrt;
+print root(81); // expect: 9
+
+// clock() is monotonic, good enough to time a loop
+var start = clock();
+var sum = 0;
+for (var i = 0; i < 1000; i = i + 1) sum = sum + i;
+print clock() >= start; // expect: true
+
+// natives and script functions mix freely
+fun hypot(a, b) { return sqrt(a * a + b * b); }
+print hypot(3, 4); // expect: 5
@@ -0,0 +1,10 @@
+// the left operand is read before the right one runs, even when the right one assigns it
+{
+    var a = 1;
+    print a + (a = 10); // expect: 11
+    print a; // expect: 10
+    var b = 2;
+    print b - (b = 1) * 10; // expect: -8
+}
+var g = 1;
+print g + (g = 10); // expect: 11
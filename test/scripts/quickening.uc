@@ -0,0 +1,33 @@
+// every + below runs many times, first on numbers, so the VM quickens it for numbers.
+// Once other types turn up it has to fall back to the generic instruction.
+var a = 1;
+var b = 2;
+var last;
+for (var i = 0; i < 20; i = i + 1) {
+    if (i == 10) {
+        a = "x";
+        b = "y";
+    }
+    last = a + b;
+    if (i == 9) print last; // expect: 3
+}
+print last; // expect: xy
+
+// and back to numbers after being quickened for strings
+for (var i = 0; i < 20; i = i + 1) {
+    if (i == 10) {
+        a = 10;
+        b = 0.5;
+    }
+    last = a + b;
+    if (i == 9) print last; // expect: xy
+}
+print last; // expect: 10.5
+
+// a number and a string at a site quickened for numbers still raise the generic error
+var n = 1;
+for (var i = 0; i < 20; i = i + 1) {
+    if (i == 10) n = "one";
+    last = n + 1;
+}
+// expect runtime error: Operands must be two numbers or two strings.
@@ -0,0 +1,3 @@
+// backends: stack
+return 1;
+// expect compile error: Can't return from top-level code.
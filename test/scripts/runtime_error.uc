@@ -0,0 +1,4 @@
+print "before"; // expect: before
+print 1 + "a";
+print "never";
+// expect runtime error: Operands must be two numbers or two strings.
@@ -0,0 +1,7 @@
+// backends: stack
+// not a tail call, the addition still needs the frame after the call returns
+fun forever(n) {
+    return forever(n + 1) + 1;
+}
+forever(0);
+// expect runtime error: Stack overflow.
@@ -0,0 +1,10 @@
+print "hello"; // expect: hello
+print "con" + "cat"; // expect: concat
+var a = "x";
+var b = a + "y";
+print b + b; // expect: xyxy
+{
+    var s = "";
+    for (var i = 0; i < 3; i = i + 1) s = s + "ab";
+    print s; // expect: ababab
+}
@@ -0,0 +1,47 @@
+// backends: stack
+// far deeper than FRAMES_MAX, only runs because every call reuses its caller's frame
+fun count(n, acc) {
+    if (n == 0) return acc;
+    return count(n - 1, acc + 1);
+}
+print count(100000, 0); // expect: 100000
+
+// mutual recursion as a state machine
+fun isEven(n) {
+    if (n == 0) return true;
+    return isOdd(n - 1);
+}
+fun isOdd(n) {
+    if (n == 0) return false;
+    return isEven(n - 1);
+}
+print isEven(50001); // expect: false
+
+// natives in tail position are plain calls
+fun root(x) { return sqrt(x); }
+print root(16); // expect: 4
+
+// the frame goes away, captured locals must be closed first
+fun makeGetter(value) {
+    fun get() { return value; }
+    return id(get);
+}
+fun id(f) { return f; }
+print makeGetter("kept")(); // expect: kept
+
+// a local helper that reads the caller's variables keeps its caller's frame
+fun outer(n) {
+    var base = 10;
+    fun add(x) { return base + x; }
+    return add(n);
+}
+print outer(5); // expect: 15
+
+// short circuit paths skip the call and still return the right value
+fun either(a) { return a or count(3, 0); }
+print either(false); // expect: 3
+print either("left"); // expect: left
+
+fun wrongArity() { return count(1); }
+wrongArity();
+// expect runtime error: Expected 2 arguments but got 1.
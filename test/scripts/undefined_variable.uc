@@ -0,0 +1,4 @@
+var defined = 1;
+print defined; // expect: 1
+print notDefined;
+// expect runtime error: Undefined variable 'notDefined'.
@@ -0,0 +1,28 @@
+var g = 1;
+print g; // expect: 1
+g = g + 1;
+print g; // expect: 2
+var u;
+print u; // expect: nil
+{
+    var a = "outer";
+    {
+        var a = "inner";
+        print a; // expect: inner
+    }
+    print a; // expect: outer
+    var b = a;
+    b = "changed";
+    print a; // expect: outer
+    print b; // expect: changed
+}
+// assignment is an expression and yields the assigned value
+var c;
+var d = c = 3;
+print c + d; // expect: 6
+{
+    var x = 1;
+    var y = 2;
+    x = y = 5;
+    print x + y; // expect: 10
+}